@@ -3,6 +3,11 @@
  * Save the result in another point cloud that will be recovered later.
  * We exploit the reading of ply with properties to retrieve the color information
  * and use it for classification as well
+ * With --sort the points are sorted along a Morton curve after reading (../utils/spatial_sort.hpp),
+ * so that the neighborhoods of the features find their points close in memory; they are written
+ * back in the order they were read
+ * With --approx <epsilon> (and --max-checks <n>) the k nearest neighbors of the eigen analysis and of
+ * the graphcut come from a grid search that may stop early (../utils/knn_grid.hpp)
  * Courtesy of: 
  * (classification) https://doc.cgal.org/lates-/Classification/Classification_2example_classification_8cpp-example.html
  * (read ply props) https://doc.cgal.org/latest/Point_set_processing_3/index.html#Point_set_processing_3Example_ply_read
@@ -14,6 +19,7 @@
 #endif
 
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -33,6 +39,9 @@
 // control the time needed by the algorithm
 #include <CGAL/Real_timer.h>
 
+#include "../utils/knn_grid.hpp"
+#include "../utils/spatial_sort.hpp"
+
 #ifdef CGAL_LINKED_WITH_TBB
 typedef CGAL::Parallel_tag Concurrency_tag;
 #else
@@ -136,36 +145,100 @@ public:
     
 };
 
+// Sort the points along a Morton curve; point_of gives the position of an element. Returns the
+// permutation back to the order of the input: the point now at j was at original[j]
+template <typename T, typename Point_of>
+std::vector<std::size_t> sort_points (std::vector<T>& points, const Point_of& point_of)
+{
+	CGAL::Real_timer t;
+	t.start();
+	std::vector<std::size_t> original = morton_order(points.size(), [&](std::size_t i)
+	{
+		const Point& p = point_of(points[i]);
+		return make_vec3(p.x(), p.y(), p.z());
+	});
+	apply_order(points, original);
+	t.stop();
+	std::cerr << "Points sorted along a Morton curve in " << t.time() << " s" << std::endl;
+	return original;
+}
+
+// Indices of the n points in the order of the input, given original as returned by sort_points
+// (and kept in step with the points removed since); empty if the points were not sorted
+std::vector<std::size_t> input_order (std::size_t n, const std::vector<std::size_t>& original)
+{
+	std::vector<std::size_t> order (n);
+	for (std::size_t i = 0; i < n; i++)
+		order[i] = i;
+	if (!original.empty())
+		parallel_sort(order.begin(), order.end(), [&original](std::size_t a, std::size_t b) { return original[a] < original[b]; });
+	return order;
+}
+
+// k nearest neighbors on a Knn_grid, as a NeighborQuery of the classification: the query point is
+// one of the k, as with Point_set_neighborhood::k_neighbor_query
+class Grid_k_neighbor_query
+{
+public:
+	typedef Point value_type;
+
+	Grid_k_neighbor_query (const Knn_grid& grid, std::size_t k) : m_grid(&grid), m_k(k) {}
+
+	template <typename OutputIterator>
+	OutputIterator operator() (const value_type& query, OutputIterator output) const
+	{
+		std::vector<Knn_neighbor> neighbors;
+		m_grid->search(make_vec3(query.x(), query.y(), query.z()), m_k, [](std::size_t) { return true; }, neighbors);
+		for (std::size_t j = 0; j < neighbors.size(); j++)
+			*output++ = neighbors[j].second;
+		return output;
+	}
+
+private:
+	const Knn_grid*	m_grid;
+	std::size_t			m_k;
+};
+
+std::vector<Vec3> positions_of (const Point_range& point_cloud)
+{
+	std::vector<Vec3> positions (point_cloud.size());
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+		positions[i] = make_vec3(point_cloud[i].x(), point_cloud[i].y(), point_cloud[i].z());
+	return positions;
+}
+
 int main (int argc, char** argv)
 {
-	if (argc < 3 || argc > 5) 
+	if (argc < 3 || argc > 10) 
 	{
 		std::cerr << "ERROR: no arguments." << std::endl;
-		std::cerr << "\tUsage: $ classification [-v|--verbose] [--with-properties] <input_file.ply> <output_file.ply>\n";
+		std::cerr << "\tUsage: $ classification [-v|--verbose] [--with-properties] [--sort] [--approx <epsilon>] [--max-checks <n>] "
+							<< "<input_file.ply> <output_file.ply>\n";
+		std::cerr << "\twith --approx the k nearest neighbors are within 1 + epsilon of the exact ones, "
+							<< "--max-checks bounds the distances computed by each query\n";
 		return EXIT_FAILURE;
 	}
 	
-	bool 										with_properties, verbose;
-	std::string							input_file, output_file;
-	switch(argc)
+	bool 										with_properties = false, verbose = false, sort = false;
+	std::string							input_file = argv[argc - 2], output_file = argv[argc - 1];
+	Knn_parameters					knn;
+	for (int a = 1; a < argc - 2; a++)
 	{
-		case 3:
-			with_properties = verbose = false;
-			input_file = argv[1];
-			output_file = argv[2];
-			break;
-		case 4:
-			with_properties = (std::strcmp(argv[1], "--with-properties") == 0)? true : false;
-			verbose = ((std::strcmp(argv[1],"-v") == 0) || (std::strcmp(argv[1],"--verbose") == 0))? true : false;
-			input_file = argv[2];
-			output_file = argv[3];
-			break;
-		case 5:
-			verbose = ((std::strcmp(argv[1],"-v") == 0) || (std::strcmp(argv[1],"--verbose") == 0))? true : false;
-			with_properties = (std::strcmp(argv[2], "--with-properties") == 0)? true : false;
-			input_file = argv[3];
-			output_file = argv[4];
-			break;
+		if ((std::strcmp(argv[a],"-v") == 0) || (std::strcmp(argv[a],"--verbose") == 0))
+			verbose = true;
+		else if (std::strcmp(argv[a], "--with-properties") == 0)
+			with_properties = true;
+		else if (std::strcmp(argv[a], "--sort") == 0)
+			sort = true;
+		else if (std::strcmp(argv[a], "--approx") == 0 && a + 1 < argc - 2 && atof(argv[a + 1]) >= 0.0)
+			knn.epsilon = atof(argv[++a]);
+		else if (std::strcmp(argv[a], "--max-checks") == 0 && a + 1 < argc - 2 && atoi(argv[a + 1]) > 0)
+			knn.max_checks = std::size_t(atoi(argv[++a]));
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
 	}
 
 	std::ifstream 					in (input_file.c_str());
@@ -173,6 +246,7 @@ int main (int argc, char** argv)
 	std::vector<HSV_Color>	hsv_color_cloud;
 	std::vector<Color>			color_cloud;
 	std::vector<PNCI> 			point_cloud_with_properties; 		
+	std::vector<std::size_t>	original;		// with --sort, the index each point had in the input
 	
 	std::cerr << "Reading input..." << std::endl;
 	if (!with_properties)
@@ -183,6 +257,8 @@ int main (int argc, char** argv)
 			return EXIT_FAILURE;
 		}
 		std::cerr << "File read successfully!" << std::endl;
+		if (sort)
+			original = sort_points(point_cloud, [](const Point& p) { return p; });
 		
 		// file is open, let's store its values
 		float 				grid_resolution = 0.34f;
@@ -196,8 +272,21 @@ int main (int argc, char** argv)
 		// a 2D grid, where lines have resolution given
 		Planimetric_grid grid (point_cloud, Pmap(), bbox, grid_resolution);
 		Neighborhood neighborhood (point_cloud, Pmap());
-		Local_eigen_analysis eigen = Local_eigen_analysis::create_from_point_set(	point_cloud, Pmap(), 
-																																							neighborhood.k_neighbor_query(number_of_neighbors));
+		// approximate k nearest neighbors on a grid, or the exact ones of the neighborhood
+		std::vector<Vec3> positions;
+		Knn_grid knn_grid;
+		if (!knn.exact())
+		{
+			positions = positions_of(point_cloud);
+			knn_grid.build(positions, number_of_neighbors, knn);
+		}
+		CGAL::Real_timer t_eigen;
+		t_eigen.start();
+		Local_eigen_analysis eigen = (knn.exact())?
+			Local_eigen_analysis::create_from_point_set(point_cloud, Pmap(), neighborhood.k_neighbor_query(number_of_neighbors)) :
+			Local_eigen_analysis::create_from_point_set(point_cloud, Pmap(), Grid_k_neighbor_query(knn_grid, number_of_neighbors));
+		t_eigen.stop();
+		std::cerr << "Local eigen analysis performed in " << t_eigen.time() << " seconds [s]" << std::endl;
 																																						
 		float radius_neighbors = 0.05f; //1.7f;
 		float radius_dtm = 0.7; //15.0f; 			// ??
@@ -278,8 +367,12 @@ int main (int argc, char** argv)
 		t.reset();
 	
 		t.start();
-		Classification::classify_with_graphcut<Concurrency_tag> (	point_cloud, Pmap(), labels, classifier,
-																															neighborhood.k_neighbor_query(12), 0.2f, 4, label_indices);
+		if (knn.exact())
+			Classification::classify_with_graphcut<Concurrency_tag> (	point_cloud, Pmap(), labels, classifier,
+																																neighborhood.k_neighbor_query(12), 0.2f, 4, label_indices);
+		else
+			Classification::classify_with_graphcut<Concurrency_tag> (	point_cloud, Pmap(), labels, classifier,
+																																Grid_k_neighbor_query(knn_grid, 12), 0.2f, 4, label_indices);
 		t.stop();
 		std::cerr << "Classification with graphcut performed in " << t.time() << " seconds [s]" << std::endl;
 		t.reset();
@@ -297,8 +390,11 @@ int main (int argc, char** argv)
 			<< "property uchar blue" << std::endl
 			<< "end_header" << std::endl; 
 
-		for (std::size_t i=0; i<point_cloud.size(); ++i)
+		// in the order of the input
+		const std::vector<std::size_t> order = input_order(point_cloud.size(), original);
+		for (std::size_t j=0; j<point_cloud.size(); ++j)
 		{
+			const std::size_t i = order[j];
 			f << point_cloud[i] << " ";
 		
 			Label_handle label = labels[std::size_t(label_indices[i])];
@@ -332,6 +428,8 @@ int main (int argc, char** argv)
 			return EXIT_FAILURE;
 		}
 		std::cerr << "File with properties (point, normal, color, intensity) read successfully!" << std::endl;
+		if (sort)
+			original = sort_points(point_cloud_with_properties, [](const PNCI& p) { return std::get<0>(p); });
 		
 		//-----------------------------------------------------------------------------------------------------------------------------------
 		std::vector<Point> point_cloud_to_purge;
@@ -368,6 +466,7 @@ int main (int argc, char** argv)
 		// now use the iterator to find out the other points
 		std::vector<Point>::const_iterator pi = point_cloud.begin();
 		std::vector<Color>::const_iterator ci = color_cloud.begin();
+		std::vector<std::size_t>::const_iterator oi = original.begin();
 		while (pi != point_cloud.end())
 		{
 			// if the point is an outlier, remove it
@@ -382,17 +481,22 @@ int main (int argc, char** argv)
 				}
 				point_cloud.erase(pi);
 				color_cloud.erase(ci);
+				if (!original.empty())
+					original.erase(oi);
 				// when erased, we get the iterator to the next position, so there is no need
 				// to advance. We should instead advance with first_to_remove, and restart from
 				// the beginning with the others (high complexity, that's true...)
 				first_to_remove++;
 				pi = point_cloud.begin();
 				ci = color_cloud.begin();
+				oi = original.begin();
 			}
 			else
 			{
 				pi++;
 				ci++;
+				if (!original.empty())
+					oi++;
 			}
 		}
 		
@@ -413,8 +517,21 @@ int main (int argc, char** argv)
 		// a 2D grid, where lines have resolution given
 		Planimetric_grid grid (point_cloud, Pmap(), bbox, grid_resolution);
 		Neighborhood neighborhood (point_cloud, Pmap());
-		Local_eigen_analysis eigen = Local_eigen_analysis::create_from_point_set(	point_cloud, Pmap(), 
-																																							neighborhood.k_neighbor_query(number_of_neighbors));
+		// approximate k nearest neighbors on a grid, or the exact ones of the neighborhood
+		std::vector<Vec3> positions;
+		Knn_grid knn_grid;
+		if (!knn.exact())
+		{
+			positions = positions_of(point_cloud);
+			knn_grid.build(positions, number_of_neighbors, knn);
+		}
+		CGAL::Real_timer t_eigen;
+		t_eigen.start();
+		Local_eigen_analysis eigen = (knn.exact())?
+			Local_eigen_analysis::create_from_point_set(point_cloud, Pmap(), neighborhood.k_neighbor_query(number_of_neighbors)) :
+			Local_eigen_analysis::create_from_point_set(point_cloud, Pmap(), Grid_k_neighbor_query(knn_grid, number_of_neighbors));
+		t_eigen.stop();
+		std::cerr << "Local eigen analysis performed in " << t_eigen.time() << " seconds [s]" << std::endl;
 																																						
 		float radius_neighbors = 0.05f; //1.7f;
 		float radius_dtm = 0.7; //15.0f; 			// ??
@@ -495,8 +612,12 @@ int main (int argc, char** argv)
 		t.reset();
 	
 		t.start();
-		Classification::classify_with_graphcut<Concurrency_tag> (	point_cloud, Pmap(), labels, classifier,
-																															neighborhood.k_neighbor_query(12), 0.2f, 4, label_indices);
+		if (knn.exact())
+			Classification::classify_with_graphcut<Concurrency_tag> (	point_cloud, Pmap(), labels, classifier,
+																																neighborhood.k_neighbor_query(12), 0.2f, 4, label_indices);
+		else
+			Classification::classify_with_graphcut<Concurrency_tag> (	point_cloud, Pmap(), labels, classifier,
+																																Grid_k_neighbor_query(knn_grid, 12), 0.2f, 4, label_indices);
 		t.stop();
 		std::cerr << "Classification with graphcut performed in " << t.time() << " seconds [s]" << std::endl;
 		t.reset();
@@ -514,8 +635,11 @@ int main (int argc, char** argv)
 			<< "property uchar blue" << std::endl
 			<< "end_header" << std::endl; 
 
-		for (std::size_t i=0; i<point_cloud.size(); ++i)
+		// in the order of the input
+		const std::vector<std::size_t> order = input_order(point_cloud.size(), original);
+		for (std::size_t j=0; j<point_cloud.size(); ++j)
 		{
+			const std::size_t i = order[j];
 			f << point_cloud[i] << " ";
 		
 			Label_handle label = labels[std::size_t(label_indices[i])];
@@ -1,6 +1,6 @@
 /*
- * Clear a point cloud basing on colors
- * 1) read a ply 2) write on another ply only point_cloud_with_properties with desised color
+ * Clear a point cloud basing on the labels assigned by the shape detectors
+ * 1) read a ply 2) write on another ply only the points with the desired shape kind
  */
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/property_map.h>
@@ -11,6 +11,10 @@
 #include <fstream>
 
 #include "../utils/colors.hpp"
+#include "../utils/labels.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/ply_header.hpp"
+#include "../utils/shm_cloud.hpp"
 
 // types
 typedef CGAL::Exact_predicates_inexact_constructions_kernel EPIC_kernel; 
@@ -19,45 +23,66 @@ typedef EPIC_kernel::Point_3 Point;
 typedef EPIC_kernel::Vector_3 Vector;
 typedef CGAL::cpp11::array<unsigned char, 3> Color; // a color is a vector of 3 unsigned chars (values 0, 255)		
 
-// define a type for a point with normal, color (P-N-C)
-typedef CGAL::cpp11::tuple<Point,Vector,Color> 		PNC;			
-typedef CGAL::Nth_of_tuple_property_map<0, PNC>	Point_map;	
-typedef CGAL::Nth_of_tuple_property_map<1, PNC>	Normal_map;
-typedef CGAL::Nth_of_tuple_property_map<2, PNC>	Color_map;
+// define a type for a point with normal and label (P-N-L)
+typedef CGAL::cpp11::tuple<Point,Vector,Shape_kind,Shape_id>	PNL;			
+typedef CGAL::Nth_of_tuple_property_map<0, PNL>	Point_map;	
+typedef CGAL::Nth_of_tuple_property_map<1, PNL>	Normal_map;
+typedef CGAL::Nth_of_tuple_property_map<2, PNL>	Kind_map;
+typedef CGAL::Nth_of_tuple_property_map<3, PNL>	Id_map;
 
 
 
 int main(int argc, char** argv)
 {
-	if (argc < 3 || argc > 4)
+	if (argc < 3 || argc > 5)
 	{
-		std::cerr << "ERROR: wrong arguments.\n\tUsage: $ clear_shape [--keep-color] <input_file.ply> <output_file.ply>\n";
+		std::cerr << "ERROR: wrong arguments.\n\tUsage: $ clear_shape [--keep-color] [--colors] <input_file.ply> <output_file.ply>\n";
 		return EXIT_FAILURE;
 	}
 	if (strcmp(argv[1], "--help") == 0)
 	{
-		std::cerr << "\tclear_shape [--keep-color] <input_file.ply> <output_file.ply>\n";
-		std::cerr << "\nClear a point cloud of points with unidentified colors (the grey ones), "
-							<< "or color non belonging to cylindrical shapes.\n"
-							<< "Use --keep_color to remove grey points only; else only cylinders will be maintained\n";
+		std::cerr << "\tclear_shape [--keep-color] [--colors] <input_file.ply> <output_file.ply>\n";
+		std::cerr << "\nClear a point cloud of points left unassigned by the shape detection, "
+							<< "or assigned to shapes which are not cylinders.\n"
+							<< "Use --keep-color to remove unassigned points only; else only cylinders will be maintained\n"
+							<< "Use --colors to write the shape colors too (for visualization only)\n"
+							<< "Input and output can also be shared memory segments: shm://<name>\n";
 		return EXIT_FAILURE;
 	}
 	
-	bool 				keep_color = (strcmp(argv[1], "--keep-color") == 0)? true : false;
-	std::string input_file = (argc == 3)? argv[1] : argv[2];
-	std::string output_file = (argc == 3)? argv[2]: argv[3];
+	bool 				keep_color = false;
+	bool				with_colors = false;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp(argv[a], "--keep-color") == 0)
+			keep_color = true;
+		else if (strcmp(argv[a], "--colors") == 0)
+			with_colors = true;
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::string input_file = argv[argc - 2];
+	std::string output_file = argv[argc - 1];
+	Cloud_uri input = parse_cloud_uri(input_file), output = parse_cloud_uri(output_file);
 	
-	std::vector<PNC> point_cloud_with_properties; 		
-	std::ifstream in (input_file);	
-	if (!in || !(CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud_with_properties), 
-																											CGAL::make_ply_point_reader (Point_map()),
-																											std::make_tuple (	Color_map(),
-																																				CGAL::Construct_array(),
-																																				CGAL::PLY_property<unsigned char>("red"),
-																																				CGAL::PLY_property<unsigned char>("green"),
-																																				CGAL::PLY_property<unsigned char>("blue")),
-																											CGAL::make_ply_normal_reader (Normal_map())
-																											)))
+	std::vector<PNL> point_cloud_with_properties; 		
+	std::ifstream in;
+	bool read;
+	if (input.shared)
+		read = attach_labeled_tuples(input, point_cloud_with_properties);
+	else
+	{
+		in.open(input.path);
+		read = in && CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud_with_properties),
+																												CGAL::make_ply_point_reader (Point_map()),
+																												CGAL::make_ply_normal_reader (Normal_map()),
+																												std::make_pair (Kind_map(), CGAL::PLY_property<unsigned char>("label")),
+																												std::make_pair (Id_map(), CGAL::PLY_property<int>("shape_id")));
+	}
+	if (!read)
 	{
 		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
 		return EXIT_FAILURE;
@@ -65,44 +90,47 @@ int main(int argc, char** argv)
 	in.close();
 	std::cerr << "Read successfully " << point_cloud_with_properties.size() << " point(s)" << std::endl;
 	
-	// erase PNCs with "wrong" color
+	// erase PNLs with "wrong" label: one lookup per point, then a parallel compaction
 	std::cerr << "Selecting points with desired classification...\n";
-	std::vector<PNC> point_cloud;
-	for (std::vector<PNC>::iterator i = point_cloud_with_properties.begin(); i != point_cloud_with_properties.end(); i++)
+	const Keep_table keep = keep_color? keep_assigned() : keep_cylinders();
+	std::vector<unsigned char> flags (point_cloud_with_properties.size());
+	parallel_for_each_index(flags.size(), [&](std::size_t i)
 	{
-		Color& c = get<2>(*i);
-		if (keep_color && is_color_value(c))
-			point_cloud.push_back(*i);
-		else if (is_blue_value(c))
-			point_cloud.push_back(*i);
-	}
+		flags[i] = keep.keep[get<2>(point_cloud_with_properties[i])];
+	});
+	std::vector<std::size_t> selected = parallel_select(flags);
+	std::vector<PNL> point_cloud (selected.size());
+	parallel_for_each_index(selected.size(), [&](std::size_t i)
+	{
+		point_cloud[i] = point_cloud_with_properties[selected[i]];
+	});
 	std::cerr << "Final cloud has " << point_cloud.size() << " point(s)\n";
 	
 	// saving
-	std::ofstream out (output_file);
 	std::cerr << "Saving output...\n";
-	out	<< "ply " << std::endl
-			<< "format ascii 1.0" << std::endl
-			<< "element vertex " << point_cloud.size() << std::endl
-			<< "property float x" << std::endl
-			<< "property float y" << std::endl
-			<< "property float z" << std::endl
-			<< "property float nx" << std::endl
-			<< "property float ny" << std::endl
-			<< "property float nz" << std::endl
-			<< "property uchar red" << std::endl
-			<< "property uchar green" << std::endl
-			<< "property uchar blue" << std::endl
-			<< "end_header" << std::endl; 
+	if (output.shared)
+	{
+		if (!publish_labeled_tuples(output, point_cloud))
+		{
+			std::cerr << "ERROR: cannot write shared memory segment " << output.path << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	std::ofstream out (output.path);
+	write_ply_header(out, point_cloud.size(), true, with_colors, true);
 
-	for (std::vector<PNC>::iterator i = point_cloud.begin(); i != point_cloud.end(); ++i)
+	for (std::vector<PNL>::iterator i = point_cloud.begin(); i != point_cloud.end(); ++i)
 	{
 		out << get<0>(*i) << " " << get<1>(*i) << " ";
-		out << int(get<2>(*i)[0]) << " " << int(get<2>(*i)[1]) << " " << int(get<2>(*i)[2]) << std::endl;
+		if (with_colors)
+		{
+			Color c = get_label_color(get<2>(*i), get<3>(*i));
+			out << int(c[0]) << " " << int(c[1]) << " " << int(c[2]) << " ";
+		}
+		out << int(get<2>(*i)) << " " << get<3>(*i) << std::endl;
 	}
 	out.close();
 	
 	return EXIT_SUCCESS;	
-}
-
- 
+}
\ No newline at end of file
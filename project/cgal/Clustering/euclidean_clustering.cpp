@@ -0,0 +1,115 @@
+/*
+ * EUCLIDEAN CLUSTERING
+ * Split the cloud into its connected pieces (axle, wheels, brake parts, rail fragments...): points
+ * closer than a radius belong to the same cluster. Each point gets the index of its cluster, the
+ * biggest cluster being 0; clusters too small to hold a shape can be dropped.
+ */
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/property_map.h>
+#include <CGAL/IO/read_ply_points.h>
+#include <CGAL/Real_timer.h>
+
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include <fstream>
+
+#include "../utils/colors.hpp"
+#include "../utils/ply_header.hpp"
+#include "../funcs/euclidean_clustering.hpp"
+
+// types
+typedef CGAL::Exact_predicates_inexact_constructions_kernel EPIC_kernel;
+typedef EPIC_kernel::Point_3 Point;
+typedef EPIC_kernel::Vector_3 Vector;
+typedef std::pair<Point, Vector>															Point_with_normal;
+typedef std::vector<Point_with_normal>												Pwn_vector;
+typedef CGAL::First_of_pair_property_map<Point_with_normal>		Point_map;
+typedef CGAL::Second_of_pair_property_map<Point_with_normal> 	Normal_map;
+
+int main(int argc, char** argv)
+{
+	if (argc < 3 || argc > 9 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\teuclidean_clustering [-v] [--radius <r>] [--min-points <n>] [--colors] <input_file.ply> <output_file.ply>\n";
+		std::cerr << "\nLabel each point with the index of its connected piece (property cluster, 0 is the biggest).\n"
+							<< "Use --radius to set the largest gap inside a piece (default 0.05)\n"
+							<< "Use --min-points to drop the pieces with less points (default 1: keep all)\n"
+							<< "Use --colors to write a color per cluster (for visualization only)\n";
+		return EXIT_FAILURE;
+	}
+
+	bool				verbose = false;
+	bool				with_colors = false;
+	double			radius = 0.05;
+	std::size_t	min_points = 1;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp(argv[a], "-v") == 0 || strcmp(argv[a], "--verbose") == 0)
+			verbose = true;
+		else if (strcmp(argv[a], "--colors") == 0)
+			with_colors = true;
+		else if (strcmp(argv[a], "--radius") == 0 && a + 1 < argc - 2 && atof(argv[a + 1]) > 0.0)
+			radius = atof(argv[++a]);
+		else if (strcmp(argv[a], "--min-points") == 0 && a + 1 < argc - 2 && atol(argv[a + 1]) > 0)
+			min_points = std::size_t(atol(argv[++a]));
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::string input_file = argv[argc - 2];
+	std::string output_file = argv[argc - 1];
+
+	Pwn_vector point_cloud;
+	std::ifstream in (input_file);
+	if (!in || !CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud),
+																											CGAL::make_ply_point_reader (Point_map()),
+																											CGAL::make_ply_normal_reader (Normal_map())
+																											))
+	{
+		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
+		return EXIT_FAILURE;
+	}
+	in.close();
+	std::cerr << "Read successfully " << point_cloud.size() << " point(s)" << std::endl;
+
+	CGAL::Real_timer t;
+	t.start();
+	std::vector<Vec3> points (point_cloud.size());
+	parallel_for_each_index(points.size(), [&](std::size_t i)
+	{
+		const Point& p = point_cloud[i].first;
+		points[i] = make_vec3(p.x(), p.y(), p.z());
+	});
+	std::vector<std::vector<std::size_t> > clusters = euclidean_clusters(points, radius, min_points);
+	t.stop();
+	std::size_t kept = 0;
+	for (std::size_t c = 0; c < clusters.size(); c++)
+		kept += clusters[c].size();
+	std::cerr << clusters.size() << " cluster(s) with " << kept << " point(s) after " << t.time() << " second(s)\n";
+	if (verbose)
+		for (std::size_t c = 0; c < clusters.size(); c++)
+			std::cerr << "Cluster " << c << ": " << clusters[c].size() << " point(s)\n";
+
+	// saving, cluster by cluster
+	std::ofstream out (output_file);
+	std::cerr << "Saving output...\n";
+	write_ply_header(out, kept, true, with_colors, false, true);
+	for (std::size_t c = 0; c < clusters.size(); c++)
+	{
+		Color color = (c % 2 == 0)? get_blue_value(c / 2) : get_yellow_value(c / 2);
+		for (std::size_t k = 0; k < clusters[c].size(); k++)
+		{
+			const Point_with_normal& p = point_cloud[clusters[c][k]];
+			out << p.first << " " << p.second << " ";
+			if (with_colors)
+				out << int(color[0]) << " " << int(color[1]) << " " << int(color[2]) << " ";
+			out << c << std::endl;
+		}
+	}
+	out.close();
+
+	return EXIT_SUCCESS;
+}
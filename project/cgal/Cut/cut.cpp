@@ -1,16 +1,22 @@
 /*
  * CUT FROM A CLOUD PARTS THAT FOR SURE ARE NOT RELATIVE TO THE AXLE
- * Reads Point - Normal - Color and saves it as well
+ * Reads Point - Normal - Color and saves it as well (Point - Normal with --no-colors: the colors are
+ * not even parsed, see utils/attributes.hpp)
+ * With --auto the box of limits.ply only bounds a tighter box found on the cloud itself
+ * (see funcs/auto_limits.hpp), which is saved beside the output as <output>_limits.ply
  */
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-#include <CGAL/property_map.h>
-#include <CGAL/IO/read_ply_points.h>
-#include <CGAL/compute_average_spacing.h>
-#include <CGAL/remove_outliers.h>
-
+#include <cstdlib>
+#include <cstring>
 #include <utility>
 #include <vector>
 #include <fstream>
+#include <iostream>
+#include <string>
+
+#include "../funcs/auto_limits.hpp"
+#include "../utils/attributes.hpp"
+#include "../utils/ply_cloud.hpp"
+#include "../utils/shm_cloud.hpp"
 
 #define X_UP_LIMIT		100.0
 #define Y_UP_LIMIT		0.6
@@ -19,55 +25,33 @@
 #define Y_DOWN_LIMIT	(-0.6)
 #define Z_DOWN_LIMIT	0.3
 
-// types
-typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel; // Kernel we use
-typedef Kernel::FT FT;																							// a model of FieldNumberType
-typedef Kernel::Point_3 Point; 											
-typedef Kernel::Vector_3 Vector;
-typedef CGAL::cpp11::array<unsigned char, 3> Color; // a color is a vector of 3 unsigned chars (values 0, 255)		
-
-// define a type for a point with normal, color and (P-N-C)
-typedef CGAL::cpp11::tuple<Point,Vector,Color> 		PNC;					// this is the tuple of properties we want to extract
-typedef CGAL::Nth_of_tuple_property_map<0, PNC>		Point_map;		// group of tuples to focus on points??
-typedef CGAL::Nth_of_tuple_property_map<1, PNC>		Normal_map;
-typedef CGAL::Nth_of_tuple_property_map<2, PNC>		Color_map;
-
-int main(int argc, char** argv)
+// Cut the cloud with the columns of the attribute set: only the positions are looked at, the
+// other columns are carried along
+template <typename Attributes>
+int cut_cloud (const std::string& input_file, const std::string& output_file, const std::string& limits_file, bool auto_limits_mode)
 {
-	if (argc != 4)
+	Point_cloud point_cloud, limits;
+	Cloud_uri input = parse_cloud_uri(input_file), output = parse_cloud_uri(output_file);
+	std::ifstream in;
+	bool read;
+	if (input.shared)
+		read = attach_cloud_attributes<Attributes>(input, point_cloud);
+	else
 	{
-		std::cerr << "ERROR: wrong arguments.\n\tUsage: $ cut <input_file.ply> <output_file.ply> <limits.ply>\n";
-		return EXIT_FAILURE;
+		in.open(input.path);
+		read = in && read_ply_cloud<Attributes>(in, point_cloud);
 	}
-	
-	std::string input_file, output_file, limits_file;
-	input_file = argv[1];
-	output_file = argv[2];
-	limits_file = argv[3];
-
-	std::vector<PNC> point_cloud_with_properties;
-	std::vector<PNC> limits;
-	std::ifstream in (input_file);	
-	if (!in || !(CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud_with_properties), 
-																											CGAL::make_ply_point_reader (Point_map()),
-																											std::make_tuple (	Color_map(),
-																																				CGAL::Construct_array(),
-																																				CGAL::PLY_property<unsigned char>("red"),
-																																				CGAL::PLY_property<unsigned char>("green"),
-																																				CGAL::PLY_property<unsigned char>("blue")),
-																											CGAL::make_ply_normal_reader (Normal_map())
-																											)))
+	if (!read)
 	{
 		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
 		return EXIT_FAILURE;
 	}
 	in.close();
-	std::cerr << "Read successfully " << point_cloud_with_properties.size() << " point(s)\n";
+	const std::size_t read_size = point_cloud.size();
+	std::cerr << "Read successfully " << read_size << " point(s)\n";
 	// read limits
 	in.open(limits_file);
-	if (!in || !CGAL::read_ply_points_with_properties(	in, std::back_inserter(limits), 
-																											CGAL::make_ply_point_reader (Point_map())
-																											))
+	if (!in || !read_ply_cloud<Attrs<XYZ> >(in, limits))
 	{
 		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
 		return EXIT_FAILURE;
@@ -77,53 +61,86 @@ int main(int argc, char** argv)
 		std::cerr << "ERROR: wrong limits size" << std::endl;
 		return EXIT_FAILURE;
 	}
-	const double XMIN = (get<0>(limits[0]))[0];
-	const double XMAX = (get<0>(limits[1]))[0];
-	const double YMIN = (get<0>(limits[0]))[1];
-	const double YMAX = (get<0>(limits[1]))[1];
-	const double ZMIN = (get<0>(limits[0]))[2];
-	const double ZMAX = (get<0>(limits[1]))[2];
-	std::cerr << "[min, max] on x: [" << XMIN << ", " << XMAX << "]\n";
-	std::cerr << "[min, max] on y: [" << YMIN << ", " << YMAX << "]\n";
-	std::cerr << "[min, max] on z: [" << ZMIN << ", " << ZMAX << "]\n";
-	
-	std::vector<PNC> point_cloud;
-	for (std::vector<PNC>::iterator i = point_cloud_with_properties.begin(); i != point_cloud_with_properties.end(); i++)
+	Crop_box box;
+	box.min = make_vec3(limits.x[0], limits.y[0], limits.z[0]);
+	box.max = make_vec3(limits.x[1], limits.y[1], limits.z[1]);
+	if (auto_limits_mode)
 	{
-		Point& p = get<0>(*i);
-		if (p[0] >= XMIN && p[0] <= XMAX)
-			if (p[1] >= YMIN && p[1] <= YMAX)
-				if (p[2] >= ZMIN && p[2] <= ZMAX)
-					point_cloud.push_back(*i);
+		// the static limits become the outer bounds of the box found on the cloud
+		std::vector<Vec3> points (point_cloud.size());
+		parallel_for_each_index(points.size(), [&](std::size_t i)
+		{
+			points[i] = make_vec3(point_cloud.x[i], point_cloud.y[i], point_cloud.z[i]);
+		});
+		box = auto_limits(points, box, Auto_limits_parameters(), std::cerr);
+		std::string box_file = (output.shared? output.path.substr(1) : output.path.substr(0, output.path.find(".ply"))).append("_limits.ply");
+		std::ofstream out_box (box_file);
+		out_box	<< "ply" << std::endl
+						<< "format ascii 1.0" << std::endl
+						<< "element vertex 2" << std::endl
+						<< "property float32 x" << std::endl
+						<< "property float32 y" << std::endl
+						<< "property float32 z" << std::endl
+						<< "end_header" << std::endl
+						<< box.min[0] << " " << box.min[1] << " " << box.min[2] << std::endl
+						<< box.max[0] << " " << box.max[1] << " " << box.max[2] << std::endl;
+		std::cerr << "Automatic limits saved in " << box_file << std::endl;
 	}
+	std::cerr << "[min, max] on x: [" << box.min[0] << ", " << box.max[0] << "]\n";
+	std::cerr << "[min, max] on y: [" << box.min[1] << ", " << box.max[1] << "]\n";
+	std::cerr << "[min, max] on z: [" << box.min[2] << ", " << box.max[2] << "]\n";
+	
+	keep_points_if<Attributes>(point_cloud, [&](std::size_t i)
+	{
+		return box.contains(make_vec3(point_cloud.x[i], point_cloud.y[i], point_cloud.z[i]));
+	});
 	
 	std::cerr << "Cut cloud has now " << point_cloud.size() << " point(s) ("  
-						<< (100.0*double(point_cloud_with_properties.size() - point_cloud.size())/double(point_cloud_with_properties.size()))
+						<< (100.0*double(read_size - point_cloud.size())/double(read_size))
 						<< " % less)\n";
 						
-	// save the output in another colored PLY format
-	std::ofstream out (output_file);
-	out	<< "ply " << std::endl
-			<< "format ascii 1.0" << std::endl
-			<< "element vertex " << point_cloud.size() << std::endl
-			<< "property float x" << std::endl
-			<< "property float y" << std::endl
-			<< "property float z" << std::endl;
-	out << "property float nx" << std::endl
-			<< "property float ny" << std::endl
-			<< "property float nz" << std::endl;
-	out	<< "property uchar red" << std::endl
-			<< "property uchar green" << std::endl
-			<< "property uchar blue" << std::endl
-			<< "end_header" << std::endl; 
-
-	for (std::vector<PNC>::iterator i=point_cloud.begin(); i!=point_cloud.end(); i++)
+	if (output.shared)
 	{
-		out << get<0>(*i) << " " << get<1>(*i) << " ";
-		Color& c = get<2>(*i);
-		out << int(c[0]) << " " << int(c[1]) << " " << int(c[2]) << std::endl;
+		if (!publish_cloud(output.path, point_cloud))
+		{
+			std::cerr << "ERROR: cannot write shared memory segment " << output.path << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
 	}
-	
+
+	// save the output in another PLY file, colored unless --no-colors
+	std::ofstream out (output.path);
+	write_ply_cloud<Attributes>(out, point_cloud);
 	return EXIT_SUCCESS;	
 }
 
+int main(int argc, char** argv)
+{
+	if (argc < 4 || argc > 6)
+	{
+		std::cerr << "ERROR: wrong arguments.\n\tUsage: $ cut [--auto] [--no-colors] <input_file.ply> <output_file.ply> <limits.ply>\n"
+							<< "\tinput and output can also be shared memory segments: shm://<name>\n"
+							<< "\twith --no-colors the colors are neither read nor written (points and normals only)\n";
+		return EXIT_FAILURE;
+	}
+	
+	bool auto_limits_mode = false, colors = true;
+	for (int a = 1; a < argc - 3; a++)
+	{
+		if (strcmp(argv[a], "--auto") == 0)
+			auto_limits_mode = true;
+		else if (strcmp(argv[a], "--no-colors") == 0)
+			colors = false;
+		else
+		{
+			std::cerr << "ERROR: wrong arguments.\n\tUsage: $ cut [--auto] [--no-colors] <input_file.ply> <output_file.ply> <limits.ply>\n";
+			return EXIT_FAILURE;
+		}
+	}
+	const std::string input_file = argv[argc - 3], output_file = argv[argc - 2], limits_file = argv[argc - 1];
+	return with_colors_if(colors, [&](auto attributes)
+	{
+		return cut_cloud<decltype(attributes)>(input_file, output_file, limits_file, auto_limits_mode);
+	});
+}
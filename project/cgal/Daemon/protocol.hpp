@@ -0,0 +1,112 @@
+/*
+ * WHEELSETD PROTOCOL
+ * Messages between wheelsetd and its clients on a Unix domain socket. Both ends run on the same
+ * machine, so the structs are sent as they are in memory (no byte swapping).
+ * A connection carries any number of requests, each answered before the next one is read:
+ * - request: Request_header, then bytes of payload: a ply file (ascii or binary, with normals),
+ *   count points as 6 floats each (x y z nx ny nz), or the name of a shared memory segment with
+ *   normals written by another tool, as shm://<name> or shm://<name>?unlink (see utils/shm_cloud.hpp);
+ * - answer: Axle_answer.
+ */
+#ifndef WHEELSETD_PROTOCOL_HPP
+#define WHEELSETD_PROTOCOL_HPP
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#define WHEELSETD_SOCKET		"/tmp/wheelsetd.sock"
+#define WHEELSETD_REQUEST		0x31445357u		// "WSD1"
+#define WHEELSETD_ANSWER		0x31525357u		// "WSR1"
+#define WHEELSETD_MAX_PAYLOAD_MB	1024		// default bound of a payload, larger ones are refused
+
+enum Payload_format
+{
+	PAYLOAD_PLY = 0,
+	PAYLOAD_FLOATS = 1,
+	PAYLOAD_SHM = 2
+};
+
+enum Answer_status
+{
+	ANSWER_OK = 0,
+	ANSWER_NO_AXLE = 1,				// no acceptable cylinder in the cloud
+	ANSWER_BAD_REQUEST = 2		// unknown format, unreadable ply, size mismatch or too large, or the request
+														// could not be processed: the daemon closes the connection after a payload
+														// it has not read
+};
+
+struct Request_header
+{
+	std::uint32_t	magic;
+	std::uint32_t	format;			// Payload_format
+	std::uint64_t	count;			// points (PAYLOAD_FLOATS only)
+	std::uint64_t	bytes;			// payload size
+};
+
+struct Axle_answer
+{
+	std::uint32_t	magic;
+	std::int32_t	status;			// Answer_status
+	std::uint64_t	points;			// received
+	std::uint64_t	cut;				// after the cut
+	std::uint64_t	kept;				// points of the accepted cylinders
+	double				center[3];	// of the kept points (see funcs/axle_pose.hpp)
+	double				point[3];		// point of the axis closest to the center
+	double				axis[3];		// unit direction
+	double				radius;
+	double				seconds;		// spent by the daemon on the request, receiving included
+};
+
+// read or write exactly bytes bytes; false on error or if the other end closed
+bool read_full (int fd, void* data, std::size_t bytes)
+{
+	char* p = static_cast<char*>(data);
+	while (bytes > 0)
+	{
+		ssize_t n = ::read(fd, p, bytes);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		bytes -= std::size_t(n);
+	}
+	return true;
+}
+
+bool write_full (int fd, const void* data, std::size_t bytes)
+{
+	const char* p = static_cast<const char*>(data);
+	while (bytes > 0)
+	{
+		ssize_t n = ::write(fd, p, bytes);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		bytes -= std::size_t(n);
+	}
+	return true;
+}
+
+// address of the socket file; false if the path does not fit
+bool socket_address (const std::string& path, sockaddr_un& address)
+{
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+		return false;
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+	return true;
+}
+
+#endif
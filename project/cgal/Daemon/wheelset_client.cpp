@@ -0,0 +1,186 @@
+/*
+ * WHEELSETD CLIENT
+ * Sends a cloud to wheelsetd and prints the axle it answers. With --bench the same cloud is sent
+ * n times on one connection and the end-to-end latency (sending, processing and answer) is
+ * reported, next to the time the daemon itself spent on each request.
+ */
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/property_map.h>
+#include <CGAL/IO/read_ply_points.h>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "protocol.hpp"
+
+// types
+typedef CGAL::Exact_predicates_inexact_constructions_kernel		Kernel;
+typedef Kernel::Point_3																				Point;
+typedef Kernel::Vector_3																			Vector;
+typedef std::pair<Point, Vector>															Point_with_normal;
+typedef CGAL::First_of_pair_property_map<Point_with_normal>		Point_map;
+typedef CGAL::Second_of_pair_property_map<Point_with_normal> 	Normal_map;
+
+// the ply file as it is, or its points as 6 floats each; for shm://<name> only the name, the
+// daemon reads the segment itself
+bool load_payload (const std::string& file, bool raw, Request_header& header, std::vector<char>& payload)
+{
+	header.magic = WHEELSETD_REQUEST;
+	if (file.compare(0, 6, "shm://") == 0)
+	{
+		payload.assign(file.begin(), file.end());
+		header.format = PAYLOAD_SHM;
+		header.count = 0;
+		header.bytes = payload.size();
+		return true;
+	}
+	std::ifstream in (file, std::ios::binary);
+	if (!in)
+		return false;
+	if (!raw)
+	{
+		payload.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		header.format = PAYLOAD_PLY;
+		header.count = 0;
+		header.bytes = payload.size();
+		return true;
+	}
+	std::vector<Point_with_normal> points;
+	if (!CGAL::read_ply_points_with_properties(	in, std::back_inserter(points),
+																							CGAL::make_ply_point_reader (Point_map()),
+																							CGAL::make_ply_normal_reader (Normal_map())))
+		return false;
+	payload.resize(points.size() * 6 * sizeof(float));
+	float* f = reinterpret_cast<float*>(payload.data());
+	for (std::size_t i = 0; i < points.size(); i++)
+		for (int k = 0; k < 3; k++)
+		{
+			f[6 * i + k] = float(points[i].first[k]);
+			f[6 * i + 3 + k] = float(points[i].second[k]);
+		}
+	header.format = PAYLOAD_FLOATS;
+	header.count = points.size();
+	header.bytes = payload.size();
+	return true;
+}
+
+void print_answer (const Axle_answer& answer)
+{
+	if (answer.status == ANSWER_BAD_REQUEST)
+	{
+		std::cerr << "ERROR: the daemon could not read the cloud (or it is larger than its --max-payload)\n";
+		return;
+	}
+	std::cerr << answer.points << " point(s) sent, " << answer.cut << " after the cut, " << answer.kept << " kept\n";
+	if (answer.status == ANSWER_NO_AXLE)
+	{
+		std::cerr << "ERROR: no acceptable shape has been detected on this cloud\n";
+		return;
+	}
+	std::cout << "center " << answer.center[0] << " " << answer.center[1] << " " << answer.center[2] << "\n"
+						<< "point " << answer.point[0] << " " << answer.point[1] << " " << answer.point[2] << "\n"
+						<< "axis " << answer.axis[0] << " " << answer.axis[1] << " " << answer.axis[2] << "\n"
+						<< "radius " << answer.radius << std::endl;
+}
+
+// min, median, 95th percentile and max of the samples
+void print_latency (const std::string& what, std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	std::size_t n = samples.size();
+	std::cerr << what << ": min " << samples[0] << " s, median " << samples[n / 2] << " s, p95 "
+						<< samples[std::min(n - 1, (95 * n) / 100)] << " s, max " << samples[n - 1] << " s\n";
+}
+
+int main (int argc, char** argv)
+{
+	if (argc < 2 || argc > 7 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\tUsage: wheelset_client [--socket <path>] [--raw] [--bench <n>] <cloud.ply|shm://name>\n";
+		std::cerr << "\nSend a cloud with normals to wheelsetd and print the axle. A shared memory segment (e.g. written "
+							<< "by cut) is passed by name, the daemon reads it.\n";
+		std::cerr << "\n--socket\tpath of the socket (default " << WHEELSETD_SOCKET << ")\n";
+		std::cerr << "--raw\t\tsend the points as floats instead of the ply file (the daemon does not parse anything)\n";
+		std::cerr << "--bench\t\tsend the cloud n times and report the latency\n";
+		return EXIT_FAILURE;
+	}
+
+	std::string		socket_path = WHEELSETD_SOCKET;
+	bool					raw = false;
+	int						repetitions = 1;
+	for (int a = 1; a < argc - 1; a++)
+	{
+		if (strcmp(argv[a], "--socket") == 0 && a + 1 < argc - 1)
+			socket_path = argv[++a];
+		else if (strcmp(argv[a], "--raw") == 0)
+			raw = true;
+		else if (strcmp(argv[a], "--bench") == 0 && a + 1 < argc - 1 && atoi(argv[a + 1]) > 0)
+			repetitions = atoi(argv[++a]);
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	Request_header		header;
+	std::vector<char>	payload;
+	if (!load_payload(argv[argc - 1], raw, header, payload))
+	{
+		std::cerr << "ERROR: cannot read file " << argv[argc - 1] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// a payload the daemon refuses is answered and the connection closed before it is read: the
+	// writes then fail with EPIPE instead of killing the client, and the answer is still read
+	signal(SIGPIPE, SIG_IGN);
+	sockaddr_un address;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || !socket_address(socket_path, address) ||
+			connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		std::cerr << "ERROR: cannot connect to " << socket_path << " (is wheelsetd running?)" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<double> latency, daemon;
+	Axle_answer answer;
+	for (int r = 0; r < repetitions; r++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const bool sent = write_full(fd, &header, sizeof(header)) && write_full(fd, payload.data(), payload.size());
+		if (!read_full(fd, &answer, sizeof(answer)) || answer.magic != WHEELSETD_ANSWER)
+		{
+			std::cerr << "ERROR: connection to " << socket_path << " lost" << std::endl;
+			close(fd);
+			return EXIT_FAILURE;
+		}
+		latency.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		daemon.push_back(answer.seconds);
+		if (!sent || answer.status == ANSWER_BAD_REQUEST)
+			break;
+	}
+	close(fd);
+
+	print_answer(answer);
+	if (repetitions > 1)
+	{
+		std::cerr << latency.size() << " request(s) of " << payload.size() << " byte(s)\n";
+		print_latency("End-to-end latency", latency);
+		print_latency("Daemon time", daemon);
+	}
+	return (answer.status == ANSWER_OK)? EXIT_SUCCESS : EXIT_FAILURE;
+}
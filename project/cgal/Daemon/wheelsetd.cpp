@@ -0,0 +1,272 @@
+/*
+ * WHEELSETD
+ * The pipeline (see ../Pipeline/run.hpp) as a long running process: the limits and the options
+ * are read once, the worker threads and their buffers stay alive between requests, so that a
+ * cloud costs only its own processing instead of starting a program for each step.
+ * Clients connect to a Unix domain socket, send clouds (see protocol.hpp) and get the axle back.
+ * Each worker serves one connection at a time; the cores are shared among the workers as in
+ * pipeline_batch. Payloads above --max-payload are refused without being read.
+ */
+#include <CGAL/Real_timer.h>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.hpp"
+#include "../Pipeline/run.hpp"
+#include "../utils/thread_pool.hpp"
+
+typedef CGAL::Real_timer																			Real_timer;
+
+static std::string socket_path = WHEELSETD_SOCKET;
+
+void on_signal (int)
+{
+	unlink(socket_path.c_str());
+	_exit(EXIT_SUCCESS);
+}
+
+// what stays in memory between the requests
+struct Daemon_state
+{
+	Pipeline_options	options;
+	Crop_box					limits;
+	std::size_t				threads;			// of the parallel loops of each request
+	std::uint64_t			max_payload;	// bytes
+	std::mutex				log_mutex;
+};
+
+// per worker: reused by all the requests the worker serves, so that they only grow
+struct Worker_buffers
+{
+	std::vector<char>	payload;
+	Pwn_vector				cloud;
+};
+
+bool parse_payload (const Request_header& header, const Worker_buffers& buffers, Pwn_vector& cloud)
+{
+	cloud.clear();
+	if (header.format == PAYLOAD_FLOATS)
+	{
+		// no product of client values, it could overflow
+		const std::uint64_t record = 6 * sizeof(float);
+		if (header.bytes % record != 0 || header.count != header.bytes / record)
+			return false;
+		const float* f = reinterpret_cast<const float*>(buffers.payload.data());
+		cloud.resize(std::size_t(header.count));
+		for (std::size_t i = 0; i < cloud.size(); i++, f += 6)
+			cloud[i] = Point_with_normal(Point(f[0], f[1], f[2]), Vector(f[3], f[4], f[5]));
+		return true;
+	}
+	if (header.format == PAYLOAD_PLY)
+	{
+		std::istringstream in (std::string(buffers.payload.data(), std::size_t(header.bytes)));
+		return CGAL::read_ply_points_with_properties(	in, std::back_inserter(cloud),
+																									CGAL::make_ply_point_reader (Point_map()),
+																									CGAL::make_ply_normal_reader (Normal_map()));
+	}
+	if (header.format == PAYLOAD_SHM)
+	{
+		// only the name travels on the socket, the points are copied from the segment
+		Cloud_uri uri = parse_cloud_uri(std::string(buffers.payload.data(), std::size_t(header.bytes)));
+		return uri.shared && attach_points_with_normals(uri, cloud);
+	}
+	return false;
+}
+
+Axle_answer empty_answer (Answer_status status)
+{
+	Axle_answer result;
+	std::memset(&result, 0, sizeof(result));
+	result.magic = WHEELSETD_ANSWER;
+	result.status = status;
+	return result;
+}
+
+Axle_answer answer (const Request_header& header, Worker_buffers& buffers, Daemon_state& state)
+{
+	Axle_answer result = empty_answer(ANSWER_BAD_REQUEST);
+	if (!parse_payload(header, buffers, buffers.cloud))
+		return result;
+	result.points = buffers.cloud.size();
+
+	std::ostringstream log;
+	Pipeline_run run;
+	with_thread_limit(state.threads, [&] { run = run_pipeline(buffers.cloud, state.limits, state.options, log); });
+	if (state.options.verbose)
+	{
+		std::lock_guard<std::mutex> lock (state.log_mutex);
+		std::cerr << log.str();
+		if (state.options.cache)
+			state.options.cache->print_stats(std::cerr);
+	}
+	result.cut = run.cut_size;
+	result.kept = run.result.size();
+	if (!run.found)
+	{
+		result.status = ANSWER_NO_AXLE;
+		return result;
+	}
+	result.status = ANSWER_OK;
+	const Axle_pose& pose = run.pose;
+	for (int k = 0; k < 3; k++)
+	{
+		result.center[k] = pose.center[k];
+		result.point[k] = pose.point[k];
+		result.axis[k] = pose.axis[k];
+	}
+	result.radius = pose.radius;
+	return result;
+}
+
+// closes the connection however serve leaves it
+struct Connection
+{
+	int fd;
+
+	explicit Connection (int f) : fd(f) {}
+	~Connection ()	{ close(fd); }
+};
+
+// all the requests of a connection, until the client closes it. A payload too large is not read
+// and a request that throws (out of memory...) leaves the buffers in an unknown state: both get
+// ANSWER_BAD_REQUEST, then the connection is closed
+void serve (int fd, Daemon_state& state)
+{
+	static thread_local Worker_buffers buffers;
+	Connection connection (fd);
+	Request_header header;
+	while (read_full(fd, &header, sizeof(header)) && header.magic == WHEELSETD_REQUEST)
+	{
+		Real_timer t;
+		t.start();
+		Axle_answer result = empty_answer(ANSWER_BAD_REQUEST);
+		bool go_on = header.bytes <= state.max_payload;
+		try
+		{
+			if (go_on)
+			{
+				if (buffers.payload.size() < header.bytes)
+					buffers.payload.resize(std::size_t(header.bytes));
+				if (!read_full(fd, buffers.payload.data(), std::size_t(header.bytes)))
+					return;
+				result = answer(header, buffers, state);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			result = empty_answer(ANSWER_BAD_REQUEST);
+			go_on = false;
+			std::lock_guard<std::mutex> lock (state.log_mutex);
+			std::cerr << "ERROR: request of " << header.bytes << " byte(s) failed: " << e.what() << std::endl;
+		}
+		t.stop();
+		result.seconds = t.time();
+		if (!write_full(fd, &result, sizeof(result)))
+			return;
+		{
+			std::lock_guard<std::mutex> lock (state.log_mutex);
+			if (header.bytes > state.max_payload)
+				std::cerr << "Request of " << header.bytes << " byte(s) refused: more than " << state.max_payload << "\n";
+			else
+				std::cerr << "Request of " << result.points << " point(s): status " << result.status << ", " << result.kept
+									<< " point(s) kept (" << result.seconds << " s)\n";
+		}
+		if (!go_on)
+			return;
+	}
+}
+
+int main (int argc, char** argv)
+{
+	if (argc < 2 || argc > 51 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\tUsage: wheelsetd [--socket <path>] [--workers <n>] [--max-payload <MB>] [pipeline options] <limits.ply>\n";
+		std::cerr << "\nServe the pipeline on a Unix domain socket: clients send clouds with normals (ply or raw floats) "
+							<< "and get the axle back, or the name of a shared memory segment holding it. Stop it with Ctrl-C or SIGTERM.\n";
+		std::cerr << "\n--socket\tpath of the socket (default " << WHEELSETD_SOCKET << ")\n";
+		std::cerr << "--workers\tconnections served at the same time (default 1: each request gets all the cores)\n";
+		std::cerr << "--max-payload\tlargest cloud accepted, in MB: larger requests are refused and their connection closed "
+							<< "(default " << WHEELSETD_MAX_PAYLOAD_MB << ")\n";
+		print_pipeline_options(std::cerr);
+		return EXIT_FAILURE;
+	}
+
+	Daemon_state	state;
+	std::size_t		workers = 1;
+	state.max_payload = std::uint64_t(WHEELSETD_MAX_PAYLOAD_MB) << 20;
+	for (int a = 1; a < argc - 1; a++)
+	{
+		if (strcmp(argv[a], "--socket") == 0 && a + 1 < argc - 1)
+			socket_path = argv[++a];
+		else if (strcmp(argv[a], "--workers") == 0 && a + 1 < argc - 1 && atoi(argv[a + 1]) > 0)
+			workers = std::size_t(atoi(argv[++a]));
+		else if (strcmp(argv[a], "--max-payload") == 0 && a + 1 < argc - 1 && atof(argv[a + 1]) > 0.0)
+			state.max_payload = std::uint64_t(atof(argv[++a]) * 1024.0 * 1024.0);
+		else if (!parse_pipeline_option(argv, a, argc - 1, state.options))
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (!open_stage_cache(state.options))
+	{
+		std::cerr << "ERROR: cannot create directory " << state.options.cache_dir << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!read_limits(argv[argc - 1], state.limits))
+	{
+		std::cerr << "ERROR: cannot read limits from " << argv[argc - 1] << std::endl;
+		return EXIT_FAILURE;
+	}
+	state.threads = std::max<std::size_t>(1, std::max<std::size_t>(1, std::thread::hardware_concurrency()) / workers);
+
+	sockaddr_un address;
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || !socket_address(socket_path, address))
+	{
+		std::cerr << "ERROR: cannot create socket " << socket_path << std::endl;
+		return EXIT_FAILURE;
+	}
+	unlink(socket_path.c_str());
+	if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0)
+	{
+		std::cerr << "ERROR: cannot listen on " << socket_path << ": " << strerror(errno) << std::endl;
+		return EXIT_FAILURE;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	std::cerr << "Listening on " << socket_path << " with " << workers << " worker(s), " << state.threads
+						<< " thread(s) each\n";
+
+	Thread_pool pool (workers);
+	while (true)
+	{
+		int fd = accept(listener, 0, 0);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			std::cerr << "ERROR: accept failed: " << strerror(errno) << std::endl;
+			break;
+		}
+		pool.submit([fd, &state] { serve(fd, state); });
+	}
+	close(listener);
+	unlink(socket_path.c_str());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,370 @@
+/*
+ * PORTFOLIO SHAPE DETECTION
+ * Some clouds converge quickly with Efficient RANSAC, others with region growing, and we cannot
+ * tell which in advance. Here both engines run at the same time on the same input, each on its own
+ * thread: the first one that finds a cylinder passing the axis and radius checks wins, and the other
+ * one is asked to stop (Efficient RANSAC through its callback, region growing through an atomic flag).
+ * If neither finds an acceptable cylinder, the result of Efficient RANSAC is kept.
+ * Region growing is the parallel engine of funcs/region_growing.hpp, the one that can be stopped.
+ */
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/IO/read_ply_points.h>
+#include <CGAL/Point_with_normal_3.h>
+#include <CGAL/property_map.h>
+#include <CGAL/version.h>
+// shape detection
+#include <CGAL/Shape_detection_3.h>
+#include <CGAL/Line_3.h>
+// real time
+#include <CGAL/Real_timer.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// user: labels and colors
+#include "../../utils/colors.hpp"
+#include "../../utils/labels.hpp"
+#include "../../utils/labeled_ply.hpp"
+#include "../../funcs/region_growing.hpp"
+
+// types
+typedef CGAL::Exact_predicates_inexact_constructions_kernel		EPIC_kernel;
+typedef EPIC_kernel::FT																				FT;
+typedef EPIC_kernel::Point_3																	Point;
+typedef EPIC_kernel::Vector_3																	Vector;
+typedef std::pair<Point, Vector>															Point_with_normal;
+typedef std::vector<Point_with_normal>												Pwn_vector;
+typedef CGAL::First_of_pair_property_map<Point_with_normal>		Point_map;
+typedef CGAL::Second_of_pair_property_map<Point_with_normal> 	Normal_map;
+typedef CGAL::cpp11::array<unsigned char, 3> 									Color;
+
+typedef CGAL::Shape_detection_3::Shape_detection_traits<EPIC_kernel, Pwn_vector, Point_map, Normal_map> Traits;
+typedef CGAL::Shape_detection_3::Efficient_RANSAC<Traits>			Efficient_ransac;
+typedef CGAL::Shape_detection_3::Cylinder<Traits>							Cylinder;
+typedef CGAL::Shape_detection_3::Plane<Traits>								Plane;
+
+typedef CGAL::Real_timer																			Real_timer;
+
+// Efficient_RANSAC::detect() accepts a callback (that can stop it) since CGAL 4.14
+#if CGAL_VERSION_NR >= CGAL_VERSION_NUMBER(4,14,0)
+#define RANSAC_HAS_CALLBACK 1
+#else
+#define RANSAC_HAS_CALLBACK 0
+#endif
+
+#define RANSAC_ENGINE		0
+#define RG_ENGINE				1
+const char* engine_names[] = { "Efficient RANSAC", "region growing" };
+
+// what an engine found: a label for each input point
+struct Engine_result
+{
+	std::vector<Shape_kind>	kinds;
+	std::vector<Shape_id>		ids;
+	std::size_t							shapes;
+	std::size_t							accepted;		// cylinders passing the checks
+	bool										completed;	// false if stopped before the end
+	double									time;				// seconds since the start of the race
+	std::string							log;
+};
+
+// state shared by the engines and the main thread
+struct Race
+{
+	std::atomic<bool>				cancel;
+	int											winner;			// -1 until someone finds an acceptable cylinder
+	bool										done[2];
+	std::mutex							mutex;
+	std::condition_variable	changed;
+	Real_timer							timer;
+};
+
+// called by each engine at the end: the first one with an acceptable cylinder wins
+void finish (Race& race, int engine, Engine_result& result)
+{
+	result.time = race.timer.time();
+	std::lock_guard<std::mutex> lock (race.mutex);
+	race.done[engine] = true;
+	if (result.completed && result.accepted > 0 && race.winner < 0)
+	{
+		race.winner = engine;
+		race.cancel.store(true);
+	}
+	race.changed.notify_all();
+}
+
+// give the points of a shape its kind and id
+void label_points (	const std::vector<std::size_t>& indices, Shape_kind kind, Shape_id id, Engine_result& result)
+{
+	for (std::size_t i = 0; i < indices.size(); i++)
+	{
+		result.kinds[indices[i]] = kind;
+		result.ids[indices[i]] = id;
+	}
+}
+
+void run_ransac (Pwn_vector& point_cloud, const Efficient_ransac::Parameters& parameters, Race& race, Engine_result& result)
+{
+	std::ostringstream log;
+	Efficient_ransac ransac;
+	ransac.set_input (point_cloud);
+	ransac.add_shape_factory<Plane>();
+	ransac.add_shape_factory<Cylinder>();
+#if RANSAC_HAS_CALLBACK
+	result.completed = ransac.detect(parameters, [&race](double) { return !race.cancel.load(std::memory_order_relaxed); });
+#else
+	ransac.detect(parameters);
+	result.completed = true;
+#endif
+	if (result.completed)
+	{
+		std::size_t cylinders = 0, planes = 0;
+		Efficient_ransac::Shape_range shapes = ransac.shapes();
+		for (Efficient_ransac::Shape_range::iterator s = shapes.begin(); s != shapes.end(); s++)
+		{
+			if (Plane* plane = dynamic_cast<Plane*>(s->get()))
+			{
+				log << "Plane " << planes << " with normal [" << plane->plane_normal() << "]\n";
+				label_points((*s)->indices_of_assigned_points(), PLANE, Shape_id(planes++), result);
+			}
+			else if (Cylinder* cyl = dynamic_cast<Cylinder*>(s->get()))
+			{
+				EPIC_kernel::Line_3 axis = cyl->axis();
+				Vector d = axis.to_vector();
+				Shape_kind k = classify_cylinder(d[1] / std::sqrt(d.squared_length()), cyl->radius());
+				log << "Cylinder " << cylinders << " with axis [" << axis << "] and radius " << cyl->radius()
+						<< ((k == CYLIND)? "\n" : " not classified\n");
+				result.accepted += (k == CYLIND);
+				label_points((*s)->indices_of_assigned_points(), k, Shape_id(cylinders++), result);
+			}
+		}
+		result.shapes = cylinders + planes;
+	}
+	result.log = log.str();
+	finish(race, RANSAC_ENGINE, result);
+}
+
+void run_region_growing (	const Pwn_vector& point_cloud, const Efficient_ransac::Parameters& ransac_parameters,
+													Race& race, Engine_result& result)
+{
+	std::ostringstream log;
+	std::vector<Vec3> points (point_cloud.size()), normals (point_cloud.size());
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+	{
+		const Point& p = point_cloud[i].first;
+		const Vector& n = point_cloud[i].second;
+		points[i] = make_vec3(p.x(), p.y(), p.z());
+		normals[i] = normalized(make_vec3(n.x(), n.y(), n.z()));
+	}
+	Region_growing_parameters parameters;
+	parameters.min_points				= ransac_parameters.min_points;
+	parameters.epsilon					= ransac_parameters.epsilon;
+	parameters.cluster_epsilon	= ransac_parameters.cluster_epsilon;
+	parameters.normal_threshold = ransac_parameters.normal_threshold;
+
+	Parallel_region_growing region_grow;
+	region_grow.set_input(points, normals);
+	result.completed = region_grow.detect(parameters, &race.cancel);
+	if (result.completed)
+	{
+		std::size_t cylinders = 0, planes = 0;
+		for (std::size_t s = 0; s < region_grow.shapes().size(); s++)
+		{
+			const Region_shape& shape = region_grow.shapes()[s];
+			if (shape.kind == PLANE)
+			{
+				log << "Plane " << planes << " with normal [" << shape.direction[0] << " " << shape.direction[1] << " "
+						<< shape.direction[2] << "]\n";
+				label_points(shape.indices, PLANE, Shape_id(planes++), result);
+			}
+			else
+			{
+				Shape_kind k = classify_cylinder(shape.direction[1], shape.radius);
+				log << "Cylinder " << cylinders << " with axis [" << shape.point[0] << " " << shape.point[1] << " "
+						<< shape.point[2] << " " << shape.direction[0] << " " << shape.direction[1] << " " << shape.direction[2]
+						<< "] and radius " << shape.radius << ((k == CYLIND)? "\n" : " not classified\n");
+				result.accepted += (k == CYLIND);
+				label_points(shape.indices, k, Shape_id(cylinders++), result);
+			}
+		}
+		result.shapes = cylinders + planes;
+	}
+	result.log = log.str();
+	finish(race, RG_ENGINE, result);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3 || argc > 9)
+	{
+		std::cerr << "ERROR: wrong arguments. Tap --help for more info" << std::endl;
+		std::cerr << "\tUsage: detect_shapes_portfolio [--verbose] [--colors] [--cylinders-only] [--debug <debug_file.ply>] "
+							<< "<input_file.ply> <output_file.ply>\n";
+		return EXIT_FAILURE;
+	}
+	if (strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\n\tUsage: detect_shapes_portfolio [--verbose] [--colors] [--cylinders-only] [--debug <debug_file.ply>] "
+							<< "<input_file.ply> <output_file.ply>\n";
+		std::cerr << "\nRun Efficient RANSAC and region growing side by side and keep the result of the first one "
+							<< "finding a cylinder aligned to Y with an acceptable radius. Default RANSAC parameters are used "
+							<< "(0.01/2% size/0.09/0.045/0.9), region growing shares the last four.\n";
+		std::cerr << "\n--v, --verbose\tinformation about found shapes can be found into the log file\n";
+		std::cerr << "--colors\tbesides the labels, write the shape colors (for visualization only)\n";
+		std::cerr << "--cylinders-only\tsave only the points of the accepted cylinders\n";
+		std::cerr << "--debug\t\talso save the whole colored cloud, with all the shapes and the unassigned points\n";
+		std::cerr << "--help\t\tdisplay information\n";
+		return EXIT_FAILURE;
+	}
+
+	bool					verbose = false;
+	bool					with_colors = false;
+	bool					cylinders_only = false;
+	std::string		debug_file;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp("--verbose", argv[a]) == 0 || strcmp("--v", argv[a]) == 0)
+			verbose = true;
+		else if (strcmp("--colors", argv[a]) == 0)
+			with_colors = true;
+		else if (strcmp("--cylinders-only", argv[a]) == 0)
+			cylinders_only = true;
+		else if (strcmp("--debug", argv[a]) == 0 && a + 1 < argc - 2)
+			debug_file = argv[++a];
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::string		infile = argv[argc - 2];
+	std::string 	outfile = argv[argc - 1];
+
+	std::ifstream in (infile);
+	Pwn_vector		point_cloud;
+	if (!in || !CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud),
+																											CGAL::make_ply_point_reader (Point_map()),
+																											CGAL::make_ply_normal_reader (Normal_map())
+																											))
+	{
+		std::cerr << "ERROR: cannot read file " << infile << std::endl;
+		return EXIT_FAILURE;
+	}
+	in.close();
+	std::cerr << "Read successfully " << point_cloud.size() << " point(s) with properties...\n";
+
+	// logging
+	std::string logfile = outfile.substr(0, outfile.find(".ply")).append("_log.txt");
+	if (verbose)
+		std::cerr << "Saving log in " << logfile << std::endl;
+	std::ofstream	out_det (logfile);
+
+	Efficient_ransac::Parameters parameters;
+	parameters.probability		 	= 0.01;
+	parameters.min_points 			= std::size_t(2.0 * double(point_cloud.size()) / 100);
+	parameters.epsilon 					= 0.09;
+	parameters.cluster_epsilon	= parameters.epsilon / 2;
+	parameters.normal_threshold = 0.9;
+	if (verbose)
+	{
+		out_det << "probability " 		<< parameters.probability << std::endl
+						<< "min points "			<< parameters.min_points << std::endl
+						<< "epsilon "					<< parameters.epsilon << std::endl
+						<< "cluster epsilon " << parameters.cluster_epsilon << std::endl
+						<< "normal deviation "<< parameters.normal_threshold << std::endl;
+	}
+
+	// both engines read the same cloud, none of them modifies it
+	Engine_result results[2];
+	for (int e = 0; e < 2; e++)
+	{
+		results[e].kinds.assign(point_cloud.size(), UNDEF);
+		results[e].ids.assign(point_cloud.size(), -1);
+		results[e].shapes = results[e].accepted = 0;
+		results[e].completed = false;
+		results[e].time = 0.0;
+	}
+	Race race;
+	race.cancel.store(false);
+	race.winner = -1;
+	race.done[RANSAC_ENGINE] = race.done[RG_ENGINE] = false;
+
+	std::cerr << "Seeking shapes with " << engine_names[RANSAC_ENGINE] << " and " << engine_names[RG_ENGINE] << "...\n";
+	race.timer.start();
+	std::thread ransac_thread (run_ransac, std::ref(point_cloud), std::cref(parameters), std::ref(race),
+														 std::ref(results[RANSAC_ENGINE]));
+	std::thread rg_thread (run_region_growing, std::cref(point_cloud), std::cref(parameters), std::ref(race),
+												 std::ref(results[RG_ENGINE]));
+
+	int winner;
+	{
+		std::unique_lock<std::mutex> lock (race.mutex);
+		race.changed.wait(lock, [&race] { return race.winner >= 0 || (race.done[RANSAC_ENGINE] && race.done[RG_ENGINE]); });
+		winner = race.winner;
+	}
+	race.cancel.store(true);
+	double decision_time = race.timer.time();
+
+	int kept = (winner >= 0)? winner : RANSAC_ENGINE;
+	if (winner >= 0)
+	{
+		int loser = 1 - winner;
+		std::cerr << engine_names[winner] << " won after " << results[winner].time << " second(s) with "
+							<< results[winner].accepted << " acceptable cylinder(s); " << engine_names[loser] << " stopped\n";
+		out_det << "winner " << engine_names[winner] << " after " << results[winner].time << " s "
+						<< "(" << engine_names[loser] << " cancelled)" << std::endl;
+	}
+	else
+	{
+		std::cerr << "No engine found an acceptable cylinder after " << decision_time << " second(s): "
+							<< "keeping the result of " << engine_names[kept] << std::endl;
+		out_det << "winner none after " << decision_time << " s (" << engine_names[RANSAC_ENGINE] << " "
+						<< results[RANSAC_ENGINE].time << " s, " << engine_names[RG_ENGINE] << " " << results[RG_ENGINE].time
+						<< " s)" << std::endl;
+	}
+	if (verbose)
+		out_det << results[kept].log;
+	out_det.close();
+
+	// the engine we keep has finished: save its labels while the other one stops
+	std::cerr << "Saving output...\n";
+	std::ofstream out (outfile);
+	std::size_t saved = write_labeled_ply(out, point_cloud, results[kept].kinds, results[kept].ids,
+																				cylinders_only? keep_cylinders() : keep_all(), with_colors);
+	std::cerr << saved << " point(s) saved\n";
+	out.close();
+	if (!debug_file.empty())
+	{
+		std::cerr << "Saving debug output in " << debug_file << "...\n";
+		std::ofstream out_dbg (debug_file);
+		write_labeled_ply(out_dbg, point_cloud, results[kept].kinds, results[kept].ids, keep_all(), true);
+		out_dbg.close();
+	}
+
+#if !RANSAC_HAS_CALLBACK
+	// this CGAL cannot interrupt Efficient RANSAC: do not wait for it, all the output is written
+	bool ransac_running;
+	{
+		std::lock_guard<std::mutex> lock (race.mutex);
+		ransac_running = !race.done[RANSAC_ENGINE];
+	}
+	if (ransac_running)
+	{
+		std::cerr << "Leaving " << engine_names[RANSAC_ENGINE] << " behind\n";
+		std::_Exit(EXIT_SUCCESS);
+	}
+#endif
+	ransac_thread.join();
+	rg_thread.join();
+
+	return EXIT_SUCCESS;
+}
@@ -5,8 +5,6 @@
  * The algorithm is not deterministic, but quite fast
  * See: https://doc.cgal.org/latest/Point_set_shape_detection_3/index.html#Point_set_shape_detection_3Method_RANSAC
  */
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-#include <CGAL/IO/read_ply_points.h>
 #include <CGAL/Point_with_normal_3.h>
 #include <CGAL/property_map.h>
 // shape detection
@@ -15,19 +13,34 @@
 // real time
 #include <CGAL/Real_timer.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <future>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
-// user: colors
+// user: labels and colors
 #include "../../utils/colors.hpp"
+#include "../../utils/labels.hpp"
 #include "../../utils/checks.hpp"
+#include "../../utils/kernel.hpp"
+#include "../../utils/labeled_ply.hpp"
+#include "../../utils/ply_cloud.hpp"
+// user: coarse to fine detection
+#include "../../funcs/voxel_grid.hpp"
+#include "../../funcs/coarse_to_fine.hpp"
+// user: detection per cluster
+#include "../../funcs/euclidean_clustering.hpp"
+#include "../../utils/thread_pool.hpp"
 
 // types
-typedef CGAL::Exact_predicates_inexact_constructions_kernel		EPIC_kernel;
-typedef EPIC_kernel::FT																				FT;
-typedef EPIC_kernel::Point_3																	Point;
-typedef EPIC_kernel::Vector_3																	Vector;
+typedef Pipeline_kernel																				Kernel;
+typedef Kernel::FT																						FT;
+typedef Kernel::Point_3																				Point;
+typedef Kernel::Vector_3																			Vector;
 typedef std::pair<Point, Vector>															Point_with_normal;
 typedef std::vector<Point_with_normal>												Pwn_vector;
 typedef CGAL::First_of_pair_property_map<Point_with_normal>		Point_map;
@@ -36,7 +49,7 @@ typedef CGAL::cpp11::array<unsigned char, 3> 									Color;
 
 // in Shape_detection_traits, the basic types like Point and Vector are as well an
 // iterator type and property maps to be defined
-typedef CGAL::Shape_detection_3::Shape_detection_traits<EPIC_kernel, Pwn_vector, Point_map, Normal_map> Traits;
+typedef CGAL::Shape_detection_3::Shape_detection_traits<Kernel, Pwn_vector, Point_map, Normal_map> Traits;
 typedef CGAL::Shape_detection_3::Efficient_RANSAC<Traits>			Efficient_ransac;
 // types for the shapes we want to identify
 typedef CGAL::Shape_detection_3::Cylinder<Traits>							Cylinder;
@@ -87,79 +100,15 @@ Efficient_ransac::Parameters set_parameters(std::size_t cloud_size, bool apply_d
 	return parameters;
 }
 
-int main(int argc, char** argv)
+// Detect the shapes of the cloud: each point gets the kind and the id of its shape (kinds and ids
+// are resized to the cloud, UNDEF and -1 for the unassigned points) and the planes and cylinders
+// found are described in found, in detection order. Progress goes to msg.
+// Returns the detection time in seconds
+double detect (	Pwn_vector& point_cloud, const Efficient_ransac::Parameters& parameters, bool verbose,
+								std::ostream& out_det, std::vector<Shape_kind>& kinds, std::vector<Shape_id>& ids,
+								std::vector<Coarse_shape>& found, std::ostream& msg = std::cerr)
 {
-	if (argc < 2 || argc > 6)
-	{
-		std::cerr << "ERROR: wrong arguments. Tap --help for more info" << std::endl;
-		std::cerr << "\tUsage: detect_shapes_ransac [--verbose] [--defaults] <input_file.ply> <output_file.ply>\n";
-		return EXIT_FAILURE;
-	}
-	if (strcmp(argv[1], "--help") == 0)
-	{
-		std::cerr << "\n\tUsage: detect_shapes_ransac [--verbose] [--defaults] <input_file.ply> <output_file.ply>\n";
-		std::cerr << "\nThis program detects shapes inside the point cloud, with particular attention to cylinders.\n";
-		std::cerr << "Detectable shapes are: planes, cylinders, spheres, toruses, cones. (check the source)\n";
-		std::cerr << "\n--v, --verbose\tinformation about found shapes can be found into the a log file\n";
-		std::cerr << "--defaults\tif specified, RANSAC parameters will not be asked in input but default values "
-							<< "(0.01/2% size/0.05/0.025/0.9) will be applied\n";
-		std::cerr << "--help\t\tdisplay information\n";
-		return EXIT_FAILURE;
-	}
-	
-	std::string		infile;
-	std::string 	outfile;
-	bool					apply_defaults;
-	bool 					verbose;
-	switch (argc)
-	{
-		case 3:
-			infile = argv[1];
-			outfile = argv[2];
-			apply_defaults = false;
-			verbose = false;
-			break;
-		case 4:
-			infile = argv[2];
-			outfile = argv[3];
-			verbose = (strcmp("--verbose", argv[1]) == 0)? true : false;
-			apply_defaults = (strcmp("--defaults", argv[1]) == 0)? true : false;
-			break;
-		case 5:
-			infile = argv[3];
-			outfile = argv[4];
-			verbose = (strcmp("--verbose", argv[1]) == 0)? true : false;
-			apply_defaults = (strcmp("--defaults", argv[2]) == 0)? true : false;
-			break;
-	}
-	
-	std::ifstream 			in 	(infile);
-	std::ofstream 			out (outfile);
-	Pwn_vector 					point_cloud;
-	std::vector<Color>	color_cloud;
-	Pwn_vector					output_point_cloud;
-	Color								c;
-	Real_timer					t;
-	
-	// logging
-	outfile = outfile.substr(0, outfile.find(".ply")).append("_log.txt");
-	if (verbose)
-		std::cerr << "Saving log in " << outfile << std::endl;
-	std::ofstream	out_det (outfile);
-	
-	// read point cloud
-	if (!in || !CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud), 
-																											CGAL::make_ply_point_reader (Point_map()),
-																											CGAL::make_ply_normal_reader (Normal_map())
-																											))
-	{
-		std::cerr << "ERROR: cannot read file " << argv[1] << std::endl;
-		return EXIT_FAILURE;
-	}
-	
-	std::cerr << "Read successfully " << point_cloud.size() << " point(s) with properties...\n";
-	std::cerr << "Setting parameters for shape detection...\n";
-
+	Real_timer t;
 	// instantiate shape detection engine
 	Efficient_ransac ransac;
 	// provide input data
@@ -170,39 +119,30 @@ int main(int argc, char** argv)
 //	ransac.add_shape_factory<Sphere>();
 //	ransac.add_shape_factory<Cone>();
 //	ransac.add_shape_factory<Torus>();
-	
-	//------------------------------------------------------------------------------------------
-	// set parameters for shape detection: we make this step interactive, because parameters 
-	// should be adjusted according to the point cloud characteristics
-	//------------------------------------------------------------------------------------------
-	Efficient_ransac::Parameters parameters = set_parameters(point_cloud.size(), apply_defaults);	
-	if (verbose)
-	{
-		out_det << "probability " 		<< parameters.probability << std::endl
-						<< "min points "			<< parameters.min_points << std::endl
-						<< "epsilon "					<< parameters.epsilon << std::endl
-						<< "cluster epsilon " << parameters.cluster_epsilon << std::endl
-						<< "normal deviation "<< parameters.normal_threshold << std::endl;
-	}
-	
+
 	// detect shape 
-	std::cerr << "Seeking shapes...\n";
+	msg << "Seeking shapes...\n";
 	t.start();
 	ransac.detect(parameters);
 	t.stop();
 	
 	// after the work is done, print the number of detected shapes and unassigned points too
-	std::cerr << ransac.shapes().end() - ransac.shapes().begin() << " detected shapes, "
+	msg << ransac.shapes().end() - ransac.shapes().begin() << " detected shapes, "
 						<< ransac.number_of_unassigned_points() << " unassigned point(s) "
 						<< "after " << t.time() << " second(s) (" << int(t.time())/60 << " min(s))\n";
 	
+	// points not assigned to any shape keep these
+	kinds.assign(point_cloud.size(), UNDEF);
+	ids.assign(point_cloud.size(), -1);
+	found.clear();
+
 	// Efficient_ransac.shapes() provides also an iterator range to the detected shapes
 	Efficient_ransac::Shape_range	shapes = ransac.shapes();
 	std::size_t 									cylinders = 0, planes = 0, spheres = 0, cones = 0, toruses = 0;
 	for (Efficient_ransac::Shape_range::iterator s = shapes.begin(); s != shapes.end(); s++)
 	{
-		// for each shape, assign it a color 
-		// (blue for axle, yellow for plane, green for spheres, grey for unassigned)
+		// for each shape, assign it a label: the kind of the shape and its index among
+		// the shapes of the same kind (colors are derived from these only when saving)
 		
 		// each shape has a vector of assigned points
 		std::vector<std::size_t>::const_iterator index_s = (*s)->indices_of_assigned_points().begin();
@@ -213,74 +153,64 @@ int main(int argc, char** argv)
 			if (verbose)
 			{
 				out_det	<< "Plane " << planes << " with normal [" << normal << "] > ";
-				// plane shape can also be converted into EPIC_kernel::Plane_3
-				out_det << "Kernel::Plane_3 [" << static_cast<EPIC_kernel::Plane_3>(*plane) << "]\n";
+				// plane shape can also be converted into Kernel::Plane_3
+				out_det << "Kernel::Plane_3 [" << static_cast<Kernel::Plane_3>(*plane) << "]\n";
 			}
-			c = get_yellow_value(planes);
+			Coarse_shape shape;
+			Point p = static_cast<Kernel::Plane_3>(*plane).point();
+			shape.kind = PLANE;
+			shape.plane.point = make_vec3(p.x(), p.y(), p.z());
+			shape.plane.normal = normalized(make_vec3(normal.x(), normal.y(), normal.z()));
+			found.push_back(shape);
 			while (index_s != (*s)->indices_of_assigned_points().end())
 			{
-				// retrieve the point
-				const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-				// add this point to the final point cloud plus relative color
-				output_point_cloud.push_back(p);
-				color_cloud.push_back(c);
+				// label the point with its plane
+				kinds[*index_s] = PLANE;
+				ids[*index_s] = Shape_id(planes);
 				index_s++;
 			}
 			planes++;
 		}
 		else if (Cylinder* cyl = dynamic_cast<Cylinder*>(s->get()))
 		{
-			EPIC_kernel::Line_3 axis = cyl->axis(); // the axis is a point and a direction
+			Kernel::Line_3 axis = cyl->axis(); // the axis is a point and a direction
 			FT radius = cyl->radius();
 			if (verbose)
 				out_det << "Cylinder " << cylinders << " with axis [" << axis
 								<< "] and radius " << radius;
-			// v. 0.2
-			// calculate axis angle with Y axis: must be almost aligned. To check this, the angle
-			// between these vectors must be less than a threshold. Moreover, since we know that
-			// y = [0,1,0], and that cyl->axis is a normalized vector, the angle to be computed 
-			// exploiting u * v = |u|*|v|*cos(angle_uv) can ba obtained as:
-			double theta = acos((axis.to_vector())[1]);
-			if (theta > 0.52 && theta < 2.62) // radians: 30 degrees 
+			// the axis is normalized here, not trusted to be: with the float kernel its y component
+			// can exceed 1 and acos would give NaN (see utils/labels.hpp)
+			Vector d = axis.to_vector();
+			const double axis_y = d[1] / std::sqrt(d.squared_length());
+			Shape_kind k = classify_cylinder(axis_y, radius);
+			if (k == WRNGAX)
 			{
-				std::cerr << "Cylinder with axis not aligned to Y (theta " << theta << " rad): non classified\n";
+				// the angle as classify_cylinder computes it
+				const double theta = std::acos(std::max(-1.0, std::min(1.0, axis_y)));
+				msg << "Cylinder with axis not aligned to Y (theta " << theta << " rad): non classified\n";
 				if (verbose)
 					out_det << " not classified (axis)\n";
-				c = get_color_value(WRNGAX);
-				while (index_s != (*s)->indices_of_assigned_points().end())
-				{
-					const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-					output_point_cloud.push_back(p);
-					color_cloud.push_back(c);
-					index_s++;
-				}
 			}
-			else if (radius > 1.0)
+			else if (k == BIGCYL)
 			{
-				std::cerr << "Cylinder with too high radius: non classified\n";
+				msg << "Cylinder with too high radius: non classified\n";
 				if (verbose)
 					out_det << " not classified (radius)\n";
-				c = get_color_value(BIGCYL);
-				while (index_s != (*s)->indices_of_assigned_points().end())
-				{
-					const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-					output_point_cloud.push_back(p);
-					color_cloud.push_back(c);
-					index_s++;
-				}
 			}
-			else
+			else if (verbose)
+				out_det << std::endl;
+			Coarse_shape shape;
+			Point p = axis.point();
+			shape.kind = k;
+			shape.cylinder.point = make_vec3(p.x(), p.y(), p.z());
+			shape.cylinder.axis = normalized(make_vec3(d.x(), d.y(), d.z()));
+			shape.cylinder.radius = radius;
+			found.push_back(shape);
+			while (index_s != (*s)->indices_of_assigned_points().end())
 			{
-				if (verbose)
-					out_det << std::endl;
-				c = get_blue_value(cylinders);
-				while (index_s != (*s)->indices_of_assigned_points().end())
-				{
-					const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-					output_point_cloud.push_back(p);
-					color_cloud.push_back(c);
-					index_s++;
-				}
+				kinds[*index_s] = k;
+				ids[*index_s] = Shape_id(cylinders);
+				index_s++;
 			}
 			cylinders++;
 		}
@@ -293,14 +223,11 @@ int main(int argc, char** argv)
 //								<< "found with center [" << center 
 //								<< "] and radius " << radius << std::endl;
 //			
-//			c = get_color_value(SPHERE);
 //			while (index_s != (*s)->indices_of_assigned_points().end())
 //			{
-//				// retrieve the point
-//				const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-//				// add this point to the final point cloud plus relative color
-//				output_point_cloud.push_back(p);
-//				color_cloud.push_back(c);
+//				// label the point with its sphere
+//				kinds[*index_s] = SPHERE;
+//				ids[*index_s] = Shape_id(spheres);
 //				index_s++;
 //			}
 //			spheres++;				
@@ -316,14 +243,11 @@ int main(int argc, char** argv)
 //								<< "axis [" << axis << "] "
 //								<< "and base angle " << angle << " rad\n";
 //								
-//			c = get_color_value(CONE);
 //			while (index_s != (*s)->indices_of_assigned_points().end())
 //			{
-//				// retrieve the point
-//				const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-//				// add this point to the final point cloud plus relative color
-//				output_point_cloud.push_back(p);
-//				color_cloud.push_back(c);
+//				// label the point with its cone
+//				kinds[*index_s] = CONE;
+//				ids[*index_s] = Shape_id(cones);
 //				index_s++;
 //			}
 //			cones++;
@@ -341,14 +265,11 @@ int main(int argc, char** argv)
 //								<< "major r: " << major_radius 
 //								<< " minor r:" << minor_radius << std::endl;
 //								
-//			c = get_color_value(TORUS);
 //			while (index_s != (*s)->indices_of_assigned_points().end())
 //			{
-//				// retrieve the point
-//				const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-//				// add this point to the final point cloud plus relative color
-//				output_point_cloud.push_back(p);
-//				color_cloud.push_back(c);
+//				// label the point with its torus
+//				kinds[*index_s] = TORUS;
+//				ids[*index_s] = Shape_id(toruses);
 //				index_s++;
 //			}
 //			toruses++;
@@ -359,58 +280,404 @@ int main(int argc, char** argv)
 			// print the parameters of the detected shape. This function is 
 			// available for any type of shape, so have a look to the structures
 			// to find out the information that you need
-			if (verbose) std::cerr << (*s)->info() << std::endl;
+			if (verbose) msg << (*s)->info() << std::endl;
 		}
 	}
-	std::cerr << "Found " << cylinders << " cylinders"
+	msg << "Found " << cylinders << " cylinders"
 						<< ", " << planes << " planes " 
 //						<< "," << spheres << " spheres "
 //						<< ", " << cones << " cones and " << toruses << " toruses\n";
 						<< std::endl;
-	out_det.close();
+	return t.time();
+}
+
+// Coarse to fine: detect on the cloud downsampled to about budget points, then look for the points
+// of each shape at full resolution only in a thin shell around it. Same output as detect()
+double detect_coarse (Pwn_vector& point_cloud, const Efficient_ransac::Parameters& full_parameters,
+											std::size_t budget, bool verbose, std::ostream& out_det, std::vector<Shape_kind>& kinds,
+											std::vector<Shape_id>& ids, std::vector<Coarse_shape>& found)
+{
+	Real_timer t;
+	t.start();
+	std::vector<Vec3> points (point_cloud.size()), normals (point_cloud.size());
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+	{
+		const Point& p = point_cloud[i].first;
+		const Vector& n = point_cloud[i].second;
+		points[i] = make_vec3(p.x(), p.y(), p.z());
+		normals[i] = normalized(make_vec3(n.x(), n.y(), n.z()));
+	}
+	double leaf = Voxel_grid::leaf_size_for_budget(points, budget);
+	if (leaf == 0.0)
+	{
+		std::cerr << "Cloud already within " << budget << " point(s): no downsampling\n";
+		t.stop();
+		return t.time() + detect(point_cloud, full_parameters, verbose, out_det, kinds, ids, found);
+	}
+	Voxel_grid grid (points, leaf);
+	std::vector<Vec3> coarse_points, coarse_normals;
+	grid.average_points(points, coarse_points);
+	grid.average_normals(normals, coarse_normals);
+	Pwn_vector coarse_cloud (grid.size());
+	for (std::size_t v = 0; v < grid.size(); v++)
+		coarse_cloud[v] = Point_with_normal(Point(coarse_points[v][0], coarse_points[v][1], coarse_points[v][2]),
+																				Vector(coarse_normals[v][0], coarse_normals[v][1], coarse_normals[v][2]));
+	t.stop();
+	std::cerr << "Downsampled to " << coarse_cloud.size() << " point(s) with leaf " << leaf << "\n";
+
+	// min points follows the size of the coarse cloud; clusters must still be connected in it
+	Efficient_ransac::Parameters parameters = full_parameters;
+	parameters.min_points = std::max<std::size_t>(1, std::size_t(double(full_parameters.min_points)
+																												* double(coarse_cloud.size()) / double(point_cloud.size())));
+	if (parameters.cluster_epsilon < 1.5 * leaf)
+	{
+		parameters.cluster_epsilon = 1.5 * leaf;
+		std::cerr << "Cluster epsilon raised to " << parameters.cluster_epsilon << " for the coarse cloud\n";
+	}
+	if (verbose)
+		out_det << "coarse leaf " << leaf << " points " << coarse_cloud.size() << " min points " << parameters.min_points
+						<< " cluster epsilon " << parameters.cluster_epsilon << std::endl;
+	std::vector<Shape_kind> coarse_kinds;
+	std::vector<Shape_id> coarse_ids;
+	std::vector<Coarse_shape> coarse_shapes;
+	double time = t.time() + detect(coarse_cloud, parameters, verbose, out_det, coarse_kinds, coarse_ids, coarse_shapes);
+
+	// the averaged points moved up to a leaf from the ones they replace: the shell covers it
+	t.reset();
+	t.start();
+	Refinement_parameters refinement;
+	refinement.epsilon = parameters.epsilon;
+	refinement.normal_threshold = parameters.normal_threshold;
+	refinement.shell = parameters.epsilon + leaf;
+	refinement.min_points = full_parameters.min_points;
+	kinds.assign(point_cloud.size(), UNDEF);
+	ids.assign(point_cloud.size(), -1);
+	refine_shapes(points, normals, coarse_shapes, refinement, kinds, ids, found);
+	t.stop();
+	std::cerr << "Refined " << found.size() << " shape(s) at full resolution in " << t.time() << " second(s)\n";
+	if (verbose)
+		for (std::size_t s = 0; s < found.size(); s++)
+			if (found[s].kind != PLANE)
+				out_det << "Refined cylinder " << s << " with axis [" << found[s].cylinder.point[0] << " "
+								<< found[s].cylinder.point[1] << " " << found[s].cylinder.point[2] << " "
+								<< found[s].cylinder.axis[0] << " " << found[s].cylinder.axis[1] << " "
+								<< found[s].cylinder.axis[2] << "] and radius " << found[s].cylinder.radius
+								<< ((found[s].kind == CYLIND)? "\n" : " not classified\n");
+	return time + t.time();
+}
+
+// one detection on a cluster: its own cloud, labels and messages
+struct Cluster_job
+{
+	Pwn_vector								point_cloud;
+	std::vector<Shape_kind>		kinds;
+	std::vector<Shape_id>			ids;
+	std::vector<Coarse_shape>	found;
+	std::ostringstream				log, msg;
+	double										time;
+};
+
+// Clusters: split the cloud into its connected pieces (points closer than radius) and run one
+// detection per piece on a thread pool; pieces with less than min_points points cannot hold a
+// shape and are skipped. Same output as detect(), with shape ids numbered across the pieces
+double detect_clusters (Pwn_vector& point_cloud, const Efficient_ransac::Parameters& parameters, double radius,
+												bool verbose, std::ostream& out_det, std::vector<Shape_kind>& kinds,
+												std::vector<Shape_id>& ids, std::vector<Coarse_shape>& found)
+{
+	Real_timer t;
+	t.start();
+	std::vector<Vec3> points (point_cloud.size());
+	parallel_for_each_index(points.size(), [&](std::size_t i)
+	{
+		const Point& p = point_cloud[i].first;
+		points[i] = make_vec3(p.x(), p.y(), p.z());
+	});
+	std::vector<std::vector<std::size_t> > clusters = euclidean_clusters(points, radius, parameters.min_points);
+	std::vector<Cluster_job> jobs (clusters.size());
+	std::size_t clustered = 0;
+	for (std::size_t c = 0; c < clusters.size(); c++)
+	{
+		jobs[c].point_cloud.reserve(clusters[c].size());
+		for (std::size_t k = 0; k < clusters[c].size(); k++)
+			jobs[c].point_cloud.push_back(point_cloud[clusters[c][k]]);
+		clustered += clusters[c].size();
+	}
+	t.stop();
+	std::cerr << clusters.size() << " cluster(s) with at least " << parameters.min_points << " point(s) ("
+						<< point_cloud.size() - clustered << " point(s) left out) after " << t.time() << " second(s)\n";
+
+	// biggest clusters first: they take longer, the small ones fill the gaps
+	t.start();
+	{
+		Thread_pool pool;
+		std::vector<std::future<double> > times;
+		for (std::size_t c = 0; c < jobs.size(); c++)
+			times.push_back(pool.submit([&jobs, &parameters, verbose, c]
+			{
+				Cluster_job& job = jobs[c];
+				return detect(job.point_cloud, parameters, verbose, job.log, job.kinds, job.ids, job.found, job.msg);
+			}));
+		for (std::size_t c = 0; c < jobs.size(); c++)
+			jobs[c].time = times[c].get();
+	}
+	t.stop();
+
+	// back to the whole cloud, in cluster order
+	kinds.assign(point_cloud.size(), UNDEF);
+	ids.assign(point_cloud.size(), -1);
+	found.clear();
+	Shape_id planes = 0, cylinders = 0;
+	for (std::size_t c = 0; c < jobs.size(); c++)
+	{
+		const Cluster_job& job = jobs[c];
+		std::cerr << "Cluster " << c << " (" << clusters[c].size() << " points, " << job.time << " s)\n" << job.msg.str();
+		if (verbose)
+			out_det << "cluster " << c << " points " << clusters[c].size() << std::endl << job.log.str();
+		for (std::size_t k = 0; k < clusters[c].size(); k++)
+		{
+			kinds[clusters[c][k]] = job.kinds[k];
+			if (job.ids[k] >= 0)
+				ids[clusters[c][k]] = job.ids[k] + ((job.kinds[k] == PLANE)? planes : cylinders);
+		}
+		for (std::size_t s = 0; s < job.found.size(); s++)
+		{
+			if (job.found[s].kind == PLANE)
+				planes++;
+			else
+				cylinders++;
+			found.push_back(job.found[s]);
+		}
+	}
+	return t.time();
+}
+
+// center of the points of the accepted cylinders (what Matlab computes on the cleared cloud)
+bool cylinder_center (const Pwn_vector& point_cloud, const std::vector<Shape_kind>& kinds, Vec3& center)
+{
+	Vec3 sum = make_vec3(0, 0, 0);
+	std::size_t count = 0;
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+		if (kinds[i] == CYLIND)
+		{
+			const Point& p = point_cloud[i].first;
+			sum = sum + make_vec3(p.x(), p.y(), p.z());
+			count++;
+		}
+	if (count == 0)
+		return false;
+	center = (1.0 / double(count)) * sum;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || argc > 15)
+	{
+		std::cerr << "ERROR: wrong arguments. Tap --help for more info" << std::endl;
+		std::cerr << "\tUsage: detect_shapes_ransac [--verbose] [--defaults] [--colors] [--cylinders-only] [--debug <debug_file.ply>] "
+							<< "[--coarse <points> | --clusters <radius>] [--compare] <input_file.ply> <output_file.ply>\n";
+		return EXIT_FAILURE;
+	}
+	if (strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\n\tUsage: detect_shapes_ransac [--verbose] [--defaults] [--colors] [--cylinders-only] [--debug <debug_file.ply>] "
+							<< "[--coarse <points> | --clusters <radius>] [--compare] <input_file.ply> <output_file.ply>\n";
+		std::cerr << "\nThis program detects shapes inside the point cloud, with particular attention to cylinders.\n";
+		std::cerr << "Detectable shapes are: planes, cylinders, spheres, toruses, cones. (check the source)\n";
+		std::cerr << "\n--v, --verbose\tinformation about found shapes can be found into the a log file\n";
+		std::cerr << "--defaults\tif specified, RANSAC parameters will not be asked in input but default values "
+							<< "(0.01/2% size/0.05/0.025/0.9) will be applied\n";
+		std::cerr << "--colors\tbesides the labels, write the shape colors (for visualization only)\n";
+		std::cerr << "--cylinders-only\tsave only the points of the accepted cylinders, as clear_shape would do "
+							<< "(detection and cleaning in a single step)\n";
+		std::cerr << "--debug\t\talso save the whole colored cloud, with all the shapes and the unassigned points\n";
+		std::cerr << "--coarse\tdetect on the cloud voxel-downsampled to about this many points, then refine the "
+							<< "shapes on the full resolution points near them\n";
+		std::cerr << "--clusters\tsplit the cloud into pieces separated by gaps wider than radius and detect the shapes "
+							<< "of each piece concurrently (pieces smaller than min points are skipped)\n";
+		std::cerr << "--compare\twith --coarse or --clusters, also run the plain detection and report speedup and "
+							<< "deviation of the cylinder center\n";
+		std::cerr << "\ninput and output can also be shared memory segments: shm://<name> (the output gets the labels "
+							<< "but no colors)\n";
+		std::cerr << "--help\t\tdisplay information\n";
+		return EXIT_FAILURE;
+	}
+	if (argc < 3)
+	{
+		std::cerr << "ERROR: missing input or output file. Tap --help for more info" << std::endl;
+		return EXIT_FAILURE;
+	}
+	
+	std::string		infile;
+	std::string 	outfile;
+	bool					apply_defaults = false;
+	bool 					verbose = false;
+	bool					with_colors = false;
+	bool					cylinders_only = false;
+	bool					compare = false;
+	std::size_t		coarse_budget = 0;
+	double				cluster_radius = 0.0;
+	std::string		debug_file;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp("--verbose", argv[a]) == 0 || strcmp("--v", argv[a]) == 0)
+			verbose = true;
+		else if (strcmp("--defaults", argv[a]) == 0)
+			apply_defaults = true;
+		else if (strcmp("--colors", argv[a]) == 0)
+			with_colors = true;
+		else if (strcmp("--cylinders-only", argv[a]) == 0)
+			cylinders_only = true;
+		else if (strcmp("--debug", argv[a]) == 0 && a + 1 < argc - 2)
+			debug_file = argv[++a];
+		else if (strcmp("--coarse", argv[a]) == 0 && a + 1 < argc - 2 && atol(argv[a + 1]) > 0)
+			coarse_budget = std::size_t(atol(argv[++a]));
+		else if (strcmp("--clusters", argv[a]) == 0 && a + 1 < argc - 2 && atof(argv[a + 1]) > 0.0)
+			cluster_radius = atof(argv[++a]);
+		else if (strcmp("--compare", argv[a]) == 0)
+			compare = true;
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (coarse_budget > 0 && cluster_radius > 0.0)
+	{
+		std::cerr << "ERROR: --coarse and --clusters cannot be used together. Tap --help for more info" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (compare && coarse_budget == 0 && cluster_radius == 0.0)
+	{
+		std::cerr << "ERROR: --compare needs --coarse or --clusters. Tap --help for more info" << std::endl;
+		return EXIT_FAILURE;
+	}
+	infile = argv[argc - 2];
+	outfile = argv[argc - 1];
+	
+	Cloud_uri									input = parse_cloud_uri(infile), output = parse_cloud_uri(outfile);
+	std::ifstream 						in;
+	std::ofstream 						out;
+	Pwn_vector 								point_cloud;
+	std::vector<Shape_kind>		kind_cloud;
+	std::vector<Shape_id>			id_cloud;
+	std::vector<Coarse_shape>	shapes;
+	
+	if (!output.shared)
+		out.open(output.path);
+	
+	// logging (next to the output file, or in the current directory for a shared memory segment)
+	outfile = (output.shared? output.path.substr(1) : output.path.substr(0, output.path.find(".ply"))).append("_log.txt");
+	if (verbose)
+		std::cerr << "Saving log in " << outfile << std::endl;
+	std::ofstream	out_det (outfile);
+	
+	// read point cloud
+	bool read;
+	if (input.shared)
+		read = attach_points_with_normals(input, point_cloud);
+	else
+	{
+		in.open(input.path);
+		read = in && read_ply_points_with_normals(in, point_cloud);		// colors and labels are skipped
+	}
+	if (!read)
+	{
+		std::cerr << "ERROR: cannot read file " << infile << std::endl;
+		return EXIT_FAILURE;
+	}
 	in.close();
 	
-	// iterate on all other points
-	std::cerr << "Reordering unassigned points...\n";
-	Efficient_ransac::Point_index_range::iterator index_s = ransac.indices_of_unassigned_points().begin();
-	c = get_color_value(UNDEF);
-	while (index_s != ransac.indices_of_unassigned_points().end())
+	std::cerr << "Read successfully " << point_cloud.size() << " point(s) with properties...\n";
+	std::cerr << "Setting parameters for shape detection...\n";
+
+	//------------------------------------------------------------------------------------------
+	// set parameters for shape detection: we make this step interactive, because parameters 
+	// should be adjusted according to the point cloud characteristics
+	//------------------------------------------------------------------------------------------
+	Efficient_ransac::Parameters parameters = set_parameters(point_cloud.size(), apply_defaults);	
+	if (verbose)
+	{
+		out_det << "probability " 		<< parameters.probability << std::endl
+						<< "min points "			<< parameters.min_points << std::endl
+						<< "epsilon "					<< parameters.epsilon << std::endl
+						<< "cluster epsilon " << parameters.cluster_epsilon << std::endl
+						<< "normal deviation "<< parameters.normal_threshold << std::endl;
+	}
+	double time;
+	const char* mode = "plain";
+	if (coarse_budget > 0)
+	{
+		mode = "coarse to fine";
+		time = detect_coarse(point_cloud, parameters, coarse_budget, verbose, out_det, kind_cloud, id_cloud, shapes);
+		std::cerr << "Coarse to fine detection took " << time << " second(s)\n";
+	}
+	else if (cluster_radius > 0.0)
+	{
+		mode = "per cluster";
+		time = detect_clusters(point_cloud, parameters, cluster_radius, verbose, out_det, kind_cloud, id_cloud, shapes);
+		std::cerr << "Per cluster detection took " << time << " second(s)\n";
+	}
+	else
+		time = detect(point_cloud, parameters, verbose, out_det, kind_cloud, id_cloud, shapes);
+
+	// the plain detection on the whole cloud, as a reference
+	if (compare)
 	{
-		// retrieve the point
-		const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-		// add this point to the final point cloud plus relative color
-		output_point_cloud.push_back(p);
-		color_cloud.push_back(c);
-		index_s++;
+		std::cerr << "Running the plain detection for comparison...\n";
+		std::vector<Shape_kind>		full_kinds;
+		std::vector<Shape_id>			full_ids;
+		std::vector<Coarse_shape>	full_shapes;
+		std::ofstream							no_log;
+		double full_time = detect(point_cloud, parameters, false, no_log, full_kinds, full_ids, full_shapes);
+		Vec3 mode_center, full_center;
+		bool mode_found = cylinder_center(point_cloud, kind_cloud, mode_center);
+		bool full_found = cylinder_center(point_cloud, full_kinds, full_center);
+		std::cerr << "Plain " << full_time << " s, " << mode << " " << time << " s: speedup "
+							<< full_time / time << "x\n";
+		out_det << "plain " << full_time << " s " << mode << " " << time << " s speedup " << full_time / time << std::endl;
+		if (mode_found && full_found)
+		{
+			double deviation = length(mode_center - full_center);
+			std::cerr << "Cylinder center deviation " << deviation << " (plain [" << full_center[0] << " "
+								<< full_center[1] << " " << full_center[2] << "], " << mode << " [" << mode_center[0] << " "
+								<< mode_center[1] << " " << mode_center[2] << "])\n";
+			out_det << "center deviation " << deviation << std::endl;
+		}
+		else if (full_found)
+			std::cerr << "Cylinder center deviation not available: no accepted cylinder in the " << mode << " detection\n";
+		else
+			std::cerr << "Cylinder center deviation not available: no accepted cylinder in the plain detection\n";
 	}
+	out_det.close();
 	
-	// save file
+	// save file: in fused mode only the points that clear_shape would have kept
 	std::cerr << "Saving output...\n";
-	out	<< "ply " << std::endl
-			<< "format ascii 1.0" << std::endl
-			<< "element vertex " << output_point_cloud.size() << std::endl
-			<< "property float x" << std::endl
-			<< "property float y" << std::endl
-			<< "property float z" << std::endl
-			<< "property float nx" << std::endl
-			<< "property float ny" << std::endl
-			<< "property float nz" << std::endl
-			<< "property uchar red" << std::endl
-			<< "property uchar green" << std::endl
-			<< "property uchar blue" << std::endl
-			<< "end_header" << std::endl; 
-
-	std::vector<Color>::iterator ci = color_cloud.begin();
-	for (Pwn_vector::iterator i = output_point_cloud.begin(); i != output_point_cloud.end(); ++i)
+	const Keep_table keep = cylinders_only? keep_cylinders() : keep_all();
+	if (output.shared)
 	{
-		Point& p = get<0>(*i);
-		Vector& n = get<1>(*i);
-		out << p << " " << n << " ";
-		out << int((*ci)[0]) << " " << int((*ci)[1]) << " " << int((*ci)[2]) << std::endl;
-		ci++;
+		long published = publish_labeled_cloud(output.path, point_cloud, kind_cloud, id_cloud, keep);
+		if (published < 0)
+		{
+			std::cerr << "ERROR: cannot write shared memory segment " << output.path << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cerr << published << " point(s) published in " << output.path << std::endl;
+	}
+	else
+	{
+		std::size_t saved = write_labeled_ply(out, point_cloud, kind_cloud, id_cloud, keep, with_colors);
+		std::cerr << saved << " point(s) saved\n";
 	}
 	out.close();
 	
+	if (!debug_file.empty())
+	{
+		std::cerr << "Saving debug output in " << debug_file << "...\n";
+		std::ofstream out_dbg (debug_file);
+		write_labeled_ply(out_dbg, point_cloud, kind_cloud, id_cloud, keep_all(), true);
+		out_dbg.close();
+	}
+	
 	return EXIT_SUCCESS;
 }
-
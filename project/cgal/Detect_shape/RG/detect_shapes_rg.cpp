@@ -3,6 +3,10 @@
  * This algorithm is not based on random consensus as RANSAC, so it is deterministic, but a bit slower.
  * Trying to identify into a point cloud the plane shape
  * See: https://doc.cgal.org/latest/Point_set_shape_detection_3/index.html#Point_set_shape_detection_3Usage_parameters
+ * Two engines are available: the CGAL one, which grows one region at a time on a single thread,
+ * and the parallel one of funcs/region_growing.hpp, which grows all regions at once
+ * With --sort the points are sorted along a Morton curve after reading (utils/spatial_sort.hpp),
+ * so that the neighbor queries of both engines find their points close in memory
  */
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/IO/read_ply_points.h>
@@ -18,7 +22,11 @@
 #include <vector>
 
 #include "../../utils/colors.hpp"
+#include "../../utils/labels.hpp"
 #include "../../utils/checks.hpp"
+#include "../../utils/labeled_ply.hpp"
+#include "../../utils/spatial_sort.hpp"
+#include "../../funcs/region_growing.hpp"
 
 // types
 typedef CGAL::Exact_predicates_inexact_constructions_kernel		EPIC_kernel;
@@ -68,49 +76,15 @@ Region_growing::Parameters set_parameters(std::size_t cloud_size)
 }
 
 
-int main(int argc, char** argv)
+// CGAL engine: returns the seconds spent in detection, appends the labelled points to the output
+double detect_cgal (const Pwn_vector& point_cloud, const Region_growing::Parameters& parameters,
+										bool verbose, std::ofstream& out_det, Pwn_vector& output_point_cloud,
+										std::vector<Shape_kind>& kind_cloud, std::vector<Shape_id>& id_cloud)
 {
-	if (argc < 3 || argc > 5)
-	{
-		std::cerr << "ERROR: wrong arguments." << std::endl;
-		std::cerr << "\tUsage: detect_shapes_rg [-v|--verbose] <input_file.ply> <output_file.ply>\n";
-		std::cerr << "\n\tDetect PLANES ONLY over a point cloud with normals, using Region Growing algorithm.\n";
-		std::cerr << "\tIf you specify verbose mode, information about those can be found into the log file\n";
-		return EXIT_FAILURE;
-	}
-	
-	std::ifstream 			in 	((argc == 3)? argv[1] : argv[2]);
-	std::string					outfile = (argc == 3)? argv[2] : argv[3];
-	std::ofstream 			out (outfile);
-	bool								verbose = (strcmp(argv[1], "-v")==0 || strcmp(argv[1],"--verbose")==0)? true : false;
-	Pwn_vector 					point_cloud;
-	std::vector<Color>	color_cloud;
-	Pwn_vector					output_point_cloud;
-	Color								c;
-	
-	outfile = outfile.substr(0, outfile.find(".ply")).append("_log.txt");
-	if (verbose)
-		std::cerr << "Saving log in " << outfile << std::endl;
-	std::ofstream	out_det (outfile);
-	
-	if (!in || !CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud), 
-																											CGAL::make_ply_point_reader (Point_map()),
-																											CGAL::make_ply_normal_reader (Normal_map())
-																											))
-	{
-		std::cerr << "ERROR: cannot read file " << argv[1] << std::endl;
-		return EXIT_FAILURE;
-	}
-	std::cerr << "Read successfully " << point_cloud.size() << " point(s) with properties...\n";
-	
-//	for (std::vector<PNC>::iterator i = point_cloud_with_properties.begin(); i != point_cloud_with_properties.end(); i++)
-//		point_cloud.push_back(Point_with_normal(get<0>(*i), get<1>(*i)));
-		
-	std::cerr << "Setting parameters for shape detection...\n";
 	// instantiate shape detection engine
 	Region_growing region_grow;
-	// provide input data
-	region_grow.set_input (point_cloud);
+	// provide input data (CGAL wants a mutable range, but does not modify the points)
+	region_grow.set_input (const_cast<Pwn_vector&>(point_cloud));
 	// register shapes for detection
 	region_grow.add_shape_factory<Plane>();
 //	region_grow.add_shape_factory<Sphere>();
@@ -118,22 +92,9 @@ int main(int argc, char** argv)
 //	region_grow.add_shape_factory<Cone>();
 //	region_grow.add_shape_factory<Torus>();
 	
-	//------------------------------------------------------------------------------------------
-	// set parameters for shape detection: we make this step interactive, because parameters 
-	// should be adjusted according to the point cloud characteristics
-	//------------------------------------------------------------------------------------------
-	Region_growing::Parameters parameters = set_parameters(point_cloud.size());	
-	if (verbose)
-	{
-		out_det << "min points "			<< parameters.min_points << std::endl
-						<< "epsilon "					<< parameters.epsilon << std::endl
-						<< "cluster epsilon " << parameters.cluster_epsilon << std::endl
-						<< "normal deviation "<< parameters.normal_threshold << std::endl;
-	}
-	
 	// detect shape 
 	Real_timer t;
-	std::cerr << "Seeking shapes...\n";
+	std::cerr << "Seeking shapes (CGAL engine)...\n";
 	t.start();
 	region_grow.detect(parameters);
 	t.stop();
@@ -146,10 +107,11 @@ int main(int argc, char** argv)
 	// Region_growing.shapes() provides also an iterator range to the detected shapes
 	Region_growing::Shape_range	shapes = region_grow.shapes();
 	std::size_t cylinders = 0, planes = 0;//, spheres = 0, cones = 0, toruses = 0;
+	Shape_kind	k;
 	for (Region_growing::Shape_range::iterator s = shapes.begin(); s != shapes.end(); s++)
 	{
-		// for each shape, assign it a color 
-		// (blue for axle, yellow for plane, green for spheres, grey for unassigned)
+		// for each shape, assign it a label: the kind of the shape and its index among
+		// the shapes of the same kind (colors are derived from these only when saving)
 		
 		// each shape has a vector of assigned points
 		std::vector<std::size_t>::const_iterator index_s = (*s)->indices_of_assigned_points().begin();
@@ -164,15 +126,14 @@ int main(int argc, char** argv)
 				out_det << "Kernel::Plane_3 [" << static_cast<EPIC_kernel::Plane_3>(*plane) << "]\n";
 			}
 			
-//			c = get_color_value(PLANE);
-			c = get_yellow_value(planes);
 			while (index_s != (*s)->indices_of_assigned_points().end())
 			{
 				// retrieve the point
 				const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-				// add this point to the final point cloud plus relative color
+				// add this point to the final point cloud plus relative label
 				output_point_cloud.push_back(p);
-				color_cloud.push_back(c);
+				kind_cloud.push_back(PLANE);
+				id_cloud.push_back(Shape_id(planes));
 				index_s++;
 			}
 			planes++;
@@ -184,38 +145,25 @@ int main(int argc, char** argv)
 			if (verbose)
 				out_det << "Cylinder " << cylinders << " with axis [" << axis
 								<< "] and radius " << radius;
-			if (radius > 1.0)
+			k = classify_cylinder(axis.to_vector()[1] / std::sqrt(axis.to_vector().squared_length()), radius);
+			if (k != CYLIND)
 			{
-				std::cerr << "Cylinder with too high radius: non classified\n";
+				std::cerr << "Cylinder with " << ((k == WRNGAX)? "axis not aligned to Y" : "too high radius")
+									<< ": non classified\n";
 				if (verbose)
 					out_det << " not classified\n";
-
-				c = get_color_value(BIGCYL);
-				while (index_s != (*s)->indices_of_assigned_points().end())
-				{
-					// retrieve the point
-					const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-					// add this point to the final point cloud plus relative color
-					output_point_cloud.push_back(p);
-					color_cloud.push_back(c);
-					index_s++;
-				}
 			}
-			else
+			else if (verbose)
+				out_det << std::endl;
+			while (index_s != (*s)->indices_of_assigned_points().end())
 			{
-				if (verbose)
-					out_det << std::endl;
-					
-				c = get_blue_value(cylinders);
-				while (index_s != (*s)->indices_of_assigned_points().end())
-				{
-					// retrieve the point
-					const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-					// add this point to the final point cloud plus relative color
-					output_point_cloud.push_back(p);
-					color_cloud.push_back(c);
-					index_s++;
-				}
+				// retrieve the point
+				const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
+				// add this point to the final point cloud plus relative label
+				output_point_cloud.push_back(p);
+				kind_cloud.push_back(k);
+				id_cloud.push_back(Shape_id(cylinders));
+				index_s++;
 			}
 			cylinders++;
 		}
@@ -231,50 +179,236 @@ int main(int argc, char** argv)
 //						<< planes << " planes, " << spheres << " spheres
 //						<< cones << " cones and " << toruses << " toruses\n";
 	std::cerr << "Found " << cylinders << " cylinders and " << planes << " planes\n";
-	out_det.close();
-	in.close();
 	
 	// iterate on all other points
 	std::cerr << "Reordering unassigned points...\n";
 	Region_growing::Point_index_range::iterator index_s = region_grow.indices_of_unassigned_points().begin();
-	c = get_color_value(GREY);
 	while (index_s != region_grow.indices_of_unassigned_points().end())
 	{
 		// retrieve the point
 		const Point_with_normal &p = *(point_cloud.begin() + (*index_s));
-		// add this point to the final point cloud plus relative color
+		// add this point to the final point cloud plus relative label
 		output_point_cloud.push_back(p);
-		color_cloud.push_back(c);
+		kind_cloud.push_back(UNDEF);
+		id_cloud.push_back(-1);
 		index_s++;
 	}
+	return t.time();
+}
+
+// parallel engine: same parameters, same output
+double detect_parallel (const Pwn_vector& point_cloud, const Region_growing::Parameters& cgal_parameters,
+												bool verbose, std::ofstream& out_det, Pwn_vector& output_point_cloud,
+												std::vector<Shape_kind>& kind_cloud, std::vector<Shape_id>& id_cloud)
+{
+	std::vector<Vec3> points (point_cloud.size()), normals (point_cloud.size());
+	parallel_for_each_index(point_cloud.size(), [&](std::size_t i)
+	{
+		const Point& p = point_cloud[i].first;
+		const Vector& n = point_cloud[i].second;
+		points[i] = make_vec3(p.x(), p.y(), p.z());
+		normals[i] = normalized(make_vec3(n.x(), n.y(), n.z()));
+	});
+	Region_growing_parameters parameters;
+	parameters.min_points				= cgal_parameters.min_points;
+	parameters.epsilon					= cgal_parameters.epsilon;
+	parameters.cluster_epsilon	= cgal_parameters.cluster_epsilon;
+	parameters.normal_threshold = cgal_parameters.normal_threshold;
 	
-	// save file
-	std::cerr << "Saving output...\n";
-	out	<< "ply " << std::endl
-			<< "format ascii 1.0" << std::endl
-			<< "element vertex " << output_point_cloud.size() << std::endl
-			<< "property float x" << std::endl
-			<< "property float y" << std::endl
-			<< "property float z" << std::endl
-			<< "property float nx" << std::endl
-			<< "property float ny" << std::endl
-			<< "property float nz" << std::endl
-			<< "property uchar red" << std::endl
-			<< "property uchar green" << std::endl
-			<< "property uchar blue" << std::endl
-			<< "end_header" << std::endl; 
+	Parallel_region_growing region_grow;
+	region_grow.set_input(points, normals);
+	Real_timer t;
+	std::cerr << "Seeking shapes (parallel engine)...\n";
+	t.start();
+	region_grow.detect(parameters);
+	t.stop();
+	std::cerr << region_grow.shapes().size() << " detected shapes, ";
+	std::cerr << region_grow.number_of_unassigned_points() << " unassigned point(s) ";
+	std::cerr << "after " << t.time() << " seconds (neighbor graph " << region_grow.graph_time()
+						<< ", growing " << region_grow.growing_time() << ", fitting " << region_grow.fitting_time() << ")\n";
+	
+	std::size_t cylinders = 0, planes = 0;
+	for (std::size_t s = 0; s < region_grow.shapes().size(); s++)
+	{
+		const Region_shape& shape = region_grow.shapes()[s];
+		Shape_kind	k;
+		Shape_id		id;
+		if (shape.kind == PLANE)
+		{
+			if (verbose)
+				out_det	<< "Plane " << planes << " with normal [" << shape.direction[0] << " " << shape.direction[1]
+								<< " " << shape.direction[2] << "]\n";
+			k = PLANE;
+			id = Shape_id(planes++);
+		}
+		else
+		{
+			if (verbose)
+				out_det << "Cylinder " << cylinders << " with axis [" << shape.point[0] << " " << shape.point[1] << " "
+								<< shape.point[2] << " " << shape.direction[0] << " " << shape.direction[1] << " "
+								<< shape.direction[2] << "] and radius " << shape.radius;
+			k = classify_cylinder(shape.direction[1], shape.radius);
+			if (k != CYLIND)
+			{
+				std::cerr << "Cylinder with " << ((k == WRNGAX)? "axis not aligned to Y" : "too high radius")
+									<< ": non classified\n";
+				if (verbose)
+					out_det << " not classified\n";
+			}
+			else if (verbose)
+				out_det << std::endl;
+			id = Shape_id(cylinders++);
+		}
+		for (std::size_t i = 0; i < shape.indices.size(); i++)
+		{
+			output_point_cloud.push_back(point_cloud[shape.indices[i]]);
+			kind_cloud.push_back(k);
+			id_cloud.push_back(id);
+		}
+	}
+	std::cerr << "Found " << cylinders << " cylinders and " << planes << " planes\n";
+	
+	const std::vector<std::size_t>& unassigned = region_grow.indices_of_unassigned_points();
+	for (std::size_t i = 0; i < unassigned.size(); i++)
+	{
+		output_point_cloud.push_back(point_cloud[unassigned[i]]);
+		kind_cloud.push_back(UNDEF);
+		id_cloud.push_back(-1);
+	}
+	return t.time();
+}
 
-	std::vector<Color>::iterator ci = color_cloud.begin();
-	for (Pwn_vector::iterator i = output_point_cloud.begin(); i != output_point_cloud.end(); ++i)
+
+int main(int argc, char** argv)
+{
+	if (argc < 3 || argc > 9)
+	{
+		std::cerr << "ERROR: wrong arguments." << std::endl;
+		std::cerr << "\tUsage: detect_shapes_rg [-v|--verbose] [--colors] [--engine cgal|parallel] [--benchmark] [--sort] "
+							<< "<input_file.ply> <output_file.ply>\n";
+		std::cerr << "\n\tDetect PLANES ONLY over a point cloud with normals, using Region Growing algorithm.\n";
+		std::cerr << "\tIf you specify verbose mode, information about those can be found into the log file\n";
+		std::cerr << "\tWith --colors, shape colors are written besides the labels (for visualization only)\n";
+		std::cerr << "\tThe parallel engine grows all the regions at once (default: cgal)\n";
+		std::cerr << "\tWith --benchmark both engines are run on the same input and timed; "
+							<< "the output is the one of the chosen engine\n";
+		std::cerr << "\tWith --sort the points are sorted along a Morton curve before the detection\n";
+		return EXIT_FAILURE;
+	}
+	
+	bool								verbose = false;
+	bool								with_colors = false;
+	bool								parallel_engine = false;
+	bool								benchmark = false;
+	bool								sort = false;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp(argv[a], "-v") == 0 || strcmp(argv[a], "--verbose") == 0)
+			verbose = true;
+		else if (strcmp(argv[a], "--colors") == 0)
+			with_colors = true;
+		else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc - 2)
+		{
+			a++;
+			if (strcmp(argv[a], "parallel") == 0)
+				parallel_engine = true;
+			else if (strcmp(argv[a], "cgal") != 0)
+			{
+				std::cerr << "ERROR: unknown engine " << argv[a] << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[a], "--benchmark") == 0)
+			benchmark = true;
+		else if (strcmp(argv[a], "--sort") == 0)
+			sort = true;
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::string								infile = argv[argc - 2];
+	std::ifstream 						in 	(infile);
+	std::string								outfile = argv[argc - 1];
+	std::ofstream 						out (outfile);
+	Pwn_vector 								point_cloud;
+	std::vector<Shape_kind>		kind_cloud;
+	std::vector<Shape_id>			id_cloud;
+	Pwn_vector								output_point_cloud;
+	
+	outfile = outfile.substr(0, outfile.find(".ply")).append("_log.txt");
+	if (verbose)
+		std::cerr << "Saving log in " << outfile << std::endl;
+	std::ofstream	out_det (outfile);
+	
+	if (!in || !CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud), 
+																											CGAL::make_ply_point_reader (Point_map()),
+																											CGAL::make_ply_normal_reader (Normal_map())
+																											))
+	{
+		std::cerr << "ERROR: cannot read file " << infile << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cerr << "Read successfully " << point_cloud.size() << " point(s) with properties...\n";
+	in.close();
+	if (sort)
+	{
+		// the output is grouped by shape anyway: the order of the input is not kept
+		Real_timer t;
+		t.start();
+		apply_order(point_cloud, morton_order(point_cloud.size(), [&point_cloud](std::size_t i)
+		{
+			const Point& p = point_cloud[i].first;
+			return make_vec3(p.x(), p.y(), p.z());
+		}));
+		t.stop();
+		std::cerr << "Points sorted along a Morton curve in " << t.time() << " s\n";
+	}
+		
+	std::cerr << "Setting parameters for shape detection...\n";
+	//------------------------------------------------------------------------------------------
+	// set parameters for shape detection: we make this step interactive, because parameters 
+	// should be adjusted according to the point cloud characteristics
+	//------------------------------------------------------------------------------------------
+	Region_growing::Parameters parameters = set_parameters(point_cloud.size());	
+	if (verbose)
 	{
-		Point& p = get<0>(*i);
-		Vector& n = get<1>(*i);
-		out << p << " " << n << " ";
-		out << int((*ci)[0]) << " " << int((*ci)[1]) << " " << int((*ci)[2]) << std::endl;
-		ci++;
+		out_det << "min points "			<< parameters.min_points << std::endl
+						<< "epsilon "					<< parameters.epsilon << std::endl
+						<< "cluster epsilon " << parameters.cluster_epsilon << std::endl
+						<< "normal deviation "<< parameters.normal_threshold << std::endl;
 	}
+	
+	if (benchmark)
+	{
+		// the engine not chosen for the output writes into throwaway vectors
+		Pwn_vector								other_cloud;
+		std::vector<Shape_kind>		other_kinds;
+		std::vector<Shape_id>			other_ids;
+		double t_cgal = detect_cgal(point_cloud, parameters, verbose, out_det,
+																parallel_engine? other_cloud : output_point_cloud,
+																parallel_engine? other_kinds : kind_cloud,
+																parallel_engine? other_ids : id_cloud);
+		double t_parallel = detect_parallel(point_cloud, parameters, verbose, out_det,
+																				parallel_engine? output_point_cloud : other_cloud,
+																				parallel_engine? kind_cloud : other_kinds,
+																				parallel_engine? id_cloud : other_ids);
+		std::cerr << "Benchmark on " << point_cloud.size() << " point(s): CGAL " << t_cgal << " s, parallel "
+							<< t_parallel << " s (speedup " << t_cgal / t_parallel << "x)\n";
+		if (verbose)
+			out_det << "benchmark cgal " << t_cgal << " parallel " << t_parallel << std::endl;
+	}
+	else if (parallel_engine)
+		detect_parallel(point_cloud, parameters, verbose, out_det, output_point_cloud, kind_cloud, id_cloud);
+	else
+		detect_cgal(point_cloud, parameters, verbose, out_det, output_point_cloud, kind_cloud, id_cloud);
+	out_det.close();
+	
+	// save file
+	std::cerr << "Saving output...\n";
+	write_labeled_ply(out, output_point_cloud, kind_cloud, id_cloud, keep_all(), with_colors);
 	out.close();
 	
 	return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,175 @@
+/*
+ * VOXEL GRID DOWNSAMPLING
+ * Reduce the density of a cloud: every non empty voxel of the grid becomes a single point, with
+ * the mean position and normal of its points and their most frequent color and label.
+ * rtabmap exports are full of near duplicates from overlapping scans, and all the neighbor
+ * based steps after this one pay for each of them.
+ * note: only the properties found in the input header are written in the output
+ */
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/property_map.h>
+#include <CGAL/IO/read_ply_points.h>
+#include <CGAL/Real_timer.h>
+
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include <fstream>
+
+#include "../utils/labels.hpp"
+#include "../utils/ply_header.hpp"
+#include "../funcs/voxel_grid.hpp"
+
+// types
+typedef CGAL::Exact_predicates_inexact_constructions_kernel EPIC_kernel;
+typedef EPIC_kernel::Point_3 Point;
+typedef EPIC_kernel::Vector_3 Vector;
+typedef CGAL::cpp11::array<unsigned char, 3> Color; // a color is a vector of 3 unsigned chars (values 0, 255)
+
+// define a type for a point with normal, color and label (P-N-C-L)
+typedef CGAL::cpp11::tuple<Point,Vector,Color,Shape_kind,Shape_id>	PNCL;
+typedef CGAL::Nth_of_tuple_property_map<0, PNCL>	Point_map;
+typedef CGAL::Nth_of_tuple_property_map<1, PNCL>	Normal_map;
+typedef CGAL::Nth_of_tuple_property_map<2, PNCL>	Color_map;
+typedef CGAL::Nth_of_tuple_property_map<3, PNCL>	Kind_map;
+typedef CGAL::Nth_of_tuple_property_map<4, PNCL>	Id_map;
+
+typedef std::pair<Shape_kind, Shape_id>						Label;	// voted together: a point keeps a consistent label
+
+bool has_property (const std::string& file, const std::string& name)
+{
+	std::ifstream in (file);
+	return ply_has_property(in, name);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 5 || argc > 6)
+	{
+		if (argc > 1 && strcmp(argv[1], "--help") == 0)
+		{
+			std::cerr << "\tdownsample [-v] (--leaf <size> | --points <count>) <input_file.ply> <output_file.ply>\n";
+			std::cerr << "\nReplace the points of each voxel of a regular grid with their average (positions, normals) "
+								<< "and their most frequent color and label.\n"
+								<< "Use --leaf to give the side of the voxels, --points to have the leaf chosen so that "
+								<< "at most that many points are left\n"
+								<< "Use -v to print the leaf size and the timings\n";
+		}
+		else
+			std::cerr << "ERROR: wrong arguments.\n\tUsage: $ downsample [-v] (--leaf <size> | --points <count>) "
+								<< "<input_file.ply> <output_file.ply>\n";
+		return EXIT_FAILURE;
+	}
+
+	bool				verbose = false;
+	double			leaf = 0.0;
+	std::size_t	target = 0;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp(argv[a], "-v") == 0 || strcmp(argv[a], "--verbose") == 0)
+			verbose = true;
+		else if (strcmp(argv[a], "--leaf") == 0 && a + 1 < argc - 2 && atof(argv[a + 1]) > 0.0)
+			leaf = atof(argv[++a]);
+		else if (strcmp(argv[a], "--points") == 0 && a + 1 < argc - 2 && atol(argv[a + 1]) > 0)
+			target = std::size_t(atol(argv[++a]));
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if ((leaf > 0.0) == (target > 0))
+	{
+		std::cerr << "ERROR: give either --leaf or --points\n";
+		return EXIT_FAILURE;
+	}
+	std::string input_file = argv[argc - 2];
+	std::string output_file = argv[argc - 1];
+
+	const bool with_normals = has_property(input_file, "nx");
+	const bool with_colors = has_property(input_file, "red");
+	const bool with_labels = has_property(input_file, "label");
+	std::vector<PNCL> point_cloud_with_properties;
+	std::ifstream in (input_file);
+	if (!in || !(CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud_with_properties),
+																											CGAL::make_ply_point_reader (Point_map()),
+																											CGAL::make_ply_normal_reader (Normal_map()),
+																											std::make_tuple (	Color_map(),
+																																				CGAL::Construct_array(),
+																																				CGAL::PLY_property<unsigned char>("red"),
+																																				CGAL::PLY_property<unsigned char>("green"),
+																																				CGAL::PLY_property<unsigned char>("blue")),
+																											std::make_pair (Kind_map(), CGAL::PLY_property<unsigned char>("label")),
+																											std::make_pair (Id_map(), CGAL::PLY_property<int>("shape_id"))
+																											)))
+	{
+		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
+		return EXIT_FAILURE;
+	}
+	in.close();
+	std::cerr << "Read successfully " << point_cloud_with_properties.size() << " point(s)" << std::endl;
+
+	// split the columns: the grid works on each of them separately
+	CGAL::Real_timer t;
+	t.start();
+	const std::size_t n = point_cloud_with_properties.size();
+	std::vector<Vec3>		points (n), normals (with_normals? n : 0);
+	std::vector<Color>	colors (with_colors? n : 0);
+	std::vector<Label>	labels (with_labels? n : 0);
+	parallel_for_each_index(n, [&](std::size_t i)
+	{
+		const PNCL& p = point_cloud_with_properties[i];
+		points[i] = make_vec3(get<0>(p).x(), get<0>(p).y(), get<0>(p).z());
+		if (with_normals)
+			normals[i] = make_vec3(get<1>(p).x(), get<1>(p).y(), get<1>(p).z());
+		if (with_colors)
+			colors[i] = get<2>(p);
+		if (with_labels)
+			labels[i] = Label(get<3>(p), get<4>(p));
+	});
+
+	if (target > 0)
+	{
+		leaf = Voxel_grid::leaf_size_for_budget(points, target);
+		if (leaf == 0.0)
+			std::cerr << "The cloud has already at most " << target << " point(s)\n";
+	}
+	std::vector<Vec3>		out_points (points), out_normals (normals);
+	std::vector<Color>	out_colors (colors);
+	std::vector<Label>	out_labels (labels);
+	if (leaf > 0.0)
+	{
+		Voxel_grid grid (points, leaf);
+		grid.average_points(points, out_points);
+		if (with_normals)
+			grid.average_normals(normals, out_normals);
+		if (with_colors)
+			grid.majority(colors, out_colors);
+		if (with_labels)
+			grid.majority(labels, out_labels);
+	}
+	t.stop();
+	std::cerr << "Downsampled to " << out_points.size() << " point(s) ("
+						<< 100.0 * double(out_points.size()) / double(std::max<std::size_t>(n, 1)) << "%)\n";
+	if (verbose)
+		std::cerr << "Leaf size " << leaf << ", " << t.time() << " second(s)\n";
+
+	// saving
+	std::ofstream out (output_file);
+	std::cerr << "Saving output...\n";
+	write_ply_header(out, out_points.size(), with_normals, with_colors, with_labels);
+	for (std::size_t v = 0; v < out_points.size(); v++)
+	{
+		out << out_points[v][0] << " " << out_points[v][1] << " " << out_points[v][2];
+		if (with_normals)
+			out << " " << out_normals[v][0] << " " << out_normals[v][1] << " " << out_normals[v][2];
+		if (with_colors)
+			out << " " << int(out_colors[v][0]) << " " << int(out_colors[v][1]) << " " << int(out_colors[v][2]);
+		if (with_labels)
+			out << " " << int(out_labels[v].first) << " " << out_labels[v].second;
+		out << std::endl;
+	}
+	out.close();
+
+	return EXIT_SUCCESS;
+}
@@ -4,34 +4,48 @@
  * orientation on each point. At the end, we save the file into another ply, useful for 
  * point structuring. 
  * IMPORTANT NOTE: this work can be done also by matlab
+ * With --sort the points are sorted along a Morton curve after reading (utils/spatial_sort.hpp):
+ * estimation and orientation find the neighbors of a point close in memory, and the points are
+ * written back in the order of the input.
+ * With --approx <epsilon> (and --max-checks <n>) the normals are estimated on approximate k nearest
+ * neighbors found on a grid (funcs/pca_normals.hpp); the orientation stays the CGAL one.
  */
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/property_map.h>
-#include <CGAL/IO/read_ply_points.h>
 #include <CGAL/pca_estimate_normals.h>
 #include <CGAL/jet_estimate_normals.h>
 #include <CGAL/mst_orient_normals.h>
+#include <CGAL/Real_timer.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <utility>
 #include <vector>
 #include <fstream>
-#include <list>
+
+#include "../funcs/pca_normals.hpp"
+#include "../utils/attributes.hpp"
+#include "../utils/kernel.hpp"
+#include "../utils/ply_cloud.hpp"
+#include "../utils/point_cloud.hpp"
+#include "../utils/shm_cloud.hpp"
+#include "../utils/spatial_sort.hpp"
 
 // types
-typedef CGAL::Exact_predicates_inexact_constructions_kernel EPIC_kernel; // EPIC_kernel we use
-typedef EPIC_kernel::FT FT;																							// a model of FieldNumberType
-typedef EPIC_kernel::Point_3 Point; 											
-typedef EPIC_kernel::Vector_3 Vector;
+typedef Pipeline_kernel Kernel; // Kernel we use (see utils/kernel.hpp)
+typedef Kernel::FT FT;																							// a model of FieldNumberType
+typedef Kernel::Point_3 Point; 											
+typedef Kernel::Vector_3 Vector;
 typedef CGAL::cpp11::array<unsigned char, 3> Color; // a color is a vector of 3 unsigned chars (values 0, 255)		
 
-// define a type for a point with normal, color and intensity (P-N-C-I)
-typedef CGAL::cpp11::tuple<Point,Vector,Color,int> 	PNCI;				// this is the tuple of properties we want to extract
-typedef CGAL::Nth_of_tuple_property_map<0, PNCI>		Point_map;	// group of tuples to focus on point_cloud_with_properties??
-typedef CGAL::Nth_of_tuple_property_map<1, PNCI>		Normal_map;
-typedef CGAL::Nth_of_tuple_property_map<2, PNCI>		Color_map;
-typedef CGAL::Nth_of_tuple_property_map<3, PNCI>		Intensity_map;
-// pair <point, normal> both vectors
-typedef std::pair<Point, Vector> 										Point_with_normal;
+// the normals of the input are estimated again and its intensity is not needed: only positions and
+// colors are read, and the normals are added to them
+typedef Attrs<XYZ, RGB>															Input_attributes;
+typedef Attrs<XYZ, Normal, RGB>											Output_attributes;
+// the CGAL algorithms run on the indices of the points and write the normals into the columns
+typedef Point_cloud_point_map<Point>								Cloud_point_map;
+typedef Point_cloud_normal_map<Vector>							Cloud_normal_map;
+typedef CGAL::Real_timer														Real_timer;
 
 // concurrency
 #ifdef CGAL_LINKED_WITH_TBB
@@ -44,69 +58,115 @@ typedef CGAL::Sequential_tag	Concurrency_tag;
 
 int main(int argc, char** argv)
 {
-	if (argc != 3)
+	if (argc < 3 || argc > 8)
 	{
-		std::cerr << "ERROR: no arguments.\n\tUsage: $ compute_onormals <input_file.ply> <output_file.ply>\n";
+		std::cerr << "ERROR: no arguments.\n\tUsage: $ compute_onormals [--sort] [--approx <epsilon>] [--max-checks <n>] "
+							<< "<input_file.ply> <output_file.ply>\n";
+		std::cerr << "\tinput and output can also be shared memory segments: shm://<name>\n";
+		std::cerr << "\twith --sort the neighbor queries run on the points sorted along a Morton curve\n";
+		std::cerr << "\twith --approx the normals are estimated on neighbors within 1 + epsilon of the exact ones, "
+							<< "--max-checks bounds the distances computed by each query\n";
 		return EXIT_FAILURE;
 	}
 	
-	std::string input_file = argv[1];
-	std::string output_file = argv[2];
-	std::ifstream in (input_file);	
+	bool						sort = false;
+	Knn_parameters	knn;
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp(argv[a], "--sort") == 0)
+			sort = true;
+		else if (strcmp(argv[a], "--approx") == 0 && a + 1 < argc - 2 && atof(argv[a + 1]) >= 0.0)
+			knn.epsilon = atof(argv[++a]);
+		else if (strcmp(argv[a], "--max-checks") == 0 && a + 1 < argc - 2 && atoi(argv[a + 1]) > 0)
+			knn.max_checks = std::size_t(atoi(argv[++a]));
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::string input_file = argv[argc - 2];
+	std::string output_file = argv[argc - 1];
+	Cloud_uri input = parse_cloud_uri(input_file), output = parse_cloud_uri(output_file);
+	std::ifstream in;
 	
-	std::vector<PNCI> point_cloud_with_properties; 	
-	if (!in || !(CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud_with_properties), 
-																											CGAL::make_ply_point_reader (Point_map()),
-																											std::make_pair (Intensity_map(), CGAL::PLY_property<int>("intensity")),
-																											std::make_tuple (	Color_map(),
-																																				CGAL::Construct_array(),
-																																				CGAL::PLY_property<unsigned char>("red"),
-																																				CGAL::PLY_property<unsigned char>("green"),
-																																				CGAL::PLY_property<unsigned char>("blue")),
-																											CGAL::make_ply_normal_reader (Normal_map())
-																											)))
+	Point_cloud point_cloud;
+	bool read;
+	if (input.shared)
+		read = attach_cloud_attributes<Input_attributes>(input, point_cloud);
+	else
+	{
+		in.open(input.path);
+		read = in && read_ply_cloud<Input_attributes>(in, point_cloud);
+	}
+	if (!read)
 	{
 		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
 		return EXIT_FAILURE;
 	}
 	
 	std::cerr << "File read successfully!\n";
-	// divide the information
-	std::list<Point_with_normal> 	point_cloud;
-	std::vector<Color> 						color_cloud;
-	for (std::size_t i=0; i<point_cloud_with_properties.size(); i++)
+	// original[i]: index in the input of the i-th point, while they are sorted
+	std::vector<std::size_t> original;
+	if (sort)
 	{
-		Point_with_normal e = Point_with_normal(get<0>(point_cloud_with_properties[i]), Vector(0,0,0));
-		point_cloud.push_back(e);
+		Real_timer t;
+		t.start();
+		original = spatial_sort(point_cloud);
+		t.stop();
+		std::cerr << "Points sorted along a Morton curve in " << t.time() << " s\n";
 	}
+	// missing colors are written as zeros
+	set_columns<Output_attributes>(point_cloud);
+	std::vector<std::size_t> indices = point_indices(point_cloud);
 	
 	std::cerr << "Estimating normal direction...\n";
 	// Estimate normal direction. Note that pca_estimate_normals() (and jet, as well) requires 
 	// a range of points as well as property maps to access each point's position and normal
 	const int nb_neighbors = 18; // k-nearest neighbors -> 3 rings of 6
-	// we can't use jet just because it wants a different type of map for the normal map
-	CGAL::pca_estimate_normals<Concurrency_tag> (	point_cloud, nb_neighbors,
-																								CGAL::parameters::point_map(CGAL::First_of_pair_property_map<Point_with_normal>()).
-																								normal_map(CGAL::Second_of_pair_property_map<Point_with_normal>()));
+	Real_timer t;
+	t.start();
+	if (knn.exact())
+		CGAL::pca_estimate_normals<Concurrency_tag> (	indices, nb_neighbors,
+																									CGAL::parameters::point_map(Cloud_point_map(&point_cloud)).
+																									normal_map(Cloud_normal_map(&point_cloud)));
+	else
+	{
+		std::vector<Vec3> positions (point_cloud.size());
+		for (std::size_t i = 0; i < point_cloud.size(); i++)
+			positions[i] = make_vec3(point_cloud.x[i], point_cloud.y[i], point_cloud.z[i]);
+		std::size_t checks;
+		std::vector<Vec3> normals = pca_normals(positions, nb_neighbors, knn, checks);
+		for (std::size_t i = 0; i < point_cloud.size(); i++)
+			point_cloud.set_normal(i, normals[i]);
+		std::cerr << "Approximate neighbors: " << double(checks) / double(std::max<std::size_t>(1, positions.size()))
+							<< " distance(s) computed per point\n";
+	}
+	t.stop();
+	std::cerr << "Normals estimated in " << t.time() << " s\n";
 																								
 	std::cerr << "Orienting the normals...\n";
 	// Orient norals (same note as above)
-	// NOTE: the order of the points is modified, so that the points with non-classified 
-	// orientation lay in the final part of the array of points.
-	std::list<Point_with_normal>::iterator unoriented_points_begin;
-	unoriented_points_begin = CGAL::mst_orient_normals(	point_cloud, nb_neighbors,
-																											CGAL::parameters::point_map(CGAL::First_of_pair_property_map<Point_with_normal>()).
-																											normal_map(CGAL::Second_of_pair_property_map<Point_with_normal>()));
+	// NOTE: the order of the indices is modified, so that the points with non-classified 
+	// orientation lay in the final part of the array; the columns are not moved
+	std::vector<std::size_t>::iterator unoriented_points_begin;
+	t.reset();
+	t.start();
+	unoriented_points_begin = CGAL::mst_orient_normals(	indices, nb_neighbors,
+																											CGAL::parameters::point_map(Cloud_point_map(&point_cloud)).
+																											normal_map(Cloud_normal_map(&point_cloud)));
+	t.stop();
+	std::cerr << "Normals oriented in " << t.time() << " s\n";
 	
 	// optional: delete points with unoriented normals (useful is reconstruction is needed)
 	// if the points to remove end up in being too much ( > 40 %) don't do anything
-	std::size_t to_erase = std::distance(unoriented_points_begin, point_cloud.end());
-	std::size_t psize = point_cloud.size();
+	std::size_t to_erase = std::distance(unoriented_points_begin, indices.end());
+	std::size_t psize = indices.size();
 	std::cerr << "Point cloud has " << psize << " pairs point-normal" << std::endl;
 	if (double(to_erase) / double(psize) < 0.4)
 	{
 		std::cerr << "Erasing " << to_erase << " points...\n";
-		point_cloud.erase(unoriented_points_begin, point_cloud.end());		
+		indices.erase(unoriented_points_begin, indices.end());		
 	}
 	else
 	{
@@ -114,48 +174,29 @@ int main(int argc, char** argv)
 		std::cerr << "no action performed." << std::endl;
 	}
 	
-	// point cloud is reorganized: we need to assign colors 
+	// the points follow the order of the orientation, their colors with them (with --sort,
+	// the order of the input)
 	std::cerr << "Reorganizing cloud..." << std::endl;
-	for (std::list<Point_with_normal>::iterator i = point_cloud.begin(); i != point_cloud.end(); i++)
+	point_cloud.select(indices);
+	if (sort)
 	{
-		for (std::vector<PNCI>::iterator j = point_cloud_with_properties.begin(); j != point_cloud_with_properties.end(); j++)
-		{
-			if (get<0>(*i) == get<0>(*j))
-			{
-				color_cloud.push_back(get<2>(*j));
-				break; // skip immediately to next piece
-			}
-		}
+		apply_order(original, indices);
+		restore_order(point_cloud, original);
 	}
 				
 	// save onto another file
 	std::cerr << "Saving file...\n";
-	std::ofstream out (output_file);
-	out << "ply " << std::endl
-		<< "format ascii 1.0" << std::endl
-		<< "element vertex " << point_cloud.size() << std::endl
-		<< "property float x" << std::endl
-		<< "property float y" << std::endl
-		<< "property float z" << std::endl
-		<< "property float nx" << std::endl
-		<< "property float ny" << std::endl
-		<< "property float nz" << std::endl
-		<< "property uchar red" << std::endl
-		<< "property uchar green" << std::endl
-		<< "property uchar blue" << std::endl
-		<< "end_header" << std::endl; 
-
-	std::vector<Color>::iterator ci = color_cloud.begin(); // scroll for color vector
-	for (std::list<Point_with_normal>::iterator i = point_cloud.begin(); i != point_cloud.end(); ++i)
+	if (output.shared)
 	{
-		Point& p = get<0>(*i);
-		Vector& n = get<1>(*i);
-		out << p << " " << n << " ";
-		Color& c = (*ci); ci++;
-		out << int(c[0]) << " " << int(c[1]) << " " << int(c[2]) << std::endl;
+		if (!publish_cloud(output.path, point_cloud))
+		{
+			std::cerr << "ERROR: cannot write shared memory segment " << output.path << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
 	}
+	std::ofstream out (output.path);
+	write_ply_cloud<Output_attributes>(out, point_cloud);
 	
 	return EXIT_SUCCESS;	
 }
- 
-
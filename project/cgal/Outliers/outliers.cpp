@@ -1,167 +1,220 @@
 /*
  * REMOVE OUTLIERS FROM A CLOUD
  * note: no problems with a file with no normals: they'll be written down using [0 0 0]
+ * With --passes n the removal is repeated n times on a single neighbor structure
+ * (funcs/incremental_outliers.hpp), as pipeline.m does with its inner iterations.
+ * The cloud is kept in columns (utils/point_cloud.hpp): the removal works on the indices of the
+ * points and the kept ones are compacted in their order at the end. Only the positions, normals
+ * and (without --no-colors) colors are read and written (utils/attributes.hpp).
+ * With --sort the points are sorted along a Morton curve after reading, so that the neighbor
+ * queries find their points close in memory (utils/spatial_sort.hpp); the points left are
+ * written in the order of the input anyway.
+ * With --approx <epsilon> (and --max-checks <n>) the neighbors come from a grid search that may stop
+ * early (utils/knn_grid.hpp): the removal then runs on the structure of --passes, one pass by default.
  */
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/property_map.h>
-#include <CGAL/IO/read_ply_points.h>
 #include <CGAL/compute_average_spacing.h>
 #include <CGAL/remove_outliers.h>
+#include <CGAL/Real_timer.h>
 
+#include <cstdlib>
+#include <cstring>
 #include <utility>
 #include <vector>
 #include <fstream>
 
+#include "../funcs/incremental_outliers.hpp"
+#include "../utils/attributes.hpp"
+#include "../utils/kernel.hpp"
+#include "../utils/ply_cloud.hpp"
+#include "../utils/point_cloud.hpp"
+#include "../utils/shm_cloud.hpp"
+#include "../utils/spatial_sort.hpp"
+
 // types
-typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel; // Kernel we use
+typedef Pipeline_kernel Kernel; // Kernel we use (see utils/kernel.hpp)
 typedef Kernel::FT FT;																							// a model of FieldNumberType
 typedef Kernel::Point_3 Point; 											
 typedef Kernel::Vector_3 Vector;
 typedef CGAL::cpp11::array<unsigned char, 3> Color; // a color is a vector of 3 unsigned chars (values 0, 255)		
 
-// define a type for a point with normal, color and (P-N-C)
-typedef CGAL::cpp11::tuple<Point,Vector,Color> 		PNC;					// this is the tuple of properties we want to extract
-typedef CGAL::Nth_of_tuple_property_map<0, PNC>		Point_map;		// group of tuples to focus on points??
-typedef CGAL::Nth_of_tuple_property_map<1, PNC>		Normal_map;
-typedef CGAL::Nth_of_tuple_property_map<2, PNC>		Color_map;
+// the CGAL algorithms run on the indices of the points, reading the positions from the columns
+typedef Point_cloud_point_map<Point>							Cloud_point_map;
+typedef CGAL::Real_timer														Real_timer;
 
-int main(int argc, char** argv)
+// Read, purge and write the cloud with the columns of the attribute set
+template <typename Attributes>
+int remove_cloud_outliers (	const std::string& input_file, const std::string& output_file, int passes, const Knn_parameters& knn,
+														bool sort, bool verbose)
 {
-	if (argc < 3 || argc > 4)
-	{
-		std::cerr << " ERROR: wrong arguments.\n\tUsage: $ outliers [-v] <input_file.ply> <output_file.ply>\n";
-		return EXIT_FAILURE;
-	}
-	
-	std::string					input_file, output_file;
-	bool								verbose;
-	if (argc == 3)
-	{
-		input_file = argv[1];
-		output_file = argv[2];
-		verbose = false;
-	}
+	Point_cloud point_cloud;
+	Cloud_uri input = parse_cloud_uri(input_file), output = parse_cloud_uri(output_file);
+	std::ifstream in;
+	bool read;
+	if (input.shared)
+		read = attach_cloud_attributes<Attributes>(input, point_cloud);
 	else
 	{
-		input_file = argv[2];
-		output_file = argv[3];
-		verbose = true;
+		in.open(input.path);
+		read = in && read_ply_cloud<Attributes>(in, point_cloud);
 	}
-	std::vector<PNC> 	point_cloud_with_properties;
-	std::vector<Point>	point_cloud; 		
-	std::vector<Color>	color_cloud;
-	std::ifstream in (input_file);	
-	if (!in || !(CGAL::read_ply_points_with_properties(	in, std::back_inserter(point_cloud_with_properties), 
-																											CGAL::make_ply_point_reader (Point_map()),
-																											std::make_tuple (	Color_map(),
-																																				CGAL::Construct_array(),
-																																				CGAL::PLY_property<unsigned char>("red"),
-																																				CGAL::PLY_property<unsigned char>("green"),
-																																				CGAL::PLY_property<unsigned char>("blue")),
-																											CGAL::make_ply_normal_reader (Normal_map())
-																											)))
+	if (!read)
 	{
 		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
 		return EXIT_FAILURE;
 	}
-
-	//-----------------------------------------------------------------------------------------------------------------------------------
-	std::vector<Point> 	point_cloud_to_purge;
-	std::vector<Vector> normal_cloud;
-	for (std::size_t i=0; i<point_cloud_with_properties.size(); i++)
+	// original[i]: index in the input of the i-th point, while they are sorted
+	std::vector<std::size_t> original;
+	if (sort)
 	{
-			point_cloud.push_back(get<0>(point_cloud_with_properties[i]));
-			point_cloud_to_purge.push_back(get<0>(point_cloud_with_properties[i]));
-			normal_cloud.push_back(get<1>(point_cloud_with_properties[i]));
-			color_cloud.push_back(get<2>(point_cloud_with_properties[i]));
+		Real_timer t;
+		t.start();
+		original = spatial_sort(point_cloud);
+		t.stop();
+		std::cerr << "Points sorted along a Morton curve in " << t.time() << " s\n";
 	}
 
+	//-----------------------------------------------------------------------------------------------------------------------------------
 	// now we have the point cloud: clean it and save somewhere to check
-	// remove outliers using erase-remove idiom (again Identity_property_map is optional)
 	const int nb_neighbors = 24; // consider 24 nearest neighbor points
+	std::vector<unsigned char> kept (point_cloud.size(), 1);
 
-	// Estimate scale of the point set with average spacing
-	const double average_spacing = CGAL::compute_average_spacing<CGAL::Sequential_tag>(point_cloud, nb_neighbors);
-
-	std::cerr << "Point cloud size is: " << (double)(point_cloud_to_purge.size()) << std::endl;
-
-	// FIRST OPTION
-	// We don't know the ratio of outliers present in the point set
-	std::vector<Point>::iterator first_to_remove;
-	first_to_remove = CGAL::remove_outliers(	point_cloud_to_purge, nb_neighbors,
-																						CGAL::parameters::threshold_percent (100.). // no limit on the number of outliers to remove
-																						threshold_distance(1.5*average_spacing)); 	// points with distance above thresh are outliers
-	std::cerr << "Points to cut off: " << std::distance(first_to_remove, point_cloud_to_purge.end());
-	std::cerr << std::endl;
-	std::cerr	<< (100. * std::distance( first_to_remove, point_cloud_to_purge.end()) / (double)(point_cloud_to_purge.size())) 
-						<< "% of the points are considered outliers when using a distance threshold of "
-						<< 1.5 * average_spacing << std::endl;
-						
-	// now use the iterator to find out the other points
-	std::cerr << "Erasing points...\n";
-	std::vector<Point>::const_iterator 	pi = point_cloud.begin();
-	std::vector<Color>::const_iterator 	ci = color_cloud.begin();
-	std::vector<Vector>::const_iterator ni = normal_cloud.begin();
-	while (pi != point_cloud.end())
+	if (passes > 0)
 	{
-		// if the point is an outlier, remove it
-		if (*first_to_remove == *pi)
+		// the neighborhoods are computed once, each pass only updates the ones next to removed points
+		std::vector<Vec3> positions (point_cloud.size());
+		for (std::size_t i = 0; i < point_cloud.size(); i++)
+			positions[i] = make_vec3(point_cloud.x[i], point_cloud.y[i], point_cloud.z[i]);
+		Incremental_outliers outliers (positions, nb_neighbors, 1.5, knn);
+		std::cerr << "Point cloud size is: " << point_cloud.size() << std::endl;
+		std::cerr << "Neighborhoods computed in " << outliers.setup_seconds() << " s\n";
+		for (int p = 1; p <= passes; p++)
 		{
-			// (*ci) : gets the pointed, an array<uchar, 3>
-			// .at() : gets element at given position
-			if (verbose) 
+			Outlier_pass pass = outliers.pass();
+			std::cerr << "Pass " << p << ": " << pass.removed << " point(s) removed with a distance threshold of "
+								<< 1.5 * pass.average_spacing << ", " << pass.left << " left, " << pass.updated
+								<< " neighborhood(s) updated (" << pass.seconds << " s)\n";
+		}
+		for (std::size_t i = 0; i < point_cloud.size(); i++)
+			kept[i] = outliers.is_kept(i);
+	}
+	else
+	{
+		// Estimate scale of the point set with average spacing
+		Real_timer t;
+		t.start();
+		std::vector<std::size_t> indices = point_indices(point_cloud);
+		const double average_spacing = CGAL::compute_average_spacing<CGAL::Sequential_tag>(	indices, nb_neighbors,
+																																												CGAL::parameters::point_map(Cloud_point_map(&point_cloud)));
+
+		std::cerr << "Point cloud size is: " << (double)(point_cloud.size()) << std::endl;
+
+		// FIRST OPTION
+		// We don't know the ratio of outliers present in the point set: the indices of the outliers
+		// end up after first_to_remove, the columns are not moved
+		std::vector<std::size_t>::iterator first_to_remove;
+		first_to_remove = CGAL::remove_outliers(	indices, nb_neighbors,
+																							CGAL::parameters::point_map(Cloud_point_map(&point_cloud)).
+																							threshold_percent (100.). // no limit on the number of outliers to remove
+																							threshold_distance(1.5*average_spacing)); 	// points with distance above thresh are outliers
+		t.stop();
+		std::cerr << "Points to cut off: " << std::distance(first_to_remove, indices.end()) << " (" << t.time() << " s)";
+		std::cerr << std::endl;
+		std::cerr	<< (100. * std::distance( first_to_remove, indices.end()) / (double)(indices.size())) 
+							<< "% of the points are considered outliers when using a distance threshold of "
+							<< 1.5 * average_spacing << std::endl;
+		std::cerr << "Erasing points...\n";
+		for (std::vector<std::size_t>::iterator i = first_to_remove; i != indices.end(); ++i)
+			kept[*i] = 0;
+	}
+	if (verbose)
+		for (std::size_t i = 0; i < point_cloud.size(); i++)
+			if (!kept[i])
 			{
-				std::cerr << "Erased point " << *pi << " and color ";
-				std::cerr << int((*ci).at(0)) << " " << int((*ci).at(1)) << " " << int((*ci).at(2)) << std::endl;
+				std::cerr << "Erased point " << point_cloud.x[i] << " " << point_cloud.y[i] << " " << point_cloud.z[i];
+				if (Attributes::colors)
+					std::cerr << " and color " << int(point_cloud.red[i]) << " " << int(point_cloud.green[i]) << " " << int(point_cloud.blue[i]);
+				std::cerr << std::endl;
 			}
-			point_cloud.erase(pi);
-			color_cloud.erase(ci);
-			normal_cloud.erase(ni);
-			// when erased, we get the iterator to the next position, so there is no need
-			// to advance. We should instead advance with first_to_remove, and restart from
-			// the beginning with the others (high complexity, that's true...)
-			first_to_remove++;
-			pi = point_cloud.begin();
-			ci = color_cloud.begin();
-			ni = normal_cloud.begin();
-		}
-		else
-		{
-			pi++;
-			ci++;
-			ni++;
-		}
+	// the kept points stay in their order
+	keep_points_if<Attributes>(point_cloud, [&](std::size_t i) { return kept[i] != 0; });
+	if (sort)
+	{
+		// the permutation follows the removal, then the points go back to the order of the input
+		std::size_t left = 0;
+		for (std::size_t i = 0; i < original.size(); i++)
+			if (kept[i])
+				original[left++] = original[i];
+		original.resize(left);
+		restore_order(point_cloud, original);
 	}
-	
-	// optional: after erase() use the Scott-Meyer's "swap trick" to trim excess capacity
-	std::vector<Point>(point_cloud).swap(point_cloud);
 	std::cerr << "Point cloud size is now: " << (double)(point_cloud.size()) << std::endl;
 	//-----------------------------------------------------------------------------------------------------------------------------------
 
-	// save the output in another colored PLY format
-	std::ofstream out (output_file);
-	out	<< "ply " << std::endl
-			<< "format ascii 1.0" << std::endl
-			<< "element vertex " << point_cloud.size() << std::endl
-			<< "property float x" << std::endl
-			<< "property float y" << std::endl
-			<< "property float z" << std::endl;
-	out << "property float nx" << std::endl
-			<< "property float ny" << std::endl
-			<< "property float nz" << std::endl;
-	out	<< "property uchar red" << std::endl
-			<< "property uchar green" << std::endl
-			<< "property uchar blue" << std::endl
-			<< "end_header" << std::endl; 
-
-	for (std::size_t i=0; i<point_cloud.size(); ++i)
+	if (output.shared)
 	{
-		out << point_cloud[i] << " ";
-		out << normal_cloud[i] << " ";
-		Color& c = color_cloud[i];
-		out << int(c[0]) << " " << int(c[1]) << " " << int(c[2]) << std::endl;
+		if (!publish_cloud(output.path, point_cloud))
+		{
+			std::cerr << "ERROR: cannot write shared memory segment " << output.path << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
 	}
-	
+
+	// save the output in another PLY file, colored unless --no-colors
+	std::ofstream out (output.path);
+	write_ply_cloud<Attributes>(out, point_cloud);
 	return EXIT_SUCCESS;	
 }
 
+int main(int argc, char** argv)
+{
+	if (argc < 3 || argc > 12)
+	{
+		std::cerr << " ERROR: wrong arguments.\n\tUsage: $ outliers [-v] [--passes <n>] [--no-colors] [--sort] [--approx <epsilon>] [--max-checks <n>] "
+							<< "<input_file.ply> <output_file.ply>\n"
+							<< "\tinput and output can also be shared memory segments: shm://<name>\n"
+							<< "\twith --no-colors the colors are neither read nor written (points and normals only)\n"
+							<< "\twith --sort the neighbor queries run on the points sorted along a Morton curve (same output)\n"
+							<< "\twith --approx the neighbors are within 1 + epsilon of the exact ones, "
+							<< "--max-checks bounds the distances computed by each query\n";
+		return EXIT_FAILURE;
+	}
+	
+	std::string					input_file, output_file;
+	bool								verbose = false;
+	bool								colors = true;
+	bool								sort = false;
+	Knn_parameters			knn;
+	int									passes = 0;			// 0: a single removal with CGAL
+	for (int a = 1; a < argc - 2; a++)
+	{
+		if (strcmp(argv[a], "-v") == 0)
+			verbose = true;
+		else if (strcmp(argv[a], "--passes") == 0 && a + 1 < argc - 2 && atoi(argv[a + 1]) > 0)
+			passes = atoi(argv[++a]);
+		else if (strcmp(argv[a], "--no-colors") == 0)
+			colors = false;
+		else if (strcmp(argv[a], "--sort") == 0)
+			sort = true;
+		else if (strcmp(argv[a], "--approx") == 0 && a + 1 < argc - 2 && atof(argv[a + 1]) >= 0.0)
+			knn.epsilon = atof(argv[++a]);
+		else if (strcmp(argv[a], "--max-checks") == 0 && a + 1 < argc - 2 && atoi(argv[a + 1]) > 0)
+			knn.max_checks = std::size_t(atoi(argv[++a]));
+		else
+		{
+			std::cerr << " ERROR: wrong arguments.\n\tUsage: $ outliers [-v] [--passes <n>] [--no-colors] [--sort] [--approx <epsilon>] [--max-checks <n>] "
+							<< "<input_file.ply> <output_file.ply>\n";
+			return EXIT_FAILURE;
+		}
+	}
+	// the CGAL removal searches exactly
+	if (!knn.exact() && passes == 0)
+		passes = 1;
+	input_file = argv[argc - 2];
+	output_file = argv[argc - 1];
+	return with_colors_if(colors, [&](auto attributes)
+	{
+		return remove_cloud_outliers<decltype(attributes)>(input_file, output_file, passes, knn, sort, verbose);
+	});
+}
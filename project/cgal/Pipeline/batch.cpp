@@ -0,0 +1,499 @@
+/*
+ * BATCH PIPELINE
+ * The pipeline of pipeline (see run.hpp) on many clouds at once: a directory of ply files or a
+ * manifest listing them. Clouds are processed side by side on a thread pool, the biggest files
+ * first; the cores left over by the clouds go to the parallel loops inside the steps of each one,
+ * so that jobs x threads per cloud never exceeds the hardware threads (with --stream, the steps
+ * running at once share them the same way).
+ * For each cloud <name> (the file name without .ply and without the c_ prefix) the output directory
+ * gets cleardetect_<name>.ply (the points of the accepted cylinders, as pipeline.m), the pose of the
+ * axle in <name>_pose.json and <name>.log; summary.csv has one line per cloud with the offset and the
+ * timings of each step.
+ * Manifest: one cloud per line, optionally followed by its own limits file; relative paths start
+ * from the directory of the manifest, empty lines and lines starting with # are skipped.
+ * With --stream the clouds are taken in order as a stream of scans and it is the steps that run
+ * side by side instead (see stream.hpp): read, cut, first outlier removal, first detection and
+ * cleaning, the following iterations (refine), write; bounded queues between them keep a fast
+ * step from piling up clouds in memory, and the occupancy of each step shows the bottleneck.
+ */
+#include <CGAL/Real_timer.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "run.hpp"
+#include "stream.hpp"
+#include "../utils/thread_pool.hpp"
+
+typedef CGAL::Real_timer																			Real_timer;
+
+struct Batch_entry
+{
+	std::string		name, cloud, limits;
+	long long			bytes;				// file size, to start from the biggest clouds
+};
+
+struct Batch_result
+{
+	std::string		name;
+	bool					ok;
+	std::string		error;
+	std::size_t		input_size;
+	double				read, write, wall;
+	Pipeline_run	run;
+};
+
+bool is_directory (const std::string& path)
+{
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+long long file_size (const std::string& path)
+{
+	struct stat info;
+	return (stat(path.c_str(), &info) == 0)? (long long)(info.st_size) : 0;
+}
+
+Batch_entry make_entry (const std::string& cloud, const std::string& limits)
+{
+	Batch_entry entry;
+	entry.name = cloud_name(cloud);
+	entry.cloud = cloud;
+	entry.limits = limits;
+	entry.bytes = file_size(cloud);
+	return entry;
+}
+
+// the ply files of the directory, except the limits file itself
+bool list_directory (const std::string& directory, const std::string& limits, std::vector<Batch_entry>& entries)
+{
+	DIR* dir = opendir(directory.c_str());
+	if (dir == 0)
+		return false;
+	std::vector<std::string> files;
+	for (struct dirent* e = readdir(dir); e != 0; e = readdir(dir))
+	{
+		std::string file = e->d_name;
+		if (ends_with(file, ".ply") && directory + "/" + file != limits && file != "limits.ply")
+			files.push_back(directory + "/" + file);
+	}
+	closedir(dir);
+	std::sort(files.begin(), files.end());
+	for (std::size_t i = 0; i < files.size(); i++)
+		entries.push_back(make_entry(files[i], limits));
+	return true;
+}
+
+bool read_manifest (const std::string& manifest, const std::string& limits, std::vector<Batch_entry>& entries)
+{
+	std::ifstream in (manifest);
+	if (!in)
+		return false;
+	std::string::size_type slash = manifest.find_last_of('/');
+	std::string base = (slash == std::string::npos)? "" : manifest.substr(0, slash + 1);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields (line);
+		std::string cloud, cloud_limits;
+		if (!(fields >> cloud) || cloud[0] == '#')
+			continue;
+		if (!(fields >> cloud_limits))
+			cloud_limits = limits;
+		else if (cloud_limits[0] != '/')
+			cloud_limits = base + cloud_limits;
+		if (cloud[0] != '/')
+			cloud = base + cloud;
+		entries.push_back(make_entry(cloud, cloud_limits));
+	}
+	return true;
+}
+
+// cleardetect_<name>.ply and <name>_pose.json; false with the reason in error
+bool write_outputs (const std::string& output_dir, const std::string& name, const Pipeline_run& run, std::string& error)
+{
+	std::string output_file = output_dir + "/cleardetect_" + name + ".ply";
+	std::string pose_file = output_dir + "/" + name + "_pose.json";
+	if (!write_cloud(output_file, run.result))
+		error = "cannot write file " + output_file;
+	else if (!write_pose(pose_file, name, run.pose))
+		error = "cannot write file " + pose_file;
+	else
+		return true;
+	return false;
+}
+
+// one cloud, its parallel loops limited to threads
+Batch_result process (const Batch_entry& entry, const Pipeline_options& options, const std::string& output_dir, std::size_t threads)
+{
+	Batch_result result;
+	result.name = entry.name;
+	result.ok = false;
+	result.input_size = 0;
+	result.read = result.write = 0.0;
+	Real_timer wall, t;
+	wall.start();
+	std::ostringstream log;
+
+	const bool	filters = options.prepare.intensity || options.prepare.color;
+	Pwn_vector	point_cloud;
+	Point_cloud	columns;
+	Crop_box		box;
+	t.start();
+	bool read = filters? read_cloud(entry.cloud, columns, options.prepare) : read_cloud(entry.cloud, point_cloud);
+	t.stop();
+	result.read = t.time();
+	if (!read)
+		result.error = "cannot read file " + entry.cloud;
+	else if (!read_limits(entry.limits, box))
+		result.error = "cannot read limits from " + entry.limits;
+	else
+	{
+		result.input_size = filters? columns.size() : point_cloud.size();
+		log << "Read successfully " << result.input_size << " point(s) from " << entry.cloud << " (" << result.read << " s)\n";
+		with_thread_limit(threads, [&]
+		{
+			result.run = filters? run_pipeline(columns, box, options, log) : run_pipeline(point_cloud, box, options, log);
+		});
+		if (result.run.result.empty())
+			result.error = "no acceptable shape has been detected on this cloud";
+		else
+		{
+			t.reset();
+			t.start();
+			result.ok = write_outputs(output_dir, entry.name, result.run, result.error);
+			t.stop();
+			result.write = t.time();
+			if (result.ok)
+				log << result.run.result.size() << " point(s) saved in " << output_dir << "/cleardetect_" << entry.name << ".ply\n";
+		}
+	}
+	if (!result.ok)
+		log << "ERROR: " << result.error << std::endl;
+	wall.stop();
+	result.wall = wall.time();
+	std::ofstream (output_dir + "/" + entry.name + ".log") << log.str();
+	return result;
+}
+
+// a cloud of the stream, handed from step to step
+struct Stream_scan
+{
+	Batch_result				result;
+	Pwn_vector					cloud;
+	Crop_box						limits;
+	Pipeline_state			state;
+	bool								go_on;				// the first detection leaves iterations to run
+	std::ostringstream	log;
+	Real_timer					wall;
+};
+
+// steps of process_stream whose parallel loops run at the same time
+#define STREAM_PARALLEL_STEPS		4
+
+// the clouds in order, one thread per step with queues of capacity clouds between them
+void process_stream (	const std::vector<Batch_entry>& entries, const Pipeline_options& options, const std::string& output_dir,
+											std::size_t threads, std::size_t capacity, std::vector<Batch_result>& results)
+{
+	std::vector<Stream_scan> scans (entries.size());
+	std::vector<Stage_stats> stages;
+	const char* names[] = { "read", "cut", "outliers", "detection", "refine", "write" };
+	for (std::size_t s = 0; s < 6; s++)
+		stages.push_back(Stage_stats(names[s]));
+	std::vector<std::unique_ptr<Stream_queue> > queues;
+	for (std::size_t s = 0; s + 1 < stages.size(); s++)
+		queues.push_back(std::unique_ptr<Stream_queue>(new Stream_queue(capacity)));
+
+	// the steps after a failure let the cloud through untouched
+	auto ok = [&scans](std::size_t i) { return scans[i].result.error.empty(); };
+	auto read = [&](std::size_t i)
+	{
+		Stream_scan& scan = scans[i];
+		const Batch_entry& entry = entries[i];
+		scan.wall.start();
+		scan.result.name = entry.name;
+		scan.result.ok = false;
+		scan.result.input_size = 0;
+		scan.result.read = scan.result.write = 0.0;
+		Real_timer t;
+		t.start();
+		bool read = read_cloud(entry.cloud, scan.cloud);
+		t.stop();
+		scan.result.read = t.time();
+		if (!read)
+			scan.result.error = "cannot read file " + entry.cloud;
+		else if (!read_limits(entry.limits, scan.limits))
+			scan.result.error = "cannot read limits from " + entry.limits;
+		else
+		{
+			scan.result.input_size = scan.cloud.size();
+			scan.log << "Read successfully " << scan.cloud.size() << " point(s) from " << entry.cloud << " (" << t.time() << " s)\n";
+		}
+	};
+	auto cut = [&](std::size_t i)
+	{
+		Stream_scan& scan = scans[i];
+		if (!ok(i))
+			return;
+		with_thread_limit(threads, [&] { pipeline_cut(scan.cloud, scan.limits, options, scan.state, scan.log); });
+		Pwn_vector().swap(scan.cloud);
+	};
+	auto outliers = [&](std::size_t i)
+	{
+		if (ok(i))
+			with_thread_limit(threads, [&] { pipeline_outliers(scans[i].state, 1, options, scans[i].log); });
+	};
+	auto detection = [&](std::size_t i)
+	{
+		if (ok(i))
+			with_thread_limit(threads, [&] { scans[i].go_on = pipeline_detection(scans[i].state, 1, options, scans[i].log); });
+	};
+	auto refine = [&](std::size_t i)
+	{
+		if (ok(i) && scans[i].go_on)
+			with_thread_limit(threads, [&] { pipeline_iterations(scans[i].state, 2, options, scans[i].log); });
+	};
+	auto write = [&](std::size_t i)
+	{
+		Stream_scan& scan = scans[i];
+		Batch_result& result = scan.result;
+		if (ok(i))
+		{
+			pipeline_pose(scan.state, options, scan.log);
+			result.run = scan.state.run;
+			Pipeline_timings& seconds = result.run.seconds;
+			seconds.total = seconds.cut + seconds.outliers + seconds.detection + seconds.pose;
+			if (result.run.result.empty())
+				result.error = "no acceptable shape has been detected on this cloud";
+			else
+			{
+				Real_timer t;
+				t.start();
+				result.ok = write_outputs(output_dir, entries[i].name, result.run, result.error);
+				t.stop();
+				result.write = t.time();
+				if (result.ok)
+					scan.log << result.run.result.size() << " point(s) saved in " << output_dir << "/cleardetect_" << entries[i].name << ".ply\n";
+			}
+		}
+		if (!result.ok)
+			scan.log << "ERROR: " << result.error << std::endl;
+		scan.wall.stop();
+		result.wall = scan.wall.time();
+		std::ofstream (output_dir + "/" + entries[i].name + ".log") << scan.log.str();
+		std::cerr << result.name << ": " << (result.ok? "ok" : "ERROR: " + result.error) << " (" << result.wall << " s)\n";
+		results[i] = result;
+		scan.state = Pipeline_state();
+	};
+
+	Real_timer total;
+	total.start();
+	{
+		std::vector<std::thread> workers;
+		workers.push_back(std::thread([&] { run_stage(0, entries.size(), queues[0].get(), stages[0], read); }));
+		workers.push_back(std::thread([&] { run_stage(queues[0].get(), 0, queues[1].get(), stages[1], cut); }));
+		workers.push_back(std::thread([&] { run_stage(queues[1].get(), 0, queues[2].get(), stages[2], outliers); }));
+		workers.push_back(std::thread([&] { run_stage(queues[2].get(), 0, queues[3].get(), stages[3], detection); }));
+		workers.push_back(std::thread([&] { run_stage(queues[3].get(), 0, queues[4].get(), stages[4], refine); }));
+		workers.push_back(std::thread([&] { run_stage(queues[4].get(), 0, (Stream_queue*)(0), stages[5], write); }));
+		for (std::size_t w = 0; w < workers.size(); w++)
+			workers[w].join();
+	}
+	total.stop();
+	print_occupancy(std::cerr, stages, queues, total.time());
+}
+
+void write_summary (std::ostream& out, const std::vector<Batch_result>& results)
+{
+	out << "name,status,points,cut,kept,iterations,radius,offset_x,read_s,cut_s,outliers_s,detection_s,pose_s,write_s,total_s\n";
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		const Batch_result& r = results[i];
+		const Pipeline_run& run = r.run;
+		out << r.name << "," << (r.ok? "ok" : "failed") << "," << r.input_size << ",";
+		if (r.input_size == 0)
+			out << ",,,,," << r.read << ",,,,,,";
+		else
+		{
+			out << run.cut_size << "," << run.result.size() << "," << run.iterations << ",";
+			if (run.found)
+				out << run.pose.radius << "," << run.pose.offset_x << ",";
+			else
+				out << ",,";
+			out << r.read << "," << run.seconds.cut << "," << run.seconds.outliers << "," << run.seconds.detection << ","
+					<< run.seconds.pose << "," << r.write << ",";
+		}
+		out << r.wall << "\n";
+	}
+}
+
+// the centers of the successful clouds, in the order of the input
+void store_offsets (const std::string& file, const Pipeline_options& options, const std::vector<Batch_result>& results)
+{
+	for (std::size_t i = 0; i < results.size(); i++)
+		if (results[i].ok && !store_offset(file, results[i].name, options, results[i].run, std::cerr))
+			std::cerr << "ERROR: cannot write file " << file << std::endl;
+}
+
+// summary.csv and the totals; the exit status of the program
+int finish (const std::string& output_dir, const Pipeline_options& options, const std::vector<Batch_result>& results, double elapsed)
+{
+	std::string summary_file = output_dir + "/summary.csv";
+	std::ofstream summary (summary_file);
+	write_summary(summary, results);
+	if (!summary)
+	{
+		std::cerr << "ERROR: cannot write file " << summary_file << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::size_t ok = 0;
+	double serial = 0.0;
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		ok += results[i].ok;
+		serial += results[i].wall;
+	}
+	std::cerr << ok << " of " << results.size() << " cloud(s) processed, summary in " << summary_file << std::endl;
+	std::cerr << "Elapsed time is " << elapsed << " seconds (" << serial << " s of single cloud runs).\n";
+	std::cerr << "Peak memory: " << peak_memory_mb() << " MB (" << PIPELINE_KERNEL_NAME << " kernel)" << std::endl;
+	if (options.cache)
+		options.cache->print_stats(std::cerr);
+	return (ok == results.size())? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main (int argc, char** argv)
+{
+	if (argc < 4 || argc > 55 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\tUsage: pipeline_batch [--jobs <n>] [--threads-per-cloud <n>] [--stream [--queue <n>]] [--store <offsets.bin>] "
+							<< "[pipeline options] "
+							<< "<input_directory|manifest.txt> <output_directory> <limits.ply>\n";
+		std::cerr << "\nRun the pipeline on every cloud of a directory or of a manifest, several clouds at once. Each cloud "
+							<< "gets its result and log in the output directory, summary.csv collects the timings of all of them.\n";
+		std::cerr << "\n--jobs\t\tclouds processed at the same time (default: one per hardware thread, at most the number of clouds)\n";
+		std::cerr << "--threads-per-cloud\tthreads of the parallel loops inside each cloud (default: the hardware threads "
+							<< "left by the jobs; with --stream, a quarter of them: the cut, outliers, detection and refine steps run at once)\n";
+		std::cerr << "--stream\ttake the clouds in order and overlap the steps of consecutive clouds instead of running "
+							<< "whole clouds side by side (--jobs is ignored); the occupancy of each step is reported at the end\n";
+		std::cerr << "--queue\t\twith --stream, clouds that can wait between two steps (default 2)\n";
+		std::cerr << "--store\t\tadd the centers to the offset store, one key per cloud and configuration (see offsets)\n";
+		print_pipeline_options(std::cerr);
+		return EXIT_FAILURE;
+	}
+
+	Pipeline_options	options;
+	std::size_t				jobs = 0, threads = 0, capacity = 2;
+	bool							stream = false;
+	std::string				store_file;
+	for (int a = 1; a < argc - 3; a++)
+	{
+		if (strcmp(argv[a], "--jobs") == 0 && a + 1 < argc - 3 && atoi(argv[a + 1]) > 0)
+			jobs = std::size_t(atoi(argv[++a]));
+		else if (strcmp(argv[a], "--threads-per-cloud") == 0 && a + 1 < argc - 3 && atoi(argv[a + 1]) > 0)
+			threads = std::size_t(atoi(argv[++a]));
+		else if (strcmp(argv[a], "--stream") == 0)
+			stream = true;
+		else if (strcmp(argv[a], "--queue") == 0 && a + 1 < argc - 3 && atoi(argv[a + 1]) > 0)
+			capacity = std::size_t(atoi(argv[++a]));
+		else if (strcmp(argv[a], "--store") == 0 && a + 1 < argc - 3)
+			store_file = argv[++a];
+		else if (!parse_pipeline_option(argv, a, argc - 3, options))
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (!open_stage_cache(options))
+	{
+		std::cerr << "ERROR: cannot create directory " << options.cache_dir << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::string input = argv[argc - 3];
+	std::string output_dir = argv[argc - 2];
+	std::string limits_file = argv[argc - 1];
+
+	std::vector<Batch_entry> entries;
+	if (is_directory(input)? !list_directory(input, limits_file, entries) : !read_manifest(input, limits_file, entries))
+	{
+		std::cerr << "ERROR: cannot read " << input << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (entries.empty())
+	{
+		std::cerr << "ERROR: no cloud found in " << input << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!is_directory(output_dir) && mkdir(output_dir.c_str(), 0755) != 0)
+	{
+		std::cerr << "ERROR: cannot create directory " << output_dir << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// outer parallelism first: the detections are sequential, a cloud per core keeps all of them busy;
+	// with fewer clouds than cores, the rest goes inside the steps
+	const std::size_t cores = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+	std::vector<Batch_result> results (entries.size());
+	if (stream)
+	{
+		// the steps with parallel loops (cut, outliers, detection, refine) run at the same time:
+		// they share the cores as the jobs do
+		if (threads == 0)
+			threads = std::max<std::size_t>(1, cores / STREAM_PARALLEL_STEPS);
+		std::cerr << entries.size() << " cloud(s) streamed through the steps, queues of " << capacity << ", "
+							<< threads << " thread(s) for the loops of each step\n";
+		Real_timer total;
+		total.start();
+		process_stream(entries, options, output_dir, threads, capacity, results);
+		total.stop();
+		if (!store_file.empty())
+			store_offsets(store_file, options, results);
+		return finish(output_dir, options, results, total.time());
+	}
+	if (jobs == 0)
+		jobs = std::min(entries.size(), cores);
+	if (threads == 0)
+		threads = std::max<std::size_t>(1, cores / jobs);
+	std::cerr << entries.size() << " cloud(s), " << jobs << " at a time with " << threads << " thread(s) each\n";
+
+	// biggest first, so that a large cloud does not start last and keep the others waiting
+	std::vector<std::size_t> order (entries.size());
+	for (std::size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&entries](std::size_t a, std::size_t b) { return entries[a].bytes > entries[b].bytes; });
+
+	Real_timer total;
+	total.start();
+	{
+		Thread_pool pool (jobs);
+		std::vector<std::future<Batch_result> > futures (entries.size());
+		for (std::size_t k = 0; k < order.size(); k++)
+		{
+			const Batch_entry& entry = entries[order[k]];
+			futures[order[k]] = pool.submit([&entry, &options, &output_dir, threads] { return process(entry, options, output_dir, threads); });
+		}
+		for (std::size_t i = 0; i < futures.size(); i++)
+		{
+			results[i] = futures[i].get();
+			std::cerr << results[i].name << ": " << (results[i].ok? "ok" : "ERROR: " + results[i].error) << " (" << results[i].wall << " s)\n";
+		}
+	}
+	total.stop();
+	if (!store_file.empty())
+		store_offsets(store_file, options, results);
+
+	return finish(output_dir, options, results, total.time());
+}
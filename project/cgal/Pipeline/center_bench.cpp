@@ -0,0 +1,144 @@
+/*
+ * CENTER BENCHMARK
+ * The estimators of the axle center (see ../funcs/axle_pose.hpp) on cleardetect clouds: the time
+ * each of them takes and, over several clouds of the same scan (the results of repeated runs,
+ * which differ because RANSAC is random), how much their estimates spread. The spread of the
+ * mean is what pipeline.m fights with many runs and the gap rule: the variance ratio says how much
+ * each estimator reduces it.
+ * The cylinder each cloud lies on is fitted again on its points and normals.
+ */
+#include <CGAL/Real_timer.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stages.hpp"
+
+typedef CGAL::Real_timer																			Real_timer;
+
+// center and seconds per call of each estimator on a cloud
+struct Center_run
+{
+	Vec3		center[CENTER_ESTIMATORS];
+	double	seconds[CENTER_ESTIMATORS];
+};
+
+bool fit_cloud_cylinder (const Pwn_vector& point_cloud, Fitted_cylinder& cylinder)
+{
+	std::vector<Vec3> points = positions_of(point_cloud), normals (point_cloud.size());
+	std::vector<std::size_t> indices (point_cloud.size());
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+	{
+		normals[i] = to_vec3(point_cloud[i].second);
+		indices[i] = i;
+	}
+	return fit_cylinder(points, normals, indices, cylinder);
+}
+
+Center_run run_estimators (const Point_columns& columns, const Fitted_cylinder& cylinder, const Axle_pose_parameters& parameters, int repeat)
+{
+	Center_run run;
+	for (int e = 0; e < CENTER_ESTIMATORS; e++)
+	{
+		Real_timer t;
+		t.start();
+		for (int r = 0; r < repeat; r++)
+		{
+			std::size_t inliers;
+			double radius;
+			switch (e)
+			{
+				case CENTER_MEAN:			run.center[e] = mean_center(columns); break;
+				case CENTER_CLIPPED:	run.center[e] = clipped_center(columns, cylinder, parameters.clip_sigmas, inliers, radius); break;
+				case CENTER_TRIMMED:	run.center[e] = trimmed_center(columns, parameters.trim); break;
+				case CENTER_MEDIAN:		run.center[e] = median_center(columns); break;
+				default:							run.center[e] = weighted_center(columns, cylinder); break;
+			}
+		}
+		t.stop();
+		run.seconds[e] = t.time() / repeat;
+	}
+	return run;
+}
+
+int main (int argc, char** argv)
+{
+	if (argc < 2 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\tUsage: center_bench [--repeat <n>] [--trim <f>] <cleardetect.ply> [<cleardetect.ply> ...]\n";
+		std::cerr << "\nTime the estimators of the axle center on each cloud and, with several clouds of the same scan, "
+							<< "compare how much their estimates spread.\n";
+		std::cerr << "\n--repeat\tcalls of each estimator on each cloud, to time them (default 20)\n";
+		std::cerr << "--trim\t\tfraction of the values cut at each end by the trimmed mean (default 0.1)\n";
+		return EXIT_FAILURE;
+	}
+
+	Axle_pose_parameters	parameters;
+	int										repeat = 20;
+	int										a = 1;
+	for (; a < argc && strncmp(argv[a], "--", 2) == 0; a++)
+	{
+		if (strcmp(argv[a], "--repeat") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0)
+			repeat = atoi(argv[++a]);
+		else if (strcmp(argv[a], "--trim") == 0 && a + 1 < argc && atof(argv[a + 1]) >= 0.0 && atof(argv[a + 1]) < 0.5)
+			parameters.trim = atof(argv[++a]);
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (a == argc)
+	{
+		std::cerr << "ERROR: no cloud given. Tap --help for more info" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Center_run> runs;
+	for (; a < argc; a++)
+	{
+		Pwn_vector point_cloud;
+		Fitted_cylinder cylinder;
+		if (!read_cloud(argv[a], point_cloud))
+		{
+			std::cerr << "ERROR: cannot read file " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!fit_cloud_cylinder(point_cloud, cylinder))
+		{
+			std::cerr << "ERROR: no cylinder fits the points of " << argv[a] << std::endl;
+			return EXIT_FAILURE;
+		}
+		cylinder.axis = normalized(cylinder.axis);
+		runs.push_back(run_estimators(columns_of(point_cloud), cylinder, parameters, repeat));
+		std::cout << argv[a] << ": " << point_cloud.size() << " point(s), radius " << cylinder.radius << "\n";
+		for (int e = 0; e < CENTER_ESTIMATORS; e++)
+			std::cout << "\t" << center_estimator_name(e) << "\t[" << runs.back().center[e][0] << " " << runs.back().center[e][1]
+								<< " " << runs.back().center[e][2] << "]\t" << runs.back().seconds[e] * 1000.0 << " ms\n";
+	}
+	if (runs.size() < 2)
+		return EXIT_SUCCESS;
+
+	// spread of each estimator over the clouds
+	const double n = double(runs.size());
+	double variance_x[CENTER_ESTIMATORS];
+	std::cout << "\nOver " << runs.size() << " clouds (standard deviation, variance on X relative to the mean):\n";
+	for (int e = 0; e < CENTER_ESTIMATORS; e++)
+	{
+		Vec3 mean = make_vec3(0, 0, 0), variance = make_vec3(0, 0, 0);
+		for (std::size_t r = 0; r < runs.size(); r++)
+			mean = mean + (1.0 / n) * runs[r].center[e];
+		for (std::size_t r = 0; r < runs.size(); r++)
+			for (int k = 0; k < 3; k++)
+				variance[k] += (runs[r].center[e][k] - mean[k]) * (runs[r].center[e][k] - mean[k]) / (n - 1.0);
+		variance_x[e] = variance[0];
+		std::cout << "\t" << center_estimator_name(e) << "\ton x: " << std::sqrt(variance[0]) * 100.0 << " cm\ton y: "
+							<< std::sqrt(variance[1]) * 100.0 << " cm\ton z: " << std::sqrt(variance[2]) * 100.0 << " cm\tratio "
+							<< ((variance_x[CENTER_MEAN] > 0.0)? variance[0] / variance_x[CENTER_MEAN] : 1.0) << "\n";
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*
+ * OFFSETS
+ * Query the offset store filled by pipeline --store and pipeline_batch --store (see
+ * ../funcs/offset_store.hpp): for each cloud and configuration, the offset on X with the mean,
+ * gap and variance of the centers, as avg_gap_var prints them, and the average computation time.
+ * With --history every run is listed, rejected ones included.
+ * With --compare a b the clouds run with both configurations are set side by side, e.g. the double
+ * and float kernels (outer3_inner3 and outer3_inner3_float): difference of the offsets, spread of
+ * each and computation time.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../funcs/offset_store.hpp"
+
+void print_stats (const Offset_record& last, std::size_t runs)
+{
+	const Offset_stats& s = last.stats;
+	std::cout << last.cloud << " (" << last.config << "): offset on X " << s.mean[0] << " m, " << s.count
+						<< " run(s) counted of " << runs << "\n";
+	std::cout << "\tAverage\t\ton x: " << s.mean[0] << " m\ton y: " << s.mean[1] << " m\ton z: " << s.mean[2] << " m\n";
+	std::cout << "\tMax gap\t\ton x: " << offset_gap(s, 0) * 100.0 << " cm\ton y: " << offset_gap(s, 1) * 100.0
+						<< " cm\ton z: " << offset_gap(s, 2) * 100.0 << " cm\n";
+	std::cout << "\tStd deviation\ton x: " << std::sqrt(offset_variance(s, 0)) * 100.0 << " cm\ton y: "
+						<< std::sqrt(offset_variance(s, 1)) * 100.0 << " cm\ton z: " << std::sqrt(offset_variance(s, 2)) * 100.0 << " cm\n";
+	std::cout << "\tAverage computation time: " << s.seconds_mean << " s\n";
+}
+
+void print_run (const Offset_record& r)
+{
+	char when[32];
+	std::time_t t = std::time_t(r.time);
+	std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&t));
+	std::cout << when << "\t" << r.cloud << "\t" << r.config << "\t" << r.center[0] << " " << r.center[1] << " "
+						<< r.center[2] << "\t" << r.seconds << " s\t" << (r.accepted? "counted" : "rejected") << "\n";
+}
+
+// The offset of a cloud with configuration a against b (both last records of their key)
+void print_comparison (const Offset_record& a, const Offset_record& b)
+{
+	std::cout << a.cloud << ": " << a.config << " against " << b.config << "\n";
+	std::cout << "\tOffset on X\t" << a.stats.mean[0] << " m against " << b.stats.mean[0] << " m: difference "
+						<< (a.stats.mean[0] - b.stats.mean[0]) * 1000.0 << " mm\n";
+	std::cout << "\tCenter\t\tdifference on y: " << (a.stats.mean[1] - b.stats.mean[1]) * 1000.0 << " mm\ton z: "
+						<< (a.stats.mean[2] - b.stats.mean[2]) * 1000.0 << " mm\n";
+	std::cout << "\tStd deviation\ton x: " << std::sqrt(offset_variance(a.stats, 0)) * 100.0 << " cm against "
+						<< std::sqrt(offset_variance(b.stats, 0)) * 100.0 << " cm (" << a.stats.count << " and " << b.stats.count << " run(s))\n";
+	std::cout << "\tComputation\t" << a.stats.seconds_mean << " s against " << b.stats.seconds_mean << " s";
+	if (a.stats.seconds_mean > 0.0)
+		std::cout << ": " << b.stats.seconds_mean / a.stats.seconds_mean << " times";
+	std::cout << "\n";
+}
+
+int main (int argc, char** argv)
+{
+	if (argc < 2 || argc > 8 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\tUsage: offsets [--cloud <name>] [--config <configuration>] [--history] [--compare <config> <config>] <offsets.bin>\n";
+		std::cerr << "\nPrint the offsets kept in the store by pipeline --store and pipeline_batch --store.\n";
+		std::cerr << "\n--cloud\t\tonly this cloud\n";
+		std::cerr << "--config\tonly this configuration (as outer3_inner3, see the store)\n";
+		std::cerr << "--history\tlist every run instead of the statistics\n";
+		std::cerr << "--compare\tthe clouds run with both configurations, side by side (e.g. outer3_inner3 and "
+							<< "outer3_inner3_float for the float kernel)\n";
+		return EXIT_FAILURE;
+	}
+
+	std::string	cloud, config, compare[2];
+	bool				history = false;
+	for (int a = 1; a < argc - 1; a++)
+	{
+		if (strcmp(argv[a], "--cloud") == 0 && a + 1 < argc - 1)
+			cloud = argv[++a];
+		else if (strcmp(argv[a], "--config") == 0 && a + 1 < argc - 1)
+			config = argv[++a];
+		else if (strcmp(argv[a], "--history") == 0)
+			history = true;
+		else if (strcmp(argv[a], "--compare") == 0 && a + 2 < argc - 1)
+		{
+			compare[0] = argv[++a];
+			compare[1] = argv[++a];
+		}
+		else
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<Offset_record> records;
+	if (!read_offset_records(argv[argc - 1], records))
+	{
+		std::cerr << "ERROR: cannot read file " << argv[argc - 1] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the last record of each key has its statistics
+	std::map<std::pair<std::string, std::string>, std::pair<std::size_t, std::size_t> > keys;	// last record, runs
+	for (std::size_t i = 0; i < records.size(); i++)
+	{
+		const Offset_record& r = records[i];
+		if ((!cloud.empty() && cloud != r.cloud) || (!config.empty() && config != r.config))
+			continue;
+		if (history)
+			print_run(r);
+		std::pair<std::size_t, std::size_t>& key = keys[std::make_pair(std::string(r.cloud), std::string(r.config))];
+		key.first = i;
+		key.second++;
+	}
+	if (keys.empty())
+	{
+		std::cerr << "ERROR: no run found in " << argv[argc - 1] << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!compare[0].empty())
+	{
+		std::size_t compared = 0;
+		for (std::map<std::pair<std::string, std::string>, std::pair<std::size_t, std::size_t> >::const_iterator k = keys.begin();
+				 k != keys.end(); ++k)
+		{
+			if (k->first.second != compare[0])
+				continue;
+			std::map<std::pair<std::string, std::string>, std::pair<std::size_t, std::size_t> >::const_iterator other =
+				keys.find(std::make_pair(k->first.first, compare[1]));
+			if (other == keys.end())
+				continue;
+			print_comparison(records[k->second.first], records[other->second.first]);
+			compared++;
+		}
+		if (compared == 0)
+		{
+			std::cerr << "ERROR: no cloud run with both " << compare[0] << " and " << compare[1] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	else if (!history)
+		for (std::map<std::pair<std::string, std::string>, std::pair<std::size_t, std::size_t> >::const_iterator k = keys.begin();
+				 k != keys.end(); ++k)
+			print_stats(records[k->second.first], k->second.second);
+	return EXIT_SUCCESS;
+}
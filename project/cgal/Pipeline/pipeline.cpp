@@ -0,0 +1,109 @@
+/*
+ * AXLE RECOGNITION PIPELINE
+ * The pipeline of pipeline.m in a single program (see run.hpp): cut, then for each outer iteration
+ * some outlier removals followed by detection and cleaning. The cloud stays in memory between the steps.
+ * With --fixed all the iterations are run, as pipeline.m does.
+ * Input: cloud with normals (as c_<name>.ply); output: the points of the accepted cylinders and,
+ * with --pose, the pose of the axle (center, axis, radius, offset on X) as JSON or binary record;
+ * with --store, the center is added to the offsets of the cloud (see ../funcs/offset_store.hpp).
+ */
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "run.hpp"
+
+int main (int argc, char** argv)
+{
+	if (argc < 4 || argc > 49 || strcmp(argv[1], "--help") == 0)
+	{
+		std::cerr << "\tUsage: pipeline [-v] [--auto-limits] [--outer <n>] [--inner <n>] [--margin <radii>] [--fixed] [--sort] [--approx <epsilon>] [--max-checks <n>] "
+							<< "[--voxel <leaf>] [--normals <k>] [--intensity <min> <max>] [--color <r> <g> <b> <distance>] "
+							<< "[--cache <dir>] [--cache-size <MB>] "
+							<< "[--removal-ratio <r>] [--center-tolerance <m>] [--axis-tolerance <rad>] [--center <estimator>] [--trim <f>] "
+							<< "[--pose <pose.json|pose.bin>] [--store <offsets.bin>] "
+							<< "<input_file.ply> <output_file.ply> <limits.ply>\n";
+		std::cerr << "\nRun cut, outlier removal, shape detection and cleaning on a cloud with normals and save the points "
+							<< "of the accepted cylinders.\n";
+		std::cerr << "\n";
+		print_pipeline_options(std::cerr);
+		std::cerr << "--pose\t\tsave the pose of the axle: one line of JSON, or a binary record if the file ends with .bin\n";
+		std::cerr << "--store\t\tadd the center to the offset store of the cloud and this configuration (see offsets)\n";
+		return EXIT_FAILURE;
+	}
+
+	Pipeline_options	options;
+	std::string				pose_file, store_file;
+	for (int a = 1; a < argc - 3; a++)
+	{
+		if (strcmp(argv[a], "--pose") == 0 && a + 1 < argc - 3)
+			pose_file = argv[++a];
+		else if (strcmp(argv[a], "--store") == 0 && a + 1 < argc - 3)
+			store_file = argv[++a];
+		else if (!parse_pipeline_option(argv, a, argc - 3, options))
+		{
+			std::cerr << "ERROR: unknown option " << argv[a] << ". Tap --help for more info" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (!open_stage_cache(options))
+	{
+		std::cerr << "ERROR: cannot create directory " << options.cache_dir << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::string input_file = argv[argc - 3];
+	std::string output_file = argv[argc - 2];
+	std::string limits_file = argv[argc - 1];
+
+	// the filters need the columns of the cloud, the other runs positions and normals only
+	const bool	filters = options.prepare.intensity || options.prepare.color;
+	Pwn_vector	point_cloud;
+	Point_cloud	columns;
+	Crop_box		box;
+	if (filters? !read_cloud(input_file, columns, options.prepare) : !read_cloud(input_file, point_cloud))
+	{
+		std::cerr << "ERROR: cannot read file " << input_file << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!read_limits(limits_file, box))
+	{
+		std::cerr << "ERROR: cannot read limits from " << limits_file << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cerr << "Read successfully " << (filters? columns.size() : point_cloud.size()) << " point(s)\n";
+
+	Pipeline_run run = filters? run_pipeline(columns, box, options, std::cerr) : run_pipeline(point_cloud, box, options, std::cerr);
+	const Pwn_vector& result = run.result;
+	if (options.cache)
+		options.cache->print_stats(std::cerr);
+
+	if (result.empty())
+	{
+		std::cerr << "ERROR: no acceptable shape has been detected on this cloud\n";
+		return EXIT_FAILURE;
+	}
+	if (!write_cloud(output_file, result))
+	{
+		std::cerr << "ERROR: cannot write file " << output_file << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cerr << result.size() << " point(s) saved in " << output_file << std::endl;
+	std::cerr << "Offset on X: " << run.pose.offset_x << std::endl;
+	std::cerr << "Peak memory: " << peak_memory_mb() << " MB (" << PIPELINE_KERNEL_NAME << " kernel)" << std::endl;
+	if (!pose_file.empty())
+	{
+		if (!write_pose(pose_file, cloud_name(input_file), run.pose))
+		{
+			std::cerr << "ERROR: cannot write file " << pose_file << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cerr << "Pose saved in " << pose_file << std::endl;
+	}
+	if (!store_file.empty() && !store_offset(store_file, cloud_name(input_file), options, run, std::cerr))
+	{
+		std::cerr << "ERROR: cannot write file " << store_file << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,309 @@
+/*
+ * CLOUD PREPARATION
+ * What the pipeline does to a cloud before the iterations, as a plan of stages (see
+ * funcs/stage_plan.hpp): the crop of the cut and, when asked, an intensity filter, a color filter,
+ * voxel downsampling (see funcs/voxel_grid.hpp) and the estimate of the normals (PCA, see
+ * funcs/pca_normals.hpp). pipeline.m estimates the normals on the whole raw cloud before the cut
+ * throws most of it away; here each stage gets a cost per point and a fraction of points kept,
+ * measured on a sample of the cloud, and the stages run in the order of least estimated cost.
+ * Declared dependencies: the filters and the crop with --auto-limits (whose histograms need the
+ * raw density) come before the voxels, so that they judge the values of the scanner and not
+ * those of a voxel. The plan is printed with the estimated and the actual points and seconds of
+ * each stage.
+ */
+#ifndef PIPELINE_PREPARE_HPP
+#define PIPELINE_PREPARE_HPP
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/knn_grid.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/point_cloud.hpp"
+#include "../utils/spatial_grid.hpp"
+#include "../funcs/auto_limits.hpp"
+#include "../funcs/pca_normals.hpp"
+#include "../funcs/stage_plan.hpp"
+#include "../funcs/voxel_grid.hpp"
+
+// estimated nanoseconds per input point of each stage, measured on one core on the scans of
+// ../ply (a test and a copy for the crop and the filters, a sort on the voxel keys and the means
+// for the voxels, a grid query and a 3x3 eigen problem for each normal); the plan prints them next
+// to the actual times
+#define PREPARE_NS_CROP					5.0
+#define PREPARE_NS_AUTO_LIMITS	40.0
+#define PREPARE_NS_FILTER				8.0
+#define PREPARE_NS_VOXEL				180.0
+#define PREPARE_NS_NORMALS			300.0			// per neighbor
+#define PREPARE_SAMPLE					16384			// points looked at by the estimates
+
+enum Prepare_stage { PREPARE_NORMALS, PREPARE_CROP, PREPARE_INTENSITY, PREPARE_COLOR, PREPARE_VOXEL, PREPARE_STAGES };
+
+const char* prepare_stage_name (int stage)
+{
+	static const char* names[PREPARE_STAGES] = { "normals", "crop", "intensity", "color", "voxel" };
+	return names[stage];
+}
+
+struct Prepare_options
+{
+	int			normals;									// neighbors of the normal estimate, 0: keep those of the cloud
+	bool		intensity;
+	float		intensity_min, intensity_max;
+	bool		color;
+	double	rgb[3], color_tolerance;	// kept within this distance of rgb (0-255 per channel)
+	double	voxel;										// leaf, 0: no downsampling
+
+	Prepare_options () : normals(0), intensity(false), intensity_min(0.0f), intensity_max(0.0f), color(false), color_tolerance(0.0),
+											 voxel(0.0)
+	{
+		rgb[0] = rgb[1] = rgb[2] = 0.0;
+	}
+
+	// whether there is more than the crop
+	bool active () const	{ return normals > 0 || intensity || color || voxel > 0.0; }
+};
+
+// per stage, in the order of the plan
+struct Prepare_report
+{
+	std::vector<Plan_stage>		stages;					// indexed by Prepare_stage; absent ones are not in the plans
+	Plan_estimate							plan, baseline;	// the order chosen and the one of pipeline.m (normals first)
+	std::vector<std::size_t>	input, output;
+	std::vector<double>				seconds;
+	Crop_box									box;						// used by the crop
+};
+
+std::vector<Vec3> positions_of (const Point_cloud& cloud)
+{
+	std::vector<Vec3> points (cloud.size());
+	parallel_for_each_index(points.size(), [&](std::size_t i) { points[i] = make_vec3(cloud.x[i], cloud.y[i], cloud.z[i]); });
+	return points;
+}
+
+bool in_color_range (const Point_cloud& cloud, std::size_t i, const Prepare_options& options)
+{
+	double d[3] = { cloud.red[i] - options.rgb[0], cloud.green[i] - options.rgb[1], cloud.blue[i] - options.rgb[2] };
+	return d[0] * d[0] + d[1] * d[1] + d[2] * d[2] <= options.color_tolerance * options.color_tolerance;
+}
+
+template <typename Predicate>
+void keep_points (Point_cloud& cloud, const Predicate& keep)
+{
+	std::vector<unsigned char> flags (cloud.size());
+	parallel_for_each_index(flags.size(), [&](std::size_t i) { flags[i] = keep(i); });
+	cloud.keep(flags);
+}
+
+// one point per voxel: mean position and intensity, normals averaged (see Voxel_grid), most frequent
+// color; labels and shape ids are dropped
+void voxel_downsample (Point_cloud& cloud, double leaf)
+{
+	const std::vector<Vec3> points = positions_of(cloud);
+	Voxel_grid grid (points, leaf);
+	std::vector<Vec3> averaged;
+	grid.average_points(points, averaged);
+	Point_cloud result;
+	if (cloud.has_normals())		result.add_normals();
+	if (cloud.has_colors())			result.add_colors();
+	if (cloud.has_intensity())	result.add_intensity();
+	result.resize(grid.size());
+	for (std::size_t v = 0; v < grid.size(); v++)
+		result.set_position(v, averaged[v]);
+	if (cloud.has_normals())
+	{
+		std::vector<Vec3> normals (cloud.size());
+		parallel_for_each_index(normals.size(), [&](std::size_t i) { normals[i] = make_vec3(cloud.nx[i], cloud.ny[i], cloud.nz[i]); });
+		grid.average_normals(normals, averaged);
+		for (std::size_t v = 0; v < grid.size(); v++)
+			result.set_normal(v, averaged[v]);
+	}
+	if (cloud.has_colors())
+	{
+		std::vector<std::uint32_t> colors (cloud.size()), voted;
+		for (std::size_t i = 0; i < colors.size(); i++)
+			colors[i] = (std::uint32_t(cloud.red[i]) << 16) | (std::uint32_t(cloud.green[i]) << 8) | cloud.blue[i];
+		grid.majority(colors, voted);
+		for (std::size_t v = 0; v < grid.size(); v++)
+		{
+			result.red[v] = (unsigned char)(voted[v] >> 16);
+			result.green[v] = (unsigned char)(voted[v] >> 8);
+			result.blue[v] = (unsigned char)(voted[v]);
+		}
+	}
+	if (cloud.has_intensity())
+		parallel_for_each_index(grid.size(), [&](std::size_t v)
+		{
+			std::pair<const std::size_t*, const std::size_t*> range = grid.voxel(v);
+			double sum = 0.0;
+			for (const std::size_t* i = range.first; i != range.second; ++i)
+				sum += cloud.intensity[*i];
+			result.intensity[v] = float(sum / double(range.second - range.first));
+		});
+	cloud = result;
+}
+
+// The stages asked by options with their estimates on a sample of cloud: the fraction of the
+// sample kept by the crop (with the static limits, the automatic box is inside them) and by the
+// filters; for the voxels, the sample is gridded with a leaf grown as the square root of the
+// sampling step, so that its voxels hold as many sample points as the voxels of the cloud hold
+// points (the scans are surfaces, see utils/knn_grid.hpp); after a filter thinning the points
+// evenly the voxels keep more than that. A filter on a column the cloud does not have is left out
+std::vector<Plan_stage> prepare_stages (const Point_cloud& cloud, const Crop_box& limits, bool automatic, const Prepare_options& options)
+{
+	const std::size_t n = cloud.size();
+	const std::size_t step = std::max<std::size_t>(1, n / PREPARE_SAMPLE);
+	std::vector<std::size_t> sample;
+	for (std::size_t i = 0; i < n; i += step)
+		sample.push_back(i);
+	const double s = double(std::max<std::size_t>(1, sample.size()));
+	std::vector<Plan_stage> stages (PREPARE_STAGES);
+	for (int k = 0; k < PREPARE_STAGES; k++)
+	{
+		stages[k].name = prepare_stage_name(k);
+		stages[k].cost = -1.0;			// absent
+		stages[k].selectivity = 1.0;
+		stages[k].after = 0;
+	}
+
+	std::size_t kept = 0;
+	for (std::size_t j = 0; j < sample.size(); j++)
+		kept += limits.contains(make_vec3(cloud.x[sample[j]], cloud.y[sample[j]], cloud.z[sample[j]]));
+	stages[PREPARE_CROP].cost = 1e-9 * (PREPARE_NS_CROP + (automatic? PREPARE_NS_AUTO_LIMITS : 0.0));
+	stages[PREPARE_CROP].selectivity = double(kept) / s;
+	if (options.normals > 0)
+		stages[PREPARE_NORMALS].cost = 1e-9 * PREPARE_NS_NORMALS * double(options.normals);
+	if (options.intensity && cloud.has_intensity())
+	{
+		kept = 0;
+		for (std::size_t j = 0; j < sample.size(); j++)
+			kept += cloud.intensity[sample[j]] >= options.intensity_min && cloud.intensity[sample[j]] <= options.intensity_max;
+		stages[PREPARE_INTENSITY].cost = 1e-9 * PREPARE_NS_FILTER;
+		stages[PREPARE_INTENSITY].selectivity = double(kept) / s;
+	}
+	if (options.color && cloud.has_colors())
+	{
+		kept = 0;
+		for (std::size_t j = 0; j < sample.size(); j++)
+			kept += in_color_range(cloud, sample[j], options);
+		stages[PREPARE_COLOR].cost = 1e-9 * PREPARE_NS_FILTER;
+		stages[PREPARE_COLOR].selectivity = double(kept) / s;
+	}
+	if (options.voxel > 0.0)
+	{
+		std::vector<Vec3> points (sample.size());
+		for (std::size_t j = 0; j < sample.size(); j++)
+			points[j] = make_vec3(cloud.x[sample[j]], cloud.y[sample[j]], cloud.z[sample[j]]);
+		const double leaf = options.voxel * std::sqrt(double(step));
+		stages[PREPARE_VOXEL].cost = 1e-9 * PREPARE_NS_VOXEL;
+		stages[PREPARE_VOXEL].selectivity = points.empty()? 1.0 : double(Voxel_grid::count_voxels(points, leaf)) / s;
+		stages[PREPARE_VOXEL].after = (1u << PREPARE_INTENSITY) | (1u << PREPARE_COLOR) | (automatic? 1u << PREPARE_CROP : 0u);
+	}
+	if (automatic)
+		stages[PREPARE_INTENSITY].after = stages[PREPARE_COLOR].after = 1u << PREPARE_CROP;
+	return stages;
+}
+
+// the plans over the stages present only (indices back to Prepare_stage)
+Plan_estimate present_plan (const std::vector<Plan_stage>& stages, double points, bool best)
+{
+	std::vector<Plan_stage> present;
+	std::vector<std::size_t> index;
+	std::vector<int> position (PREPARE_STAGES, -1);
+	for (std::size_t k = 0; k < stages.size(); k++)
+		if (stages[k].cost >= 0.0)
+		{
+			position[k] = int(present.size());
+			present.push_back(stages[k]);
+			index.push_back(k);
+		}
+	for (std::size_t p = 0; p < present.size(); p++)
+	{
+		unsigned after = 0;
+		for (int k = 0; k < PREPARE_STAGES; k++)
+			if ((present[p].after & (1u << k)) && position[k] >= 0)
+				after |= 1u << position[k];
+		present[p].after = after;
+	}
+	std::vector<std::size_t> declared (present.size());
+	for (std::size_t p = 0; p < declared.size(); p++)
+		declared[p] = p;
+	Plan_estimate plan = best? best_plan(present, points) : estimate_plan(present, declared, points);
+	for (std::size_t k = 0; k < plan.order.size(); k++)
+		plan.order[k] = index[plan.order[k]];
+	return plan;
+}
+
+// Run the stages asked by options on cloud in the order of least estimated cost; the crop uses
+// limits, or with automatic the box found inside them (see funcs/auto_limits.hpp)
+Prepare_report prepare_cloud (Point_cloud& cloud, const Crop_box& limits, bool automatic, const Prepare_options& options,
+															const Knn_parameters& knn, std::ostream& log)
+{
+	typedef std::chrono::steady_clock Clock;
+	Prepare_report report;
+	report.box = limits;
+	report.stages = prepare_stages(cloud, limits, automatic, options);
+	report.plan = present_plan(report.stages, double(cloud.size()), true);
+	report.baseline = present_plan(report.stages, double(cloud.size()), false);
+	if (options.intensity && !cloud.has_intensity())
+		log << "The cloud has no intensity: intensity filter left out\n";
+	if (options.color && !cloud.has_colors())
+		log << "The cloud has no colors: color filter left out\n";
+	for (std::size_t k = 0; k < report.plan.order.size(); k++)
+	{
+		Clock::time_point start = Clock::now();
+		report.input.push_back(cloud.size());
+		switch (report.plan.order[k])
+		{
+		case PREPARE_CROP:
+			if (automatic)
+				report.box = auto_limits(positions_of(cloud), limits, Auto_limits_parameters(), log);
+			keep_points(cloud, [&](std::size_t i) { return report.box.contains(make_vec3(cloud.x[i], cloud.y[i], cloud.z[i])); });
+			break;
+		case PREPARE_INTENSITY:
+			keep_points(cloud, [&](std::size_t i) { return cloud.intensity[i] >= options.intensity_min && cloud.intensity[i] <= options.intensity_max; });
+			break;
+		case PREPARE_COLOR:
+			keep_points(cloud, [&](std::size_t i) { return in_color_range(cloud, i, options); });
+			break;
+		case PREPARE_VOXEL:
+			voxel_downsample(cloud, options.voxel);
+			break;
+		case PREPARE_NORMALS:
+		{
+			std::size_t checks;
+			std::vector<Vec3> normals = pca_normals(positions_of(cloud), std::size_t(options.normals), knn, checks);
+			cloud.add_normals();
+			for (std::size_t i = 0; i < normals.size(); i++)
+				cloud.set_normal(i, normals[i]);
+			break;
+		}
+		}
+		report.output.push_back(cloud.size());
+		report.seconds.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+	}
+	return report;
+}
+
+void print_prepare_report (std::ostream& out, const Prepare_report& report)
+{
+	const Plan_estimate& plan = report.plan;
+	double actual = 0.0;
+	for (std::size_t k = 0; k < report.seconds.size(); k++)
+		actual += report.seconds[k];
+	out << "Plan of " << plan.order.size() << " stage(s): estimated " << plan.total << " s, " << report.baseline.total
+			<< " s in the order of pipeline.m; took " << actual << " s\n";
+	for (std::size_t k = 0; k < plan.order.size(); k++)
+		out << "  " << k + 1 << ") " << std::left << std::setw(10) << prepare_stage_name(int(plan.order[k])) << std::right
+				<< "estimated " << std::size_t(plan.input[k] + 0.5) << " -> " << std::size_t(plan.output[k] + 0.5) << " point(s) in "
+				<< plan.seconds[k] << " s, actual " << report.input[k] << " -> " << report.output[k] << " in " << report.seconds[k] << " s\n";
+}
+
+#endif
@@ -0,0 +1,543 @@
+/*
+ * PIPELINE RUN
+ * The iterations of pipeline.m on a cloud already in memory: cut, then for each outer iteration
+ * some outlier removals followed by detection and cleaning. Once an axle cylinder has been found,
+ * each following iteration only works on the points within a few radii from it; when an iteration
+ * finds no cylinder, the margin grows and the next one starts again from the cut cloud.
+ * The numbers of iterations are upper bounds: outlier removal stops when a run removes only a
+ * few points, the outer loop when the axle does not move any more (see funcs/convergence.hpp).
+ * At the end the pose of the axle is computed from the points still in memory (see
+ * funcs/axle_pose.hpp).
+ * With --sort the cut cloud is sorted along a Morton curve, so that the neighbor queries of the
+ * following steps find their points close in memory (the time is counted in the cut).
+ * With --voxel, --normals, --intensity or --color the cut is a plan of preparation stages, run in the
+ * order of least estimated cost (see prepare.hpp).
+ * With --cache the outputs of the cut and of the outlier removals are kept in a stage cache (see
+ * utils/stage_cache.hpp), keyed by the hash of their input cloud and their parameters: a run
+ * that only changes the detection loads them instead of computing them again. The plain crop
+ * costs less than hashing its input, so the cut goes through the cache only with the
+ * preparation stages.
+ * Shared by pipeline (one cloud) and pipeline_batch (many clouds at once): all the messages go
+ * to the given stream, so that runs side by side do not mix their logs.
+ */
+#ifndef PIPELINE_RUN_HPP
+#define PIPELINE_RUN_HPP
+
+#include <CGAL/Real_timer.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "stages.hpp"
+#include "../funcs/axle_pose.hpp"
+#include "../funcs/convergence.hpp"
+#include "../funcs/offset_store.hpp"
+
+struct Pipeline_options
+{
+	bool										verbose;
+	bool										auto_limits;
+	bool										fixed;					// always run all the iterations
+	bool										sort;						// sort the cut cloud along a Morton curve
+	int											outer, inner;		// maximum numbers of iterations
+	double									margin_radii;		// re-cropping margin, in radii of the axle
+	Convergence_parameters	convergence;
+	Knn_parameters					knn;						// of the outlier removal
+	Axle_pose_parameters		pose;
+	Prepare_options					prepare;				// stages run with the crop of the cut
+	std::string							cache_dir;			// of the stage cache, none if empty
+	double									cache_mb;				// its size limit
+	std::shared_ptr<Stage_cache>	cache;		// see open_stage_cache
+
+	Pipeline_options () : verbose(false), auto_limits(false), fixed(false), sort(false), outer(3), inner(3), margin_radii(2.0),
+												cache_mb(2048.0) {}
+};
+
+// Read argv[a] (and its value, if any, advancing a) into options; the option arguments end before
+// argv[last]. False if argv[a] is not a pipeline option or its value is missing or out of range
+bool parse_pipeline_option (char** argv, int& a, int last, Pipeline_options& options)
+{
+	const bool has_value = a + 1 < last;
+	if (strcmp(argv[a], "-v") == 0 || strcmp(argv[a], "--verbose") == 0)
+		options.verbose = true;
+	else if (strcmp(argv[a], "--auto-limits") == 0)
+		options.auto_limits = true;
+	else if (strcmp(argv[a], "--outer") == 0 && has_value && atoi(argv[a + 1]) > 0)
+		options.outer = atoi(argv[++a]);
+	else if (strcmp(argv[a], "--inner") == 0 && has_value && atoi(argv[a + 1]) >= 0)
+		options.inner = atoi(argv[++a]);
+	else if (strcmp(argv[a], "--margin") == 0 && has_value && atof(argv[a + 1]) > 0.0)
+		options.margin_radii = atof(argv[++a]);
+	else if (strcmp(argv[a], "--fixed") == 0)
+		options.fixed = true;
+	else if (strcmp(argv[a], "--sort") == 0)
+		options.sort = true;
+	else if (strcmp(argv[a], "--approx") == 0 && has_value && atof(argv[a + 1]) >= 0.0)
+		options.knn.epsilon = atof(argv[++a]);
+	else if (strcmp(argv[a], "--max-checks") == 0 && has_value && atoi(argv[a + 1]) > 0)
+		options.knn.max_checks = std::size_t(atoi(argv[++a]));
+	else if (strcmp(argv[a], "--removal-ratio") == 0 && has_value && atof(argv[a + 1]) >= 0.0)
+		options.convergence.removal_ratio = atof(argv[++a]);
+	else if (strcmp(argv[a], "--center-tolerance") == 0 && has_value && atof(argv[a + 1]) >= 0.0)
+		options.convergence.center_tolerance = atof(argv[++a]);
+	else if (strcmp(argv[a], "--axis-tolerance") == 0 && has_value && atof(argv[a + 1]) >= 0.0)
+		options.convergence.axis_tolerance = atof(argv[++a]);
+	else if (strcmp(argv[a], "--center") == 0 && has_value && center_estimator_of(argv[a + 1]) < CENTER_ESTIMATORS)
+		options.pose.estimator = center_estimator_of(argv[++a]);
+	else if (strcmp(argv[a], "--trim") == 0 && has_value && atof(argv[a + 1]) >= 0.0 && atof(argv[a + 1]) < 0.5)
+		options.pose.trim = atof(argv[++a]);
+	else if (strcmp(argv[a], "--voxel") == 0 && has_value && atof(argv[a + 1]) > 0.0)
+		options.prepare.voxel = atof(argv[++a]);
+	else if (strcmp(argv[a], "--normals") == 0 && has_value && atoi(argv[a + 1]) >= 3)
+		options.prepare.normals = atoi(argv[++a]);
+	else if (strcmp(argv[a], "--intensity") == 0 && a + 2 < last && atof(argv[a + 1]) <= atof(argv[a + 2]))
+	{
+		options.prepare.intensity = true;
+		options.prepare.intensity_min = float(atof(argv[++a]));
+		options.prepare.intensity_max = float(atof(argv[++a]));
+	}
+	else if (strcmp(argv[a], "--color") == 0 && a + 4 < last && atof(argv[a + 4]) >= 0.0)
+	{
+		options.prepare.color = true;
+		for (int k = 0; k < 3; k++)
+			options.prepare.rgb[k] = atof(argv[++a]);
+		options.prepare.color_tolerance = atof(argv[++a]);
+	}
+	else if (strcmp(argv[a], "--cache") == 0 && has_value)
+		options.cache_dir = argv[++a];
+	else if (strcmp(argv[a], "--cache-size") == 0 && has_value && atof(argv[a + 1]) > 0.0)
+		options.cache_mb = atof(argv[++a]);
+	else
+		return false;
+	return true;
+}
+
+// help lines of the options above
+void print_pipeline_options (std::ostream& out)
+{
+	out << "-v, --verbose\tprint the size of the working set at each step\n";
+	out << "--auto-limits\tcrop to a box found on the cloud, inside the static limits (as cut --auto)\n";
+	out << "--outer\t\tmaximum number of outer iterations, detection included (default 3)\n";
+	out << "--inner\t\tmaximum number of outlier removals in each outer iteration (default 3)\n";
+	out << "--fixed\t\talways run all the iterations\n";
+	out << "--sort\t\tsort the cut cloud along a Morton curve before the neighbor queries of the next steps\n";
+	out << "--approx, --max-checks	let the neighbor searches of the outlier removal stop once the k-th neighbor is within "
+			<< "1 + epsilon of the exact one, or after this many distances (default: exact)\n";
+	out << "--removal-ratio\tstop removing outliers when a run removes less than this fraction "
+			<< "of the points (default 0.01)\n";
+	out << "--center-tolerance, --axis-tolerance\tstop the outer iterations when the center of the cylinder "
+			<< "points moves less than this (default 0.01 m) and the axis turns less than this (default 0.02 rad)\n";
+	out << "--margin\tafter the first axle is found, keep only the points within this many radii "
+			<< "from it (default 2)\n";
+	out << "--center\testimate of the center giving the offset: mean (baricenter of pipeline.m), clipped (default), "
+			<< "trimmed, median or weighted (by the distance from the cylinder); all of them are in the pose\n";
+	out << "--trim\t\tfraction of the values cut at each end by the trimmed mean (default 0.1)\n";
+	out << "--voxel\t\tdownsample to one point per voxel of this side, before the normals\n";
+	out << "--normals\testimate the normals (PCA on this many neighbors) instead of those of the cloud\n";
+	out << "--intensity\tkeep the points with intensity in [min, max] (followed by min and max)\n";
+	out << "--color\t\tkeep the points within a distance of a color (followed by red, green, blue and the distance, 0-255)\n";
+	out << "\t\tthe crop and the stages above run in the order of least estimated cost, printed with their actual cost\n";
+	out << "--cache\t\tdirectory of the stage cache: the cut (with the stages above only) and outlier removal outputs are "
+			<< "loaded from it when the input cloud and the parameters are the same as in a previous run\n";
+	out << "--cache-size\tsize limit of the stage cache in MB, the entries used least recently go first (default 2048)\n";
+}
+
+// The stage cache of --cache, after the options are parsed (pipeline_batch and wheelsetd share it
+// among their runs); false if its directory cannot be created
+bool open_stage_cache (Pipeline_options& options)
+{
+	if (options.cache_dir.empty())
+		return true;
+	options.cache = std::make_shared<Stage_cache>(options.cache_dir, std::uint64_t(options.cache_mb * 1024.0 * 1024.0));
+	return options.cache->ready();
+}
+
+bool ends_with (const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// peak resident memory of the process so far, in MB (0 if unknown)
+double peak_memory_mb ()
+{
+	struct rusage usage;
+	return (getrusage(RUSAGE_SELF, &usage) == 0)? double(usage.ru_maxrss) / 1024.0 : 0.0;
+}
+
+// file name without directory, .ply and the c_ prefix of the clouds with normals
+std::string cloud_name (const std::string& path)
+{
+	std::string name = path.substr(path.find_last_of('/') + 1);
+	if (ends_with(name, ".ply"))
+		name = name.substr(0, name.size() - 4);
+	if (name.compare(0, 2, "c_") == 0 && name.size() > 2)
+		name = name.substr(2);
+	return name;
+}
+
+// configuration key of the offset store: the iterations, as pipeline.m names its .mat files, and
+// the options that change the result (the float kernel too, see utils/kernel.hpp)
+std::string pipeline_config (const Pipeline_options& options)
+{
+	std::ostringstream config;
+	config << "outer" << options.outer << "_inner" << options.inner;
+	if (options.fixed)
+		config << "_fixed";
+	if (options.auto_limits)
+		config << "_auto";
+	if (options.sort)
+		config << "_sorted";
+	if (options.knn.epsilon > 0.0)
+		config << "_approx" << options.knn.epsilon;
+	if (options.knn.max_checks > 0)
+		config << "_checks" << options.knn.max_checks;
+	if (options.margin_radii != 2.0)
+		config << "_margin" << options.margin_radii;
+	if (options.pose.estimator != CENTER_CLIPPED)
+		config << "_" << center_estimator_name(options.pose.estimator);
+	if (options.prepare.voxel > 0.0)
+		config << "_voxel" << options.prepare.voxel;
+	if (options.prepare.normals > 0)
+		config << "_normals" << options.prepare.normals;
+	if (options.prepare.intensity || options.prepare.color)
+		config << "_filtered";
+#ifdef WHEELSET_FLOAT_KERNEL
+	config << "_float";
+#endif
+	return config.str();
+}
+
+// parameters of the cut and of an outlier removal, as the stage cache keys them: whatever changes
+// their output (the limits in full precision)
+std::string cut_parameters (const Crop_box& limits, const Pipeline_options& options)
+{
+	std::ostringstream parameters;
+	parameters << std::setprecision(17) << "box";
+	for (int k = 0; k < 3; k++)
+		parameters << " " << limits.min[k] << " " << limits.max[k];
+	parameters << (options.auto_limits? " auto" : "") << (options.sort? " sorted" : "");
+	const Prepare_options& prepare = options.prepare;
+	if (prepare.active())
+		parameters << " voxel " << prepare.voxel << " normals " << prepare.normals << " approx " << options.knn.epsilon
+							 << " checks " << options.knn.max_checks;
+	if (prepare.intensity)
+		parameters << " intensity " << prepare.intensity_min << " " << prepare.intensity_max;
+	if (prepare.color)
+		parameters << " color " << prepare.rgb[0] << " " << prepare.rgb[1] << " " << prepare.rgb[2] << " " << prepare.color_tolerance;
+	return parameters.str();
+}
+
+std::string outlier_parameters (const Pipeline_options& options)
+{
+	std::ostringstream parameters;
+	parameters << std::setprecision(17) << "inner " << options.inner << (options.fixed? " fixed" : "")
+						 << " ratio " << options.convergence.removal_ratio << " approx " << options.knn.epsilon
+						 << " checks " << options.knn.max_checks << " " << PIPELINE_KERNEL_NAME;
+	return parameters.str();
+}
+
+// seconds spent in each step, summed over the iterations
+struct Pipeline_timings
+{
+	double cut, outliers, detection, pose, total;
+};
+
+struct Pipeline_run
+{
+	Pwn_vector				result;				// points of the accepted cylinders of the last successful detection
+	Crop_box					box;					// the one actually used by the cut
+	std::size_t				cut_size;
+	int								iterations;		// outer iterations run
+	bool							found;
+	Axle_region				axle;
+	Axle_pose					pose;					// of the result, if found
+	Pipeline_timings	seconds;
+};
+
+// what the steps of a run hand to each other: the iterations can be run one at a time, so that
+// the steps of different clouds can overlap (see stream.hpp)
+struct Pipeline_state
+{
+	Pipeline_run	run;
+	Pwn_vector		cut, current, region;
+	double				margin;							// around the axle, in radii
+	Axle_estimate	estimate;
+};
+
+// the cut cloud of input: the crop alone, or the plan of the preparation stages
+void cut_input (const Point_cloud& input, const Crop_box& limits, const Pipeline_options& options, Pipeline_state& state, std::ostream& log)
+{
+	Point_cloud cloud = input;
+	Prepare_report report = prepare_cloud(cloud, limits, options.auto_limits, options.prepare, options.knn, log);
+	print_prepare_report(log, report);
+	state.run.box = report.box;
+	state.cut = points_with_normals(cloud);
+}
+
+void cut_input (const Pwn_vector& input, const Crop_box& limits, const Pipeline_options& options, Pipeline_state& state, std::ostream& log)
+{
+	if (options.prepare.active())
+		return cut_input(point_columns(input), limits, options, state, log);
+	if (options.auto_limits)
+		state.run.box = auto_limits(positions_of(input), limits, Auto_limits_parameters(), log);
+	state.cut = cut_cloud(input, state.run.box);
+}
+
+Cache_key input_key (const Point_cloud& input)	{ return cloud_key(input); }
+Cache_key input_key (const Pwn_vector& input)		{ return cloud_key(point_columns(input)); }
+
+// 1) cut, of a cloud with normals or of the columns read with the attributes of the filters; the
+// state is ready for the first iteration
+template <typename Cloud>
+void pipeline_cut (const Cloud& point_cloud, const Crop_box& limits, const Pipeline_options& options, Pipeline_state& state, std::ostream& log)
+{
+	typedef CGAL::Real_timer Real_timer;
+	Pipeline_run& run = state.run;
+	run.box = limits;
+	run.iterations = 0;
+	run.found = false;
+	run.seconds.cut = run.seconds.outliers = run.seconds.detection = run.seconds.pose = run.seconds.total = 0.0;
+	Real_timer t;
+	t.start();
+	// the key hashes the whole input cloud, a pass slower than the crop alone: only a plan of
+	// preparation stages is worth it. Its time is counted in the cut
+	const bool use_cache = options.cache && options.prepare.active();
+	Cache_key key = 0;
+	bool cached = false;
+	if (use_cache)
+	{
+		key = stage_key(input_key(point_cloud), "cut", cut_parameters(limits, options));
+		Point_cloud columns;
+		std::vector<double> values;
+		cached = options.cache->load("cut", key, columns, values) && values.size() == 6;
+		if (cached)
+		{
+			state.cut = points_with_normals(columns);
+			run.box.min = make_vec3(values[0], values[1], values[2]);
+			run.box.max = make_vec3(values[3], values[4], values[5]);
+		}
+	}
+	const Crop_box& box = run.box;
+	if (!cached)
+	{
+		cut_input(point_cloud, limits, options, state, log);
+		if (options.sort)
+			spatial_sort(state.cut);
+		if (use_cache)
+			options.cache->store("cut", key, point_columns(state.cut),
+														{ box.min[0], box.min[1], box.min[2], box.max[0], box.max[1], box.max[2] });
+	}
+	t.stop();
+	run.cut_size = state.cut.size();
+	run.seconds.cut = t.time();
+	log << "Step 1 - cut: " << state.cut.size() << " point(s) in [" << box.min[0] << ", " << box.max[0] << "] x ["
+			<< box.min[1] << ", " << box.max[1] << "] x [" << box.min[2] << ", " << box.max[2] << "]"
+			<< (options.sort? ", sorted along a Morton curve" : "") << (cached? ", from the cache" : "") << " (" << t.time() << " s)\n";
+	state.current = state.cut;
+	state.margin = options.margin_radii;
+}
+
+// 2) outlier removal of iteration i, on the points around the axle once one has been found
+void pipeline_outliers (Pipeline_state& state, int i, const Pipeline_options& options, std::ostream& log)
+{
+	Pipeline_run& run = state.run;
+	run.iterations = i;
+	if (run.found)
+	{
+		state.region = crop_around_axle(state.current, run.axle, state.margin * run.axle.cylinder.radius);
+		log << "Iteration " << i << ": " << state.region.size() << " of " << state.current.size() << " point(s) within "
+				<< state.margin << " radii from the axle\n";
+	}
+	else
+		state.region = state.current;
+
+	typedef CGAL::Real_timer Real_timer;
+	Real_timer t;
+	t.start();
+	Cache_key key = 0;
+	if (options.cache && options.inner > 0)
+	{
+		Point_cloud columns;
+		key = stage_key(cloud_key(point_columns(state.region)), "outliers", outlier_parameters(options));
+		if (options.cache->load("outliers", key, columns))
+		{
+			const std::size_t before = state.region.size();
+			state.region = points_with_normals(columns);
+			t.stop();
+			run.seconds.outliers += t.time();
+			log << "Step 2." << i << " - outlier removal: " << before - state.region.size() << " point(s) removed, "
+					<< state.region.size() << " left, from the cache (" << t.time() << " s)\n";
+			return;
+		}
+	}
+	t.stop();
+	run.seconds.outliers += t.time();
+
+	// the passes share one neighbor structure
+	double setup;
+	std::vector<Outlier_pass> passes = remove_cloud_outliers_passes(state.region, options.inner,
+		[&](int j, const Outlier_pass& pass)
+		{
+			run.seconds.outliers += pass.seconds;
+			if (options.verbose)
+				log << "Step 2." << i << "." << j << " - outlier removal: " << pass.removed << " point(s) removed, "
+						<< pass.left << " left, " << pass.updated << " neighborhood(s) updated (" << pass.seconds << " s)\n";
+			if (options.fixed || j == options.inner ||
+					!outliers_converged(pass.removed, pass.left + pass.removed, options.convergence))
+				return true;
+			log << "Outlier removal stopped after " << j << " run(s): " << pass.removed << " of "
+					<< pass.left + pass.removed << " point(s) removed, below " << options.convergence.removal_ratio << std::endl;
+			return false;
+		}, setup, options.knn);
+	run.seconds.outliers += setup;
+	if (options.verbose && !passes.empty())
+		log << "Step 2." << i << " - neighborhoods computed in " << setup << " s\n";
+	if (options.cache && options.inner > 0)
+	{
+		t.start();
+		options.cache->store("outliers", key, point_columns(state.region));
+		t.stop();
+		run.seconds.outliers += t.time();
+	}
+}
+
+// 3-4) detection and cleaning of iteration i; false when the outer iterations can stop
+bool pipeline_detection (Pipeline_state& state, int i, const Pipeline_options& options, std::ostream& log)
+{
+	typedef CGAL::Real_timer Real_timer;
+	Pipeline_run& run = state.run;
+	Pwn_vector& region = state.region;
+	Real_timer t;
+	t.start();
+	Cylinder_detection detection = detect_cylinders(region, default_ransac_parameters(region.size()));
+	t.stop();
+	run.seconds.detection += t.time();
+	log << "Step 3." << i << " - detection: " << detection.shapes << " shape(s), " << detection.cylinders
+			<< " accepted cylinder(s), " << detection.cylinder_points.size() << " point(s) kept (" << t.time() << " s)\n";
+	if (!detection.found)
+	{
+		// start again from the cut cloud, looking farther from the last axle (the margin doubles,
+		// up to 8 times)
+		state.current = state.cut;
+		if (run.found)
+		{
+			state.margin = std::min(2.0 * state.margin, 8.0 * options.margin_radii);
+			log << "No cylinder found: margin grows to " << state.margin << " radii\n";
+		}
+		else
+			log << "No cylinder found\n";
+		return true;
+	}
+
+	Axle_estimate previous = state.estimate;
+	state.estimate.center = centroid_of(detection.cylinder_points);
+	state.estimate.axis = detection.axle.cylinder.axis;
+	bool converged = false;
+	if (run.found)
+	{
+		double center_change, axis_change;
+		converged = axle_converged(previous, state.estimate, options.convergence, center_change, axis_change);
+		log << "Axle moved by " << center_change << " m, turned by " << axis_change << " rad\n";
+	}
+	const Axle_region& axle = run.axle = detection.axle;
+	run.found = true;
+	state.margin = options.margin_radii;
+	state.current = detection.cylinder_points;
+	run.result = detection.cylinder_points;
+	if (options.verbose)
+		log << "Axle: point [" << axle.cylinder.point[0] << " " << axle.cylinder.point[1] << " "
+				<< axle.cylinder.point[2] << "] direction [" << axle.cylinder.axis[0] << " " << axle.cylinder.axis[1]
+				<< " " << axle.cylinder.axis[2] << "] radius " << axle.cylinder.radius << std::endl;
+	if (!options.fixed && converged && i < options.outer)
+	{
+		log << "Outer iterations stopped after " << i << ": axle within " << options.convergence.center_tolerance
+				<< " m and " << options.convergence.axis_tolerance << " rad of the previous iteration\n";
+		return false;
+	}
+	return true;
+}
+
+// the outer iterations from first on
+void pipeline_iterations (Pipeline_state& state, int first, const Pipeline_options& options, std::ostream& log)
+{
+	for (int i = first; i <= options.outer; i++)
+	{
+		pipeline_outliers(state, i, options, log);
+		if (!pipeline_detection(state, i, options, log))
+			break;
+	}
+}
+
+// 5) pose of the axle, from the points of the accepted cylinders
+void pipeline_pose (Pipeline_state& state, const Pipeline_options& options, std::ostream& log)
+{
+	typedef CGAL::Real_timer Real_timer;
+	Pipeline_run& run = state.run;
+	if (!run.found)
+		return;
+	Real_timer t;
+	t.start();
+	run.pose = axle_pose(columns_of(run.result), run.axle.cylinder, options.pose);
+	t.stop();
+	run.seconds.pose = t.time();
+	const Axle_pose& pose = run.pose;
+	log << "Step 5 - pose: " << center_estimator_name(pose.estimator) << " center [" << pose.center[0] << " "
+			<< pose.center[1] << " " << pose.center[2] << "] of " << pose.points << " point(s), radius " << pose.radius
+			<< ", offset on X " << pose.offset_x << " (" << t.time() << " s)\n";
+	if (options.verbose)
+		for (int e = 0; e < CENTER_ESTIMATORS; e++)
+			log << "  " << center_estimator_name(e) << " center [" << pose.estimates[e][0] << " " << pose.estimates[e][1]
+					<< " " << pose.estimates[e][2] << "]\n";
+}
+
+template <typename Cloud>
+Pipeline_run run_pipeline (const Cloud& point_cloud, const Crop_box& limits, const Pipeline_options& options, std::ostream& log)
+{
+	typedef CGAL::Real_timer Real_timer;
+	Pipeline_state state;
+	Real_timer total;
+	total.start();
+	pipeline_cut(point_cloud, limits, options, state, log);
+	pipeline_iterations(state, 1, options, log);
+	pipeline_pose(state, options, log);
+	total.stop();
+	state.run.seconds.total = total.time();
+	log << "Elapsed time is " << total.time() << " seconds.\n";
+	return state.run;
+}
+
+// Add the center of a successful run of cloud to the offset store (see funcs/offset_store.hpp)
+// and report the offset of its key
+bool store_offset (	const std::string& file, const std::string& cloud, const Pipeline_options& options,
+										const Pipeline_run& run, std::ostream& log)
+{
+	Offset_record record;
+	const std::string config = pipeline_config(options);
+	if (!offset_key_fits(cloud, config))
+	{
+		log << "ERROR: key " << cloud << " (" << config << ") is longer than the offset store allows (" << OFFSET_CLOUD_SIZE - 1
+				<< " and " << OFFSET_CONFIG_SIZE - 1 << " characters)\n";
+		return false;
+	}
+	if (!append_offset(file, cloud, config, run.pose.center, run.seconds.total, record))
+		return false;
+	const Offset_stats& stats = record.stats;
+	if (!record.accepted)
+		log << "Center of " << cloud << " rejected: it widens the gap on X by " << OFFSET_GAP_LIMIT * 100.0
+				<< " cm or more. Kept old values\n";
+	log << "Offset of " << cloud << " (" << record.config << ") on X: " << stats.mean[0] << " over " << stats.count
+			<< " run(s), gap " << offset_gap(stats, 0) * 100.0 << " cm, standard deviation "
+			<< std::sqrt(offset_variance(stats, 0)) * 100.0 << " cm, average computation time " << stats.seconds_mean << " s\n";
+	return true;
+}
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ * PIPELINE STAGES
+ * The steps of pipeline.m (cut, outlier removal, shape detection and cleaning) as functions working
+ * on a cloud in memory, so that the driver does not write and read a ply file between two steps.
+ * Each one does what the program of the same step does, with the default parameters.
+ */
+#ifndef PIPELINE_STAGES_HPP
+#define PIPELINE_STAGES_HPP
+
+#include <CGAL/property_map.h>
+#include <CGAL/IO/read_ply_points.h>
+#include <CGAL/compute_average_spacing.h>
+#include <CGAL/remove_outliers.h>
+// shape detection
+#include <CGAL/Shape_detection_3.h>
+
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../utils/kernel.hpp"
+#include "../utils/labels.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/ply_cloud.hpp"
+#include "../utils/ply_header.hpp"
+#include "../utils/shm_cloud.hpp"
+#include "../utils/spatial_sort.hpp"
+#include "../utils/stage_cache.hpp"
+#include "../funcs/auto_limits.hpp"
+#include "../funcs/axle_pose.hpp"
+#include "../funcs/axle_region.hpp"
+#include "../funcs/incremental_outliers.hpp"
+#include "prepare.hpp"
+
+// types
+typedef Pipeline_kernel																				Kernel;
+typedef Kernel::FT																						FT;
+typedef Kernel::Point_3																				Point;
+typedef Kernel::Vector_3																			Vector;
+typedef std::pair<Point, Vector>															Point_with_normal;
+typedef std::vector<Point_with_normal>												Pwn_vector;
+typedef CGAL::First_of_pair_property_map<Point_with_normal>		Point_map;
+typedef CGAL::Second_of_pair_property_map<Point_with_normal> 	Normal_map;
+
+typedef CGAL::Shape_detection_3::Shape_detection_traits<Kernel, Pwn_vector, Point_map, Normal_map> Traits;
+typedef CGAL::Shape_detection_3::Efficient_RANSAC<Traits>			Efficient_ransac;
+typedef CGAL::Shape_detection_3::Cylinder<Traits>							Cylinder;
+typedef CGAL::Shape_detection_3::Plane<Traits>								Plane;
+
+// concurrency
+#ifdef CGAL_LINKED_WITH_TBB
+typedef CGAL::Parallel_tag 		Concurrency_tag;
+#else
+typedef CGAL::Sequential_tag	Concurrency_tag;
+#endif
+
+Vec3 to_vec3 (const Point& p)		{ return make_vec3(p.x(), p.y(), p.z()); }
+Vec3 to_vec3 (const Vector& v)	{ return make_vec3(v.x(), v.y(), v.z()); }
+
+std::vector<Vec3> positions_of (const Pwn_vector& point_cloud)
+{
+	std::vector<Vec3> points (point_cloud.size());
+	parallel_for_each_index(points.size(), [&](std::size_t i) { points[i] = to_vec3(point_cloud[i].first); });
+	return points;
+}
+
+// the positions as float columns (see funcs/axle_pose.hpp)
+Point_columns columns_of (const Pwn_vector& point_cloud)
+{
+	Point_columns columns;
+	for (int k = 0; k < 3; k++)
+		columns[k].resize(point_cloud.size());
+	parallel_for_each_index(point_cloud.size(), [&](std::size_t i)
+	{
+		for (int k = 0; k < 3; k++)
+			columns[k][i] = float(point_cloud[i].first[k]);
+	});
+	return columns;
+}
+
+// mean of the positions (the baricenter computed by Matlab on the final cloud)
+Vec3 centroid_of (const Pwn_vector& point_cloud)
+{
+	Vec3 sum = make_vec3(0, 0, 0);
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+		sum = sum + to_vec3(point_cloud[i].first);
+	return (point_cloud.empty())? sum : (1.0 / double(point_cloud.size())) * sum;
+}
+
+// the points of the cloud flagged by keep(position)
+template <typename Predicate>
+Pwn_vector select_points (const Pwn_vector& point_cloud, const Predicate& keep)
+{
+	std::vector<unsigned char> flags (point_cloud.size());
+	parallel_for_each_index(flags.size(), [&](std::size_t i) { flags[i] = keep(to_vec3(point_cloud[i].first)); });
+	std::vector<std::size_t> selected = parallel_select(flags);
+	Pwn_vector result (selected.size());
+	parallel_for_each_index(selected.size(), [&](std::size_t i) { result[i] = point_cloud[selected[i]]; });
+	return result;
+}
+
+// Sort the points along a Morton curve (see utils/spatial_sort.hpp); returns the permutation back
+// to their order: the point now at j was at original[j]
+std::vector<std::size_t> spatial_sort (Pwn_vector& point_cloud)
+{
+	std::vector<std::size_t> original = morton_order(point_cloud.size(), [&point_cloud](std::size_t i)
+	{
+		return to_vec3(point_cloud[i].first);
+	});
+	apply_order(point_cloud, original);
+	return original;
+}
+
+//------------------------------------------------------------------------------------------------
+// input and output
+//------------------------------------------------------------------------------------------------
+// file is a ply file or a shared memory segment (see utils/shm_cloud.hpp); only positions and
+// normals are parsed
+bool read_cloud (const std::string& file, Pwn_vector& point_cloud)
+{
+	Cloud_uri uri = parse_cloud_uri(file);
+	if (uri.shared)
+		return attach_points_with_normals(uri, point_cloud);
+	std::ifstream in (uri.path);
+	return in && read_ply_points_with_normals(in, point_cloud);
+}
+
+// The columns of file with the attributes the filters of prepare look at (see prepare.hpp); the
+// ones the file does not have are left out, so that their filters are too
+bool read_cloud (const std::string& file, Point_cloud& cloud, const Prepare_options& prepare)
+{
+	Cloud_uri uri = parse_cloud_uri(file);
+	if (uri.shared)
+		return attach_cloud(uri.path, cloud, uri.unlink);
+	std::ifstream header (uri.path), colors_header (uri.path);
+	const bool intensity = prepare.intensity && ply_has_property(header, "intensity");
+	const bool colors = prepare.color && ply_has_property(colors_header, "red");
+	std::ifstream in (uri.path);
+	if (!in)
+		return false;
+	if (colors && intensity)
+		return read_ply_cloud<Attrs<XYZ, Normal, RGB, Intensity> >(in, cloud);
+	if (colors)
+		return read_ply_cloud<Attrs<XYZ, Normal, RGB> >(in, cloud);
+	if (intensity)
+		return read_ply_cloud<Attrs<XYZ, Normal, Intensity> >(in, cloud);
+	return read_ply_cloud<Attrs<XYZ, Normal> >(in, cloud);
+}
+
+// two vertices: the lower and the upper corner of the box
+bool read_limits (const std::string& file, Crop_box& box)
+{
+	std::vector<Point> corners;
+	std::ifstream in (file);
+	if (!in || !CGAL::read_ply_points(in, std::back_inserter(corners)) || corners.size() != 2)
+		return false;
+	box.min = to_vec3(corners[0]);
+	box.max = to_vec3(corners[1]);
+	return true;
+}
+
+// positions and normals as float columns, as a shared memory segment or a stage cache entry
+// holds them (see utils/point_cloud.hpp)
+Point_cloud point_columns (const Pwn_vector& point_cloud)
+{
+	Point_cloud columns;
+	columns.add_normals();
+	columns.resize(point_cloud.size());
+	parallel_for_each_index(point_cloud.size(), [&](std::size_t i)
+	{
+		columns.set_position(i, point_cloud[i].first);
+		columns.set_normal(i, point_cloud[i].second);
+	});
+	return columns;
+}
+
+Pwn_vector points_with_normals (const Point_cloud& columns)
+{
+	Pwn_vector point_cloud (columns.size());
+	parallel_for_each_index(columns.size(), [&](std::size_t i)
+	{
+		point_cloud[i] = Point_with_normal(columns.position<Point>(i), columns.normal<Vector>(i));
+	});
+	return point_cloud;
+}
+
+bool write_cloud (const std::string& file, const Pwn_vector& point_cloud)
+{
+	Cloud_uri uri = parse_cloud_uri(file);
+	if (uri.shared)
+		return publish_cloud(uri.path, point_columns(point_cloud));
+	std::ofstream out (uri.path);
+	if (!out)
+		return false;
+	write_ply_header(out, point_cloud.size(), true, false, false);
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+		out << point_cloud[i].first << " " << point_cloud[i].second << std::endl;
+	return bool(out);
+}
+
+//------------------------------------------------------------------------------------------------
+// 1) cut
+//------------------------------------------------------------------------------------------------
+Pwn_vector cut_cloud (const Pwn_vector& point_cloud, const Crop_box& box)
+{
+	return select_points(point_cloud, [&box](const Vec3& p) { return box.contains(p); });
+}
+
+//------------------------------------------------------------------------------------------------
+// 2) outlier removal: same criterion as outliers.cpp, returns the number of points removed
+//------------------------------------------------------------------------------------------------
+std::size_t remove_cloud_outliers (Pwn_vector& point_cloud, unsigned int nb_neighbors = 24, double spacing_factor = 1.5)
+{
+	if (point_cloud.size() <= nb_neighbors)
+		return 0;
+	const double average_spacing = CGAL::compute_average_spacing<Concurrency_tag>(point_cloud, nb_neighbors,
+																																								CGAL::parameters::point_map(Point_map()));
+	Pwn_vector::iterator first_to_remove = CGAL::remove_outliers(	point_cloud, nb_neighbors,
+																																CGAL::parameters::point_map(Point_map()).
+																																threshold_percent(100.).
+																																threshold_distance(spacing_factor * average_spacing));
+	std::size_t removed = std::size_t(std::distance(first_to_remove, point_cloud.end()));
+	point_cloud.erase(first_to_remove, point_cloud.end());
+	return removed;
+}
+
+// Up to passes removals on a single neighbor structure (see funcs/incremental_outliers.hpp): same
+// result as calling remove_cloud_outliers passes times. After each pass go_on(pass, report) tells
+// whether to run another one; the reports of the passes run are returned, setup gets the time
+// spent before the first one. knn lets the neighbor searches stop early (see utils/knn_grid.hpp)
+template <typename Continue>
+std::vector<Outlier_pass> remove_cloud_outliers_passes (Pwn_vector& point_cloud, int passes, const Continue& go_on, double& setup,
+																												const Knn_parameters& knn = Knn_parameters(),
+																												unsigned int nb_neighbors = 24, double spacing_factor = 1.5)
+{
+	std::vector<Outlier_pass> reports;
+	setup = 0.0;
+	if (passes <= 0)
+		return reports;
+	std::vector<Vec3> points = positions_of(point_cloud);
+	Incremental_outliers outliers (points, nb_neighbors, spacing_factor, knn);
+	setup = outliers.setup_seconds();
+	for (int p = 1; p <= passes; p++)
+	{
+		reports.push_back(outliers.pass());
+		if (!go_on(p, reports.back()))
+			break;
+	}
+	std::vector<std::size_t> kept = parallel_select(outliers.kept());
+	Pwn_vector result (kept.size());
+	parallel_for_each_index(kept.size(), [&](std::size_t i) { result[i] = point_cloud[kept[i]]; });
+	point_cloud.swap(result);
+	return reports;
+}
+
+//------------------------------------------------------------------------------------------------
+// 3-4) detection and cleaning: only the points of the accepted cylinders are kept
+//------------------------------------------------------------------------------------------------
+struct Cylinder_detection
+{
+	Pwn_vector		cylinder_points;	// what clear_shape would keep
+	std::size_t		shapes;						// all the shapes found
+	std::size_t		cylinders;				// accepted ones
+	bool					found;
+	Axle_region		axle;							// the accepted cylinder with most points
+};
+
+// default parameters of detect_shapes_ransac
+Efficient_ransac::Parameters default_ransac_parameters (std::size_t cloud_size)
+{
+	Efficient_ransac::Parameters parameters;
+	parameters.probability		 	= 0.01;
+	parameters.min_points 			= std::size_t(2.0 * double(cloud_size) / 100);
+	parameters.epsilon 					= 0.09;
+	parameters.cluster_epsilon	= parameters.epsilon / 2;
+	parameters.normal_threshold = 0.9;
+	return parameters;
+}
+
+Cylinder_detection detect_cylinders (Pwn_vector& point_cloud, const Efficient_ransac::Parameters& parameters)
+{
+	Cylinder_detection result;
+	result.shapes = result.cylinders = 0;
+	result.found = false;
+	Efficient_ransac ransac;
+	ransac.set_input (point_cloud);
+	ransac.add_shape_factory<Plane>();
+	ransac.add_shape_factory<Cylinder>();
+	ransac.detect(parameters);
+
+	std::size_t best_size = 0;
+	Efficient_ransac::Shape_range shapes = ransac.shapes();
+	for (Efficient_ransac::Shape_range::iterator s = shapes.begin(); s != shapes.end(); s++)
+	{
+		result.shapes++;
+		Cylinder* cyl = dynamic_cast<Cylinder*>(s->get());
+		if (cyl == 0)
+			continue;
+		Vector d = cyl->axis().to_vector();
+		if (classify_cylinder(d[1] / std::sqrt(d.squared_length()), cyl->radius()) != CYLIND)
+			continue;
+		result.cylinders++;
+		const std::vector<std::size_t>& indices = (*s)->indices_of_assigned_points();
+		std::vector<Vec3> support (indices.size());
+		for (std::size_t i = 0; i < indices.size(); i++)
+		{
+			result.cylinder_points.push_back(point_cloud[indices[i]]);
+			support[i] = to_vec3(point_cloud[indices[i]].first);
+		}
+		if (indices.size() > best_size)
+		{
+			Fitted_cylinder cylinder;
+			cylinder.point = to_vec3(cyl->axis().point());
+			cylinder.axis = to_vec3(d);
+			cylinder.radius = cyl->radius();
+			result.axle = axle_region_of(cylinder, support);
+			result.found = true;
+			best_size = indices.size();
+		}
+	}
+	return result;
+}
+
+//------------------------------------------------------------------------------------------------
+// re-cropping: the points within margin of the axle found so far
+//------------------------------------------------------------------------------------------------
+Pwn_vector crop_around_axle (const Pwn_vector& point_cloud, const Axle_region& axle, double margin)
+{
+	return select_points(point_cloud, [&axle, margin](const Vec3& p) { return in_axle_region(axle, p, margin); });
+}
+
+#endif
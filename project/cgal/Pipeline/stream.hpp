@@ -0,0 +1,85 @@
+/*
+ * PIPELINE STREAM
+ * Stages of a stream of clouds running side by side, each on its own thread: stage k takes the
+ * clouds from the queue filled by stage k - 1 and hands them to stage k + 1 through another one,
+ * so that a cloud can be read while the previous one is in outlier removal and the one before in
+ * detection. Clouds travel as indexes into an array owned by the caller: a cloud is only touched
+ * by the stage that popped it, the queue hand-over orders the accesses.
+ * Each stage measures the time it works, the time it waits for a cloud (starved) and the time it
+ * waits for room in the next queue (blocked): the bottleneck is the stage that is never starved.
+ */
+#ifndef PIPELINE_STREAM_HPP
+#define PIPELINE_STREAM_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../utils/spsc_queue.hpp"
+
+typedef Spsc_queue<std::size_t>	Stream_queue;
+
+struct Stage_stats
+{
+	std::string		name;
+	std::size_t		items;
+	double				busy, starved, blocked;		// seconds
+
+	Stage_stats (const std::string& n = "") : name(n), items(0), busy(0.0), starved(0.0), blocked(0.0) {}
+};
+
+// Process the clouds arriving from in (0: the clouds 0 .. count - 1, in order) and pass them on to
+// out (0: last stage); out is closed when in is drained
+template <typename Work>
+void run_stage (Stream_queue* in, std::size_t count, Stream_queue* out, Stage_stats& stats, Work work)
+{
+	typedef std::chrono::steady_clock clock;
+	clock::time_point t = clock::now();
+	std::size_t index = 0;
+	for (std::size_t k = 0; in? in->pop(index) : k < count; k++)
+	{
+		if (!in)
+			index = k;
+		clock::time_point popped = clock::now();
+		stats.starved += std::chrono::duration<double>(popped - t).count();
+		work(index);
+		clock::time_point done = clock::now();
+		stats.busy += std::chrono::duration<double>(done - popped).count();
+		stats.items++;
+		if (out)
+			out->push(index);
+		t = clock::now();
+		stats.blocked += std::chrono::duration<double>(t - done).count();
+	}
+	if (out)
+		out->close();
+}
+
+// one line per stage and per queue; wall is the time of the whole stream
+void print_occupancy (	std::ostream& out, const std::vector<Stage_stats>& stages,
+												const std::vector<std::unique_ptr<Stream_queue> >& queues, double wall)
+{
+	std::size_t bottleneck = 0;
+	out << "Stage occupancy over " << wall << " s (busy / starved / blocked):\n";
+	for (std::size_t s = 0; s < stages.size(); s++)
+	{
+		const Stage_stats& stage = stages[s];
+		out << "  " << stage.name << ": " << stage.items << " cloud(s), " << stage.busy << " s busy ("
+				<< 100.0 * stage.busy / std::max(wall, 1e-9) << " %), " << stage.starved << " s starved, "
+				<< stage.blocked << " s blocked\n";
+		if (s < queues.size())
+			out << "    -> queue: " << queues[s]->mean_occupancy() << " of " << queues[s]->capacity()
+					<< " cloud(s) waiting on average, full at " << queues[s]->found_full() << " of "
+					<< queues[s]->pushed() << " push(es)\n";
+		if (stage.busy > stages[bottleneck].busy)
+			bottleneck = s;
+	}
+	if (!stages.empty())
+		out << "Bottleneck: " << stages[bottleneck].name << std::endl;
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * AUTOMATIC CUT LIMITS
+ * The static limits of cut are deliberately loose. Here a tighter box is derived from the cloud
+ * itself, looking at how the points are spread along each axis (occupancy histograms):
+ * - along Z the dense bands are found; the one holding most points is the axle (with the wheels
+ *   around it), a band below it is the rail, which the box must not reach;
+ * - along X and Y only the points at axle height are counted: on X the box takes the densest
+ *   band (the axle body), on Y the whole occupied span (the axle goes from wheel to wheel).
+ * Each side gets a safety margin, and the static limits stay the outer bounds of the box.
+ */
+#ifndef AUTO_LIMITS_HPP
+#define AUTO_LIMITS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/parallel.hpp"
+
+struct Crop_box
+{
+	Vec3 min, max;
+
+	bool contains (const Vec3& p) const
+	{
+		return p[0] >= min[0] && p[0] <= max[0] && p[1] >= min[1] && p[1] <= max[1] && p[2] >= min[2] && p[2] <= max[2];
+	}
+};
+
+struct Auto_limits_parameters
+{
+	double			bin;				// histogram resolution
+	double			density;		// a bin belongs to a band if it holds this fraction of the densest one
+	std::size_t	smoothing;	// half width (in bins) of the moving average applied before
+	double			margin;			// added on each side of the bands
+
+	Auto_limits_parameters () : bin(0.02), density(0.05), smoothing(1), margin(0.05) {}
+};
+
+// contiguous bins [begin, end) above the density threshold, and the points they hold
+struct Histogram_band
+{
+	std::size_t begin, end, mass;
+};
+
+// Points of the selected ones falling in each bin of width bin from lo along axis; each block of
+// points fills its own histogram, the histograms are summed at the end
+std::vector<std::size_t> occupancy_histogram (const std::vector<Vec3>& points, const std::vector<unsigned char>& selected,
+																							int axis, double lo, double bin, std::size_t bins)
+{
+	const std::size_t	n = points.size();
+	const std::size_t	block = 1 << 14;
+	const std::size_t	nb_blocks = (n + block - 1) / block;
+	std::vector<std::vector<std::size_t> > partial (nb_blocks);
+	parallel_for_each_index(nb_blocks, [&](std::size_t b)
+	{
+		std::vector<std::size_t>& h = partial[b];
+		h.assign(bins, 0);
+		for (std::size_t i = b * block; i < n && i < (b + 1) * block; ++i)
+			if (selected[i])
+			{
+				double x = (points[i][axis] - lo) / bin;
+				if (x >= 0.0)
+					h[std::min(bins - 1, std::size_t(x))]++;
+			}
+	});
+	std::vector<std::size_t> histogram (bins, 0);
+	for (std::size_t b = 0; b < nb_blocks; ++b)
+		for (std::size_t k = 0; k < bins; ++k)
+			histogram[k] += partial[b][k];
+	return histogram;
+}
+
+// dense bands of the histogram, from the lowest one up
+std::vector<Histogram_band> histogram_bands (const std::vector<std::size_t>& histogram, const Auto_limits_parameters& parameters)
+{
+	const std::size_t bins = histogram.size();
+	std::vector<double> smooth (bins, 0.0);
+	double peak = 0.0;
+	for (std::size_t k = 0; k < bins; k++)
+	{
+		std::size_t from = (k >= parameters.smoothing)? k - parameters.smoothing : 0;
+		std::size_t to = std::min(bins - 1, k + parameters.smoothing);
+		for (std::size_t j = from; j <= to; j++)
+			smooth[k] += double(histogram[j]);
+		smooth[k] /= double(to - from + 1);
+		peak = std::max(peak, smooth[k]);
+	}
+	std::vector<Histogram_band> bands;
+	for (std::size_t k = 0; k < bins; )
+	{
+		if (peak == 0.0 || smooth[k] < parameters.density * peak)
+		{
+			k++;
+			continue;
+		}
+		Histogram_band band = { k, k, 0 };
+		while (band.end < bins && smooth[band.end] >= parameters.density * peak)
+			band.mass += histogram[band.end++];
+		bands.push_back(band);
+		k = band.end;
+	}
+	return bands;
+}
+
+// the band holding most points
+std::size_t heaviest_band (const std::vector<Histogram_band>& bands)
+{
+	std::size_t best = 0;
+	for (std::size_t b = 1; b < bands.size(); b++)
+		if (bands[b].mass > bands[best].mass)
+			best = b;
+	return best;
+}
+
+// Tighter box inside outer; log receives a description of the bands chosen. If some axis has no
+// dense band (e.g. no point inside outer) the outer limits are kept on it
+Crop_box auto_limits (const std::vector<Vec3>& points, const Crop_box& outer, const Auto_limits_parameters& parameters,
+											std::ostream& log)
+{
+	const std::size_t n = points.size();
+	Crop_box box = outer;
+	std::vector<unsigned char> selected (n);
+	parallel_for_each_index(n, [&](std::size_t i) { selected[i] = outer.contains(points[i]); });
+
+	// histograms cover the points inside the outer box, not the whole outer box (X is +-100 m)
+	Vec3 lo = outer.max, hi = outer.min;
+	for (std::size_t i = 0; i < n; i++)
+		if (selected[i])
+			for (int k = 0; k < 3; k++)
+			{
+				lo[k] = std::min(lo[k], points[i][k]);
+				hi[k] = std::max(hi[k], points[i][k]);
+			}
+	if (lo[0] > hi[0])
+	{
+		log << "no point inside the static limits\n";
+		return box;
+	}
+	std::size_t bins[3];
+	for (int k = 0; k < 3; k++)
+		bins[k] = std::size_t((hi[k] - lo[k]) / parameters.bin) + 1;
+
+	// height: axle band, not below the rail band
+	std::vector<Histogram_band> z_bands = histogram_bands(occupancy_histogram(points, selected, 2, lo[2], parameters.bin, bins[2]),
+																												parameters);
+	if (!z_bands.empty())
+	{
+		std::size_t axle = heaviest_band(z_bands);
+		box.min[2] = lo[2] + double(z_bands[axle].begin) * parameters.bin - parameters.margin;
+		box.max[2] = lo[2] + double(z_bands[axle].end) * parameters.bin + parameters.margin;
+		log << "axle band on z: [" << lo[2] + double(z_bands[axle].begin) * parameters.bin << ", "
+				<< lo[2] + double(z_bands[axle].end) * parameters.bin << "] with " << z_bands[axle].mass << " point(s)\n";
+		if (axle > 0)
+		{
+			double rail_top = lo[2] + double(z_bands[axle - 1].end) * parameters.bin;
+			box.min[2] = std::max(box.min[2], rail_top);
+			log << "rail band on z: [" << lo[2] + double(z_bands[axle - 1].begin) * parameters.bin << ", " << rail_top
+					<< "] with " << z_bands[axle - 1].mass << " point(s)\n";
+		}
+		parallel_for_each_index(n, [&](std::size_t i)
+		{
+			selected[i] = selected[i] && points[i][2] >= box.min[2] && points[i][2] <= box.max[2];
+		});
+	}
+
+	// along the track: the axle body; across it: from wheel to wheel
+	std::vector<Histogram_band> x_bands = histogram_bands(occupancy_histogram(points, selected, 0, lo[0], parameters.bin, bins[0]),
+																												parameters);
+	if (!x_bands.empty())
+	{
+		std::size_t body = heaviest_band(x_bands);
+		box.min[0] = lo[0] + double(x_bands[body].begin) * parameters.bin - parameters.margin;
+		box.max[0] = lo[0] + double(x_bands[body].end) * parameters.bin + parameters.margin;
+	}
+	std::vector<Histogram_band> y_bands = histogram_bands(occupancy_histogram(points, selected, 1, lo[1], parameters.bin, bins[1]),
+																												parameters);
+	if (!y_bands.empty())
+	{
+		box.min[1] = lo[1] + double(y_bands.front().begin) * parameters.bin - parameters.margin;
+		box.max[1] = lo[1] + double(y_bands.back().end) * parameters.bin + parameters.margin;
+	}
+
+	// never outside the static limits
+	for (int k = 0; k < 3; k++)
+	{
+		box.min[k] = std::max(box.min[k], outer.min[k]);
+		box.max[k] = std::min(box.max[k], outer.max[k]);
+	}
+	return box;
+}
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * AXLE POSE
+ * What pipeline.m computes at the end (baricenter of the cleardetect cloud, its X coordinate as
+ * the offset), from the points still in memory: a few parallel passes over float columns instead
+ * of reading the ply file back. The baricenter is skewed by the wheel and brake points the
+ * detector leaves on the cylinder, so the pose carries several estimates of the center:
+ * - mean: the baricenter of pipeline.m;
+ * - clipped: mean of the points within clip_sigmas standard deviations on every coordinate;
+ * - trimmed: on each coordinate, mean of the values between the trim and 1 - trim quantiles;
+ * - median: coordinate-wise median;
+ * - weighted: each point weighs 1 / (1 + (e / s)^2), e being its distance from the surface of the
+ *   cylinder and s the mean of those distances, so that points off the cylinder barely count.
+ * The quantiles are parallel selections (parallel_nth_value), all the rest parallel reductions.
+ * The estimator chosen by the parameters gives the center and the offset. The axis comes from the
+ * detected cylinder; the radius is the mean distance from it of the points within the clipping.
+ * The pose is saved as a one line JSON object or as a fixed size binary record (.bin).
+ */
+#ifndef AXLE_POSE_HPP
+#define AXLE_POSE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/parallel.hpp"
+
+// x, y and z of the points
+typedef std::array<std::vector<float>, 3>	Point_columns;
+
+enum Center_estimator { CENTER_MEAN, CENTER_CLIPPED, CENTER_TRIMMED, CENTER_MEDIAN, CENTER_WEIGHTED, CENTER_ESTIMATORS };
+
+const char* center_estimator_name (int estimator)
+{
+	static const char* names[CENTER_ESTIMATORS] = { "mean", "clipped", "trimmed", "median", "weighted" };
+	return names[estimator];
+}
+
+// CENTER_ESTIMATORS if name is not an estimator
+int center_estimator_of (const std::string& name)
+{
+	int e = 0;
+	while (e < CENTER_ESTIMATORS && name != center_estimator_name(e))
+		e++;
+	return e;
+}
+
+struct Axle_pose_parameters
+{
+	int			estimator;
+	double	clip_sigmas;
+	double	trim;									// fraction cut at each end
+
+	Axle_pose_parameters () : estimator(CENTER_CLIPPED), clip_sigmas(3.0), trim(0.1) {}
+};
+
+struct Axle_pose
+{
+	std::size_t	points, inliers;						// cylinder points, the ones within the clipping
+	int					estimator;
+	Vec3				center;											// estimates[estimator]
+	Vec3				estimates[CENTER_ESTIMATORS];
+	Vec3				point, axis;								// point of the axis closest to the center, unit direction
+	double			radius;
+	double			offset_x;										// center[0], the offset pipeline.m publishes
+};
+
+// sums of a reduction over the points
+struct Pose_sums
+{
+	Vec3				sum, squares;
+	std::size_t	count;
+	double			weight, distance;
+};
+
+Pose_sums no_pose_sums ()
+{
+	Pose_sums s;
+	s.sum = s.squares = make_vec3(0, 0, 0);
+	s.count = 0;
+	s.weight = s.distance = 0.0;
+	return s;
+}
+
+void merge_pose_sums (Pose_sums& a, const Pose_sums& b)
+{
+	a.sum = a.sum + b.sum;
+	a.squares = a.squares + b.squares;
+	a.count += b.count;
+	a.weight += b.weight;
+	a.distance += b.distance;
+}
+
+Vec3 point_at (const Point_columns& c, std::size_t i)	{ return make_vec3(c[0][i], c[1][i], c[2][i]); }
+
+// distance of p from the axis of the cylinder
+double axis_distance (const Vec3& p, const Fitted_cylinder& cylinder)
+{
+	const Vec3 r = p - cylinder.point;
+	return length(r - dot(r, cylinder.axis) * cylinder.axis);
+}
+
+// one pass
+Vec3 mean_center (const Point_columns& c)
+{
+	const std::size_t n = c[0].size();
+	Pose_sums all = parallel_reduce_index(n, no_pose_sums(),
+		[&](Pose_sums& s, std::size_t i) { s.sum = s.sum + point_at(c, i); s.count++; }, merge_pose_sums);
+	return (n > 0)? (1.0 / double(n)) * all.sum : all.sum;
+}
+
+// two passes: mean and standard deviation of each coordinate, then mean within the clipping;
+// inliers gets how many points it kept and radius their mean distance from the axis
+Vec3 clipped_center (const Point_columns& c, const Fitted_cylinder& cylinder, double sigmas, std::size_t& inliers, double& radius)
+{
+	const std::size_t n = c[0].size();
+	Pose_sums all = parallel_reduce_index(n, no_pose_sums(),
+		[&](Pose_sums& s, std::size_t i)
+		{
+			const Vec3 p = point_at(c, i);
+			s.sum = s.sum + p;
+			s.squares = s.squares + make_vec3(p[0] * p[0], p[1] * p[1], p[2] * p[2]);
+			s.count++;
+		}, merge_pose_sums);
+	Vec3 mean = make_vec3(0, 0, 0), sigma = make_vec3(0, 0, 0);
+	if (n > 0)
+	{
+		mean = (1.0 / double(n)) * all.sum;
+		for (int k = 0; k < 3; k++)
+			sigma[k] = std::sqrt(std::max(0.0, all.squares[k] / double(n) - mean[k] * mean[k]));
+	}
+	const Vec3 limit = sigmas * sigma;
+	Pose_sums kept = parallel_reduce_index(n, no_pose_sums(),
+		[&](Pose_sums& s, std::size_t i)
+		{
+			const Vec3 p = point_at(c, i);
+			const Vec3 d = p - mean;
+			if (std::fabs(d[0]) > limit[0] || std::fabs(d[1]) > limit[1] || std::fabs(d[2]) > limit[2])
+				return;
+			s.sum = s.sum + p;
+			s.distance += axis_distance(p, cylinder);
+			s.count++;
+		}, merge_pose_sums);
+	inliers = kept.count;
+	radius = (kept.count > 0)? kept.distance / double(kept.count) : cylinder.radius;
+	return (kept.count > 0)? (1.0 / double(kept.count)) * kept.sum : mean;
+}
+
+// per coordinate: two selections, then one pass
+Vec3 trimmed_center (const Point_columns& c, double trim)
+{
+	const std::size_t n = c[0].size();
+	Vec3 center = make_vec3(0, 0, 0);
+	if (n == 0)
+		return center;
+	const std::size_t cut = std::min(std::size_t(trim * double(n)), (n - 1) / 2);
+	for (int k = 0; k < 3; k++)
+	{
+		const std::vector<float>& v = c[k];
+		const float low = parallel_nth_value(v, cut), high = parallel_nth_value(v, n - 1 - cut);
+		Pose_sums kept = parallel_reduce_index(n, no_pose_sums(),
+			[&](Pose_sums& s, std::size_t i)
+			{
+				if (v[i] >= low && v[i] <= high)
+				{
+					s.weight += v[i];
+					s.count++;
+				}
+			}, merge_pose_sums);
+		center[k] = kept.weight / double(kept.count);
+	}
+	return center;
+}
+
+// per coordinate: one selection
+Vec3 median_center (const Point_columns& c)
+{
+	const std::size_t n = c[0].size();
+	return make_vec3(parallel_nth_value(c[0], n / 2), parallel_nth_value(c[1], n / 2), parallel_nth_value(c[2], n / 2));
+}
+
+// two passes: scale of the distances from the surface, then weighted mean
+Vec3 weighted_center (const Point_columns& c, const Fitted_cylinder& cylinder)
+{
+	const std::size_t n = c[0].size();
+	Pose_sums residuals = parallel_reduce_index(n, no_pose_sums(),
+		[&](Pose_sums& s, std::size_t i) { s.distance += std::fabs(axis_distance(point_at(c, i), cylinder) - cylinder.radius); },
+		merge_pose_sums);
+	const double scale = std::max(1e-6, residuals.distance / double(std::max<std::size_t>(1, n)));
+	Pose_sums weighted = parallel_reduce_index(n, no_pose_sums(),
+		[&](Pose_sums& s, std::size_t i)
+		{
+			const Vec3 p = point_at(c, i);
+			const double e = (axis_distance(p, cylinder) - cylinder.radius) / scale;
+			const double w = 1.0 / (1.0 + e * e);
+			s.sum = s.sum + w * p;
+			s.weight += w;
+		}, merge_pose_sums);
+	return (weighted.weight > 0.0)? (1.0 / weighted.weight) * weighted.sum : weighted.sum;
+}
+
+// Pose of the axle supported by the points; cylinder is the one found by the detection
+Axle_pose axle_pose (	const Point_columns& points, const Fitted_cylinder& cylinder,
+											const Axle_pose_parameters& parameters = Axle_pose_parameters())
+{
+	Axle_pose pose;
+	pose.points = points[0].size();
+	pose.estimator = parameters.estimator;
+	pose.axis = normalized(cylinder.axis);
+	// the direction of an axis has no sign: the same axle gives the same record on every run
+	int largest = 0;
+	for (int k = 1; k < 3; k++)
+		if (std::fabs(pose.axis[k]) > std::fabs(pose.axis[largest]))
+			largest = k;
+	if (pose.axis[largest] < 0.0)
+		pose.axis = -1.0 * pose.axis;
+	Fitted_cylinder axle = cylinder;
+	axle.axis = pose.axis;
+
+	pose.estimates[CENTER_MEAN] = mean_center(points);
+	pose.estimates[CENTER_CLIPPED] = clipped_center(points, axle, parameters.clip_sigmas, pose.inliers, pose.radius);
+	pose.estimates[CENTER_TRIMMED] = trimmed_center(points, parameters.trim);
+	pose.estimates[CENTER_MEDIAN] = median_center(points);
+	pose.estimates[CENTER_WEIGHTED] = weighted_center(points, axle);
+	pose.center = pose.estimates[pose.estimator];
+	pose.point = axle.point + dot(pose.center - axle.point, pose.axis) * pose.axis;
+	pose.offset_x = pose.center[0];
+	return pose;
+}
+
+// fixed size binary form; both ends on the same machine, no byte swapping
+#define AXLE_POSE_MAGIC	0x32505357u		// "WSP2"
+
+struct Axle_pose_record
+{
+	std::uint32_t	magic;
+	std::uint32_t	estimator;							// Center_estimator of center
+	std::uint64_t	points, inliers;
+	double				center[3], point[3], axis[3];
+	double				radius, offset_x;
+	double				estimates[CENTER_ESTIMATORS][3];
+};
+
+Axle_pose_record pose_record (const Axle_pose& pose)
+{
+	Axle_pose_record record;
+	std::memset(&record, 0, sizeof(record));
+	record.magic = AXLE_POSE_MAGIC;
+	record.estimator = std::uint32_t(pose.estimator);
+	record.points = pose.points;
+	record.inliers = pose.inliers;
+	for (int k = 0; k < 3; k++)
+	{
+		record.center[k] = pose.center[k];
+		record.point[k] = pose.point[k];
+		record.axis[k] = pose.axis[k];
+		for (int e = 0; e < CENTER_ESTIMATORS; e++)
+			record.estimates[e][k] = pose.estimates[e][k];
+	}
+	record.radius = pose.radius;
+	record.offset_x = pose.offset_x;
+	return record;
+}
+
+void write_pose_json (std::ostream& out, const std::string& cloud, const Axle_pose& pose)
+{
+	const std::streamsize precision = out.precision(9);
+	out << "{\"cloud\":\"" << cloud << "\",\"points\":" << pose.points << ",\"inliers\":" << pose.inliers
+			<< ",\"center\":[" << pose.center[0] << "," << pose.center[1] << "," << pose.center[2]
+			<< "],\"point\":[" << pose.point[0] << "," << pose.point[1] << "," << pose.point[2]
+			<< "],\"axis\":[" << pose.axis[0] << "," << pose.axis[1] << "," << pose.axis[2]
+			<< "],\"radius\":" << pose.radius << ",\"offset_x\":" << pose.offset_x
+			<< ",\"estimator\":\"" << center_estimator_name(pose.estimator) << "\"";
+	for (int e = 0; e < CENTER_ESTIMATORS; e++)
+		out << ",\"" << center_estimator_name(e) << "\":[" << pose.estimates[e][0] << "," << pose.estimates[e][1] << ","
+				<< pose.estimates[e][2] << "]";
+	out << "}\n";
+	out.precision(precision);
+}
+
+// JSON, or the binary record if file ends with .bin
+bool write_pose (const std::string& file, const std::string& cloud, const Axle_pose& pose)
+{
+	const bool binary = file.size() >= 4 && file.compare(file.size() - 4, 4, ".bin") == 0;
+	std::ofstream out (file, binary? std::ios::binary : std::ios::out);
+	if (!out)
+		return false;
+	if (binary)
+	{
+		Axle_pose_record record = pose_record(pose);
+		out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+	}
+	else
+		write_pose_json(out, cloud, pose);
+	return bool(out);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * AXLE REGION
+ * Once an axle cylinder has been found, only the points around it matter: the region is the
+ * cylinder grown by a margin, radially and past both ends of the points that support it.
+ */
+#ifndef AXLE_REGION_HPP
+#define AXLE_REGION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+
+// the cylinder and the extent of its points along the axis (measured from cylinder.point)
+struct Axle_region
+{
+	Fitted_cylinder	cylinder;
+	double					t_min, t_max;
+};
+
+// region of the cylinder supported by the given points
+Axle_region axle_region_of (const Fitted_cylinder& cylinder, const std::vector<Vec3>& points)
+{
+	Axle_region region;
+	region.cylinder = cylinder;
+	region.cylinder.axis = normalized(cylinder.axis);
+	region.t_min = std::numeric_limits<double>::max();
+	region.t_max = -std::numeric_limits<double>::max();
+	for (std::size_t i = 0; i < points.size(); i++)
+	{
+		double t = dot(points[i] - region.cylinder.point, region.cylinder.axis);
+		region.t_min = std::min(region.t_min, t);
+		region.t_max = std::max(region.t_max, t);
+	}
+	if (points.empty())
+		region.t_min = region.t_max = 0.0;
+	return region;
+}
+
+// whether p is within margin from the cylinder of the region
+bool in_axle_region (const Axle_region& region, const Vec3& p, double margin)
+{
+	Vec3 d = p - region.cylinder.point;
+	double t = dot(d, region.cylinder.axis);
+	if (t < region.t_min - margin || t > region.t_max + margin)
+		return false;
+	double r = region.cylinder.radius + margin;
+	return squared_length(d - t * region.cylinder.axis) <= r * r;
+}
+
+#endif
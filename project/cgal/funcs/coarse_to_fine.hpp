@@ -0,0 +1,111 @@
+/*
+ * COARSE TO FINE SHAPE REFINEMENT
+ * Shapes detected on a downsampled cloud are brought back to the full resolution cloud: each
+ * shape is fitted again on the points within a thin shell around its coarse surface, and then
+ * on the ones within epsilon of the refined surface (with a compatible normal). Shapes are refined
+ * in the order they were detected and a point already taken by a shape is not given to another;
+ * a shape left with fewer than min_points points is dropped and its points stay free.
+ * The full resolution cloud is scanned once per shape: the free points within shell + epsilon of
+ * the coarse surface are the candidates, and every fit selects among them only.
+ */
+#ifndef COARSE_TO_FINE_HPP
+#define COARSE_TO_FINE_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/labels.hpp"
+#include "../utils/parallel.hpp"
+
+// kind is PLANE or one of the cylinder kinds (CYLIND, WRNGAX, BIGCYL)
+struct Coarse_shape
+{
+	Shape_kind				kind;
+	Fitted_plane			plane;
+	Fitted_cylinder		cylinder;
+};
+
+struct Refinement_parameters
+{
+	double			epsilon;
+	double			normal_threshold;
+	double			shell;				// half width of the band searched around the coarse surface
+	int					rounds;				// fits on the full resolution points
+	std::size_t	min_points;		// of a refined shape, as the detection on the full resolution cloud
+
+	Refinement_parameters () : epsilon(0.09), normal_threshold(0.9), shell(0.1), rounds(3), min_points(1) {}
+};
+
+// whether p is within distance from the surface of the shape, with its normal n agreeing
+bool near_shape (	const Coarse_shape& shape, const Vec3& p, const Vec3& n, double distance, double normal_threshold)
+{
+	if (shape.kind == PLANE)
+		return std::fabs(dot(p - shape.plane.point, shape.plane.normal)) <= distance
+				&& std::fabs(dot(n, shape.plane.normal)) >= normal_threshold;
+	Vec3 radial;
+	double d = distance_to_axis(shape.cylinder, p, radial);
+	return std::fabs(d - shape.cylinder.radius) <= distance && std::fabs(dot(n, radial)) >= normal_threshold;
+}
+
+// Label the full resolution points (kinds and ids must have one slot per point, UNDEF / -1 if
+// free); refined gets the shapes fitted again, cylinders classified again on their new axis
+void refine_shapes (const std::vector<Vec3>& points, const std::vector<Vec3>& normals,
+										const std::vector<Coarse_shape>& shapes, const Refinement_parameters& parameters,
+										std::vector<Shape_kind>& kinds, std::vector<Shape_id>& ids, std::vector<Coarse_shape>& refined)
+{
+	Shape_id planes = 0, cylinders = 0;
+	std::vector<unsigned char> flags (points.size());
+	refined.clear();
+	for (std::size_t s = 0; s < shapes.size(); s++)
+	{
+		// free points near the coarse surface, whatever their normal: a refined surface drifting
+		// less than shell from the coarse one finds all its epsilon band among them
+		Coarse_shape shape = shapes[s];
+		parallel_for_each_index(points.size(), [&](std::size_t i)
+		{
+			flags[i] = kinds[i] == UNDEF && near_shape(shape, points[i], normals[i], parameters.shell + parameters.epsilon, 0.0);
+		});
+		const std::vector<std::size_t> candidates = parallel_select(flags);
+
+		// the candidates in the shell around the coarse surface, then fit on them and take
+		// the candidates within epsilon of the new surface, a few times
+		std::vector<unsigned char> near (candidates.size());
+		std::vector<std::size_t> inliers;
+		for (int r = 0; r <= parameters.rounds; r++)
+		{
+			if (r > 0 && !((shape.kind == PLANE)? fit_plane(points, inliers, shape.plane)
+																				 : fit_cylinder(points, normals, inliers, shape.cylinder)))
+				break;
+			const double distance = (r == 0)? parameters.shell : parameters.epsilon;
+			parallel_for_each_index(candidates.size(), [&](std::size_t c)
+			{
+				const std::size_t i = candidates[c];
+				near[c] = near_shape(shape, points[i], normals[i], distance, parameters.normal_threshold);
+			});
+			inliers = parallel_select(near);
+			for (std::size_t k = 0; k < inliers.size(); k++)
+				inliers[k] = candidates[inliers[k]];
+		}
+		if (inliers.empty() || inliers.size() < parameters.min_points)
+			continue;
+
+		Shape_id id;
+		if (shape.kind == PLANE)
+			id = planes++;
+		else
+		{
+			shape.kind = classify_cylinder(shape.cylinder.axis[1], shape.cylinder.radius);
+			id = cylinders++;
+		}
+		for (std::size_t i = 0; i < inliers.size(); i++)
+		{
+			kinds[inliers[i]] = shape.kind;
+			ids[inliers[i]] = id;
+		}
+		refined.push_back(shape);
+	}
+}
+
+#endif
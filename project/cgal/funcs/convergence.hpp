@@ -0,0 +1,47 @@
+/*
+ * CONVERGENCE OF THE PIPELINE ITERATIONS
+ * Instead of a fixed number of iterations, the pipeline stops repeating a step when one more
+ * run would not change much: outlier removal once a run removes only a small fraction of the
+ * points, the whole detection once the axle stays put between two iterations.
+ */
+#ifndef CONVERGENCE_HPP
+#define CONVERGENCE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "../utils/geometry.hpp"
+
+struct Convergence_parameters
+{
+	double	removal_ratio;			// inner: stop below this fraction of points removed
+	double	center_tolerance;		// outer: stop when the center moves less than this (m)...
+	double	axis_tolerance;			// ...and the axis turns less than this (rad)
+
+	Convergence_parameters () : removal_ratio(0.01), center_tolerance(0.01), axis_tolerance(0.02) {}
+};
+
+// what the outer iterations compare: center of the cylinder points and axis direction
+struct Axle_estimate
+{
+	Vec3	center, axis;
+};
+
+// the last outlier removal took away removed points out of before
+bool outliers_converged (std::size_t removed, std::size_t before, const Convergence_parameters& parameters)
+{
+	return before == 0 || double(removed) < parameters.removal_ratio * double(before);
+}
+
+// Movement of the axle between two iterations; axes are compared without their orientation
+bool axle_converged (	const Axle_estimate& previous, const Axle_estimate& current, const Convergence_parameters& parameters,
+											double& center_change, double& axis_change)
+{
+	center_change = length(current.center - previous.center);
+	double c = std::fabs(dot(normalized(current.axis), normalized(previous.axis)));
+	axis_change = std::acos(std::min(1.0, c));
+	return center_change < parameters.center_tolerance && axis_change < parameters.axis_tolerance;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * EUCLIDEAN CLUSTERING
+ * Connected components of the radius graph: two points are in the same cluster if a chain of
+ * points closer than radius joins them. Each point looks for its neighbors in a uniform grid
+ * and merges with them in a lock-free union-find, so the whole graph is never stored.
+ * The partition does not depend on the number of threads.
+ */
+#ifndef EUCLIDEAN_CLUSTERING_HPP
+#define EUCLIDEAN_CLUSTERING_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/spatial_grid.hpp"
+#include "../utils/union_find.hpp"
+
+// Clusters as increasing lists of point indices, biggest first (ties: the one with the
+// smallest point first). Clusters with less than min_size points are dropped
+std::vector<std::vector<std::size_t> > euclidean_clusters (	const std::vector<Vec3>& points, double radius,
+																														std::size_t min_size = 1)
+{
+	const std::size_t n = points.size();
+	Spatial_grid grid (points, radius);
+	Concurrent_union_find components (n);
+	parallel_for_each_index(n, [&](std::size_t i)
+	{
+		// each edge is seen from both ends: merging from the smaller one is enough
+		grid.for_each_in_radius(points, points[i], radius, [&](std::size_t j, double)
+		{
+			if (j > i)
+				components.unite(i, j);
+		});
+	});
+
+	// roots are the smallest index of their component: clusters come out in that order
+	std::vector<std::size_t> root (n), size (n, 0), cluster_of (n, n);
+	parallel_for_each_index(n, [&](std::size_t i) { root[i] = components.find(i); });
+	for (std::size_t i = 0; i < n; i++)
+		size[root[i]]++;
+	std::vector<std::vector<std::size_t> > clusters;
+	for (std::size_t i = 0; i < n; i++)
+		if (root[i] == i && size[i] >= min_size)
+		{
+			cluster_of[i] = clusters.size();
+			clusters.push_back(std::vector<std::size_t>());
+			clusters.back().reserve(size[i]);
+		}
+	for (std::size_t i = 0; i < n; i++)
+		if (cluster_of[root[i]] != n)
+			clusters[cluster_of[root[i]]].push_back(i);
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const std::vector<std::size_t>& a,
+																												 const std::vector<std::size_t>& b) { return a.size() > b.size(); });
+	return clusters;
+}
+
+#endif
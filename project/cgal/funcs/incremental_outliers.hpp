@@ -0,0 +1,166 @@
+/*
+ * INCREMENTAL OUTLIER REMOVAL
+ * Same criterion as outliers.cpp (CGAL remove_outliers with no limit on the percentage): a point
+ * is an outlier when the root mean square distance to its k nearest neighbors is above
+ * spacing_factor times the average spacing of the cloud. As in CGAL, the point itself counts as
+ * one of the k + 1 neighbors of both measures.
+ * Running it several times in a row with CGAL rebuilds the search tree and all the neighborhoods
+ * at each run, while a pass removes only a few percent of the points. Here the neighborhoods are
+ * computed once on a spatial grid; after a pass only the points that had a removed point among
+ * their neighbors search again, and the sum behind the average spacing is updated with the
+ * difference.
+ * The searches are exact unless Knn_parameters allow them to stop early (see utils/knn_grid.hpp).
+ */
+#ifndef INCREMENTAL_OUTLIERS_HPP
+#define INCREMENTAL_OUTLIERS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/knn_grid.hpp"
+
+// cost of a pass
+struct Outlier_pass
+{
+	std::size_t	removed;					// points removed by the pass
+	std::size_t	left;							// points still in the cloud
+	std::size_t	updated;					// neighborhoods searched again after it
+	double			average_spacing;	// the one the threshold was computed from
+	double			seconds;
+};
+
+class Incremental_outliers
+{
+public:
+	// points stay owned by the caller and must not change while this object is used
+	Incremental_outliers (const std::vector<Vec3>& points, std::size_t nb_neighbors = 24, double spacing_factor = 1.5,
+												const Knn_parameters& knn = Knn_parameters())
+		: m_points(points), m_k(nb_neighbors), m_factor(spacing_factor), m_alive(points.size(), 1), m_left(points.size()),
+			m_neighbors(points.size() * nb_neighbors), m_count(points.size(), 0),
+			m_mean(points.size(), 0.0), m_sq_mean(points.size(), 0.0), m_spacing_sum(0.0)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		m_grid.build(points, nb_neighbors, knn);
+		parallel_for_each_index(points.size(), [this](std::size_t i) { search(i); });
+		m_reverse.assign(points.size(), std::vector<std::size_t>());
+		for (std::size_t i = 0; i < points.size(); i++)
+		{
+			m_spacing_sum += m_mean[i];
+			for (std::size_t j = 0; j < m_count[i]; j++)
+				m_reverse[m_neighbors[i * m_k + j]].push_back(i);
+		}
+		m_setup_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::size_t size () const													{ return m_left; }
+	bool is_kept (std::size_t i) const								{ return m_alive[i] != 0; }
+	const std::vector<unsigned char>& kept () const	{ return m_alive; }
+	double average_spacing () const										{ return (m_left == 0)? 0.0 : m_spacing_sum / double(m_left); }
+	// time spent on the grid and on the first neighborhoods, before any pass
+	double setup_seconds () const											{ return m_setup_seconds; }
+
+	// one removal: all the points above the threshold go at once, as in CGAL
+	Outlier_pass pass ()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		Outlier_pass report;
+		report.average_spacing = average_spacing();
+		report.removed = report.updated = 0;
+		const double threshold = m_factor * report.average_spacing;
+		const double sq_threshold = threshold * threshold;
+
+		std::vector<std::size_t> removed;
+		if (m_left > m_k)
+			for (std::size_t i = 0; i < m_points.size(); i++)
+				if (m_alive[i] && m_sq_mean[i] > sq_threshold)
+					removed.push_back(i);
+		for (std::size_t r = 0; r < removed.size(); r++)
+		{
+			m_alive[removed[r]] = 0;
+			m_spacing_sum -= m_mean[removed[r]];
+		}
+		m_left -= removed.size();
+
+		// the survivors that had a removed point among their neighbors
+		std::vector<unsigned char> dirty (m_points.size(), 0);
+		std::vector<std::size_t> to_update;
+		for (std::size_t r = 0; r < removed.size(); r++)
+		{
+			const std::vector<std::size_t>& users = m_reverse[removed[r]];
+			for (std::size_t u = 0; u < users.size(); u++)
+				if (m_alive[users[u]] && !dirty[users[u]] && has_neighbor(users[u], removed[r]))
+				{
+					dirty[users[u]] = 1;
+					to_update.push_back(users[u]);
+				}
+			std::vector<std::size_t>().swap(m_reverse[removed[r]]);
+		}
+
+		for (std::size_t u = 0; u < to_update.size(); u++)
+			m_spacing_sum -= m_mean[to_update[u]];
+		parallel_for_each_index(to_update.size(), [&](std::size_t u) { search(to_update[u]); });
+		// old entries of the reverse lists are left there: has_neighbor filters them out
+		for (std::size_t u = 0; u < to_update.size(); u++)
+		{
+			std::size_t i = to_update[u];
+			m_spacing_sum += m_mean[i];
+			for (std::size_t j = 0; j < m_count[i]; j++)
+				m_reverse[m_neighbors[i * m_k + j]].push_back(i);
+		}
+
+		report.removed = removed.size();
+		report.left = m_left;
+		report.updated = to_update.size();
+		report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return report;
+	}
+
+private:
+	bool has_neighbor (std::size_t i, std::size_t n) const
+	{
+		for (std::size_t j = 0; j < m_count[i]; j++)
+			if (m_neighbors[i * m_k + j] == n)
+				return true;
+		return false;
+	}
+
+	// k nearest kept points of i (i excluded)
+	void search (std::size_t i)
+	{
+		std::vector<Knn_neighbor> best;
+		m_grid.search(m_points[i], m_k, [this, i](std::size_t j) { return j != i && m_alive[j] != 0; }, best);
+		double sum = 0.0, sq_sum = 0.0;
+		for (std::size_t j = 0; j < best.size(); j++)
+		{
+			m_neighbors[i * m_k + j] = best[j].second;
+			sum += std::sqrt(best[j].first);
+			sq_sum += best[j].first;
+		}
+		m_count[i] = best.size();
+		m_mean[i] = sum / double(best.size() + 1);
+		m_sq_mean[i] = sq_sum / double(best.size() + 1);
+	}
+
+	const std::vector<Vec3>&		m_points;
+	std::size_t									m_k;
+	double											m_factor;
+	std::vector<unsigned char>	m_alive;
+	std::size_t									m_left;
+	Knn_grid										m_grid;
+	std::vector<std::size_t>		m_neighbors;				// k per point, nearest first
+	std::vector<std::size_t>		m_count;						// fewer than k only in clouds of k points or less
+	std::vector<double>					m_mean;							// mean distance to the neighbors
+	std::vector<double>					m_sq_mean;					// mean squared distance
+	std::vector<std::vector<std::size_t> > m_reverse;	// points that have i among their neighbors
+	double											m_spacing_sum;			// sum of m_mean over the kept points
+	double											m_setup_seconds;
+};
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * OFFSET STORE
+ * What pipeline.m keeps in test/<name>/baricenters_<oi>.mat, ctimes_<oi>.mat and offset_<oi>.mat,
+ * in a single append-only binary file: one fixed size record per run, keyed by cloud name and
+ * configuration (the iterations and options of the run). Each record also carries the statistics
+ * of its key after the run (count, mean, variance via Welford's M2, min and max of the centers,
+ * mean computation time), so that adding a run only reads the last record of its key and the
+ * current offset of a key is its last record: nothing is reloaded and recomputed.
+ * As in pipeline.m, a center that widens the spread of the X coordinates (max - min) by gap_limit
+ * or more is not counted: the run is stored, flagged as rejected, with the statistics unchanged.
+ * Keys are stored whole: a cloud name or configuration that does not fit its field is refused,
+ * since a cut key would never match again and each run would start new statistics.
+ */
+#ifndef OFFSET_STORE_HPP
+#define OFFSET_STORE_HPP
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+
+#define OFFSET_STORE_MAGIC		0x3253464fu		// "OFS2": wider keys than "OFS1"
+#define OFFSET_CLOUD_SIZE			64
+// the longest configuration pipeline_config can build, every option at its widest, is 167
+// characters (see Pipeline/run.hpp)
+#define OFFSET_CONFIG_SIZE		192
+#define OFFSET_GAP_LIMIT			0.15					// m, as in pipeline.m
+
+// statistics of the accepted centers of a key
+struct Offset_stats
+{
+	std::uint64_t	count;
+	double				mean[3], m2[3];				// Welford: m2 / (count - 1) is the variance
+	double				min[3], max[3];
+	double				seconds_mean;					// computation time
+};
+
+struct Offset_record
+{
+	std::uint32_t	magic;
+	std::uint32_t	accepted;
+	std::int64_t	time;									// of the run, seconds since the epoch
+	char					cloud[OFFSET_CLOUD_SIZE];		// key: cloud name...
+	char					config[OFFSET_CONFIG_SIZE];	// ...and configuration, both null terminated
+	double				center[3];						// of this run
+	double				seconds;
+	Offset_stats	stats;								// of the key, this run included if accepted
+};
+
+double offset_variance (const Offset_stats& stats, int k)
+{
+	return (stats.count > 1)? stats.m2[k] / double(stats.count - 1) : 0.0;
+}
+
+double offset_gap (const Offset_stats& stats, int k)
+{
+	return (stats.count > 0)? stats.max[k] - stats.min[k] : 0.0;
+}
+
+// whether the key fits the fields of a record, terminator included
+bool offset_key_fits (const std::string& cloud, const std::string& config)
+{
+	return cloud.size() < OFFSET_CLOUD_SIZE && config.size() < OFFSET_CONFIG_SIZE;
+}
+
+bool same_key (const Offset_record& record, const std::string& cloud, const std::string& config)
+{
+	return strncmp(record.cloud, cloud.c_str(), sizeof(record.cloud)) == 0 &&
+				 strncmp(record.config, config.c_str(), sizeof(record.config)) == 0;
+}
+
+// Statistics after adding center; false (stats unchanged) if the center is rejected by the gap rule
+bool add_offset (Offset_stats& stats, const double center[3], double seconds, double gap_limit)
+{
+	if (stats.count > 0)
+	{
+		const double gap = offset_gap(stats, 0);
+		const double new_gap = std::max(stats.max[0], center[0]) - std::min(stats.min[0], center[0]);
+		if (new_gap - gap >= gap_limit)
+			return false;
+	}
+	stats.count++;
+	const double n = double(stats.count);
+	for (int k = 0; k < 3; k++)
+	{
+		const double delta = center[k] - stats.mean[k];
+		stats.mean[k] += delta / n;
+		stats.m2[k] += delta * (center[k] - stats.mean[k]);
+		stats.min[k] = (stats.count == 1)? center[k] : std::min(stats.min[k], center[k]);
+		stats.max[k] = (stats.count == 1)? center[k] : std::max(stats.max[k], center[k]);
+	}
+	stats.seconds_mean += (seconds - stats.seconds_mean) / n;
+	return true;
+}
+
+// The last record of the key in the open store, scanning from the end; false if there is none
+bool last_offset_record (int fd, const std::string& cloud, const std::string& config, Offset_record& record)
+{
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+		return false;
+	for (off_t position = off_t(info.st_size / sizeof(Offset_record)) * off_t(sizeof(Offset_record));
+			 position > 0; position -= off_t(sizeof(Offset_record)))
+	{
+		if (pread(fd, &record, sizeof(record), position - off_t(sizeof(record))) != ssize_t(sizeof(record)))
+			return false;
+		if (record.magic == OFFSET_STORE_MAGIC && same_key(record, cloud, config))
+			return true;
+	}
+	return false;
+}
+
+// Append a run of the key to the store (created if missing); record gets what has been written.
+// The store is locked meanwhile, so that several programs can add runs to the same file. False
+// if the key does not fit (see offset_key_fits) or the file cannot be written
+bool append_offset (const std::string& file, const std::string& cloud, const std::string& config,
+										const Vec3& center, double seconds, Offset_record& record, double gap_limit = OFFSET_GAP_LIMIT)
+{
+	if (!offset_key_fits(cloud, config))
+		return false;
+	int fd = open(file.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+	if (flock(fd, LOCK_EX) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	Offset_record last;
+	Offset_stats stats;
+	if (last_offset_record(fd, cloud, config, last))
+		stats = last.stats;
+	else
+		std::memset(&stats, 0, sizeof(stats));
+
+	std::memset(&record, 0, sizeof(record));
+	record.magic = OFFSET_STORE_MAGIC;
+	record.time = std::int64_t(std::time(0));
+	strncpy(record.cloud, cloud.c_str(), sizeof(record.cloud) - 1);
+	strncpy(record.config, config.c_str(), sizeof(record.config) - 1);
+	for (int k = 0; k < 3; k++)
+		record.center[k] = center[k];
+	record.seconds = seconds;
+	record.accepted = add_offset(stats, record.center, seconds, gap_limit);
+	record.stats = stats;
+
+	// whole records only: a torn write from a crash is cut away before appending
+	struct stat info;
+	bool ok = fstat(fd, &info) == 0;
+	off_t end = off_t(info.st_size / sizeof(Offset_record)) * off_t(sizeof(Offset_record));
+	ok = ok && (end == info.st_size || ftruncate(fd, end) == 0) &&
+			 pwrite(fd, &record, sizeof(record), end) == ssize_t(sizeof(record));
+	flock(fd, LOCK_UN);
+	close(fd);
+	return ok;
+}
+
+// All the records of the store, oldest first
+bool read_offset_records (const std::string& file, std::vector<Offset_record>& records)
+{
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	Offset_record record;
+	while (read(fd, &record, sizeof(record)) == ssize_t(sizeof(record)))
+		if (record.magic == OFFSET_STORE_MAGIC)
+			records.push_back(record);
+	close(fd);
+	return true;
+}
+
+#endif
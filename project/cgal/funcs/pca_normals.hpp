@@ -0,0 +1,59 @@
+/*
+ * PCA NORMALS
+ * Unoriented normals as CGAL pca_estimate_normals computes them: the direction of least variance
+ * of the k nearest neighbors of a point (the point itself included). The neighbors come from a
+ * grid (utils/knn_grid.hpp), so that the queries can be approximate: on scanner noise the plane of
+ * a neighborhood hardly changes when one of its farthest points is swapped for a slightly farther one.
+ */
+#ifndef PCA_NORMALS_HPP
+#define PCA_NORMALS_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/knn_grid.hpp"
+#include "../utils/parallel.hpp"
+
+// normal of the least squares plane of the neighbors of points (eigenvector of the smallest
+// eigenvalue of their covariance)
+Vec3 pca_normal (const std::vector<Vec3>& points, const std::vector<Knn_neighbor>& neighbors)
+{
+	Vec3 centroid = make_vec3(0, 0, 0);
+	for (std::size_t j = 0; j < neighbors.size(); j++)
+		centroid = centroid + points[neighbors[j].second];
+	centroid = (1.0 / double(neighbors.size())) * centroid;
+	Mat3 covariance = {{ make_vec3(0, 0, 0), make_vec3(0, 0, 0), make_vec3(0, 0, 0) }};
+	for (std::size_t j = 0; j < neighbors.size(); j++)
+	{
+		Vec3 d = points[neighbors[j].second] - centroid;
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				covariance[r][c] += d[r] * d[c];
+	}
+	Vec3 eigenvalues;
+	Mat3 eigenvectors;
+	symmetric_eigen(covariance, eigenvalues, eigenvectors);
+	return eigenvectors[0];
+}
+
+// Normals of all the points from their k nearest neighbors; checks gets the distances computed
+// by all the queries
+std::vector<Vec3> pca_normals (const std::vector<Vec3>& points, std::size_t k, const Knn_parameters& knn, std::size_t& checks)
+{
+	std::vector<Vec3> normals (points.size(), make_vec3(0, 0, 0));
+	std::vector<std::size_t> query_checks (points.size(), 0);
+	Knn_grid grid (points, k, knn);
+	parallel_for_each_index(points.size(), [&](std::size_t i)
+	{
+		std::vector<Knn_neighbor> neighbors;
+		query_checks[i] = grid.search(points[i], k, [](std::size_t) { return true; }, neighbors);
+		normals[i] = pca_normal(points, neighbors);
+	});
+	checks = 0;
+	for (std::size_t i = 0; i < points.size(); i++)
+		checks += query_checks[i];
+	return normals;
+}
+
+#endif
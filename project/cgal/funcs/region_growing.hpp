@@ -0,0 +1,289 @@
+/*
+ * PARALLEL REGION GROWING SHAPE DETECTION
+ * Every point starts as the seed of its own region, and regions grow at the same time
+ * along the edges of a precomputed neighbor graph (points closer than cluster_epsilon)
+ * when the two ends are compatible: normals deviating less than normal_threshold and
+ * each point closer than epsilon to the tangent plane of the other one. Two regions
+ * meeting are merged with a lock-free union-find. Each region with at least min_points
+ * points is then fitted to a plane or to a cylinder (whichever explains more points
+ * within epsilon and normal_threshold); what is left, if still big enough, is fitted again.
+ * Regions and shapes are ordered by point indices, never by thread timing, so the output
+ * is the same whatever the number of threads.
+ * The detection can be cancelled from another thread through an atomic flag.
+ */
+#ifndef REGION_GROWING_HPP
+#define REGION_GROWING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/labels.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/spatial_grid.hpp"
+#include "../utils/union_find.hpp"
+
+// same meaning as in CGAL::Shape_detection_3
+struct Region_growing_parameters
+{
+	std::size_t	min_points;
+	double			epsilon;
+	double			cluster_epsilon;
+	double			normal_threshold;
+	std::size_t	max_neighbors;		// edges kept per point in the neighbor graph
+	std::size_t	max_shapes;				// fits tried on what is left of a region
+
+	Region_growing_parameters ()
+		: min_points(100), epsilon(0.025), cluster_epsilon(0.0125), normal_threshold(0.9),
+			max_neighbors(16), max_shapes(4)
+	{}
+};
+
+// kind is PLANE or CYLIND; for planes direction is the normal, for cylinders
+// point and direction describe the axis
+struct Region_shape
+{
+	Shape_kind								kind;
+	Vec3											point, direction;
+	double										radius;
+	std::vector<std::size_t>	indices;
+};
+
+class Parallel_region_growing
+{
+public:
+	Parallel_region_growing () : m_points(0), m_normals(0), m_graph_time(0), m_growing_time(0), m_fitting_time(0) {}
+
+	// the input is not copied: it must outlive the detection
+	void set_input (const std::vector<Vec3>& points, const std::vector<Vec3>& normals)
+	{
+		m_points = &points;
+		m_normals = &normals;
+	}
+
+	// returns false if cancel was raised before the end (shapes are then left empty)
+	bool detect (const Region_growing_parameters& parameters, const std::atomic<bool>* cancel = 0)
+	{
+		typedef std::chrono::steady_clock Clock;
+		const std::vector<Vec3>& points = *m_points;
+		const std::size_t n = points.size();
+		m_shapes.clear();
+		m_unassigned.clear();
+
+		// 1) neighbor graph, fixed number of slots per point (unused ones are n)
+		Clock::time_point t0 = Clock::now();
+		const std::size_t k = parameters.max_neighbors;
+		Spatial_grid grid (points, parameters.cluster_epsilon);
+		m_neighbors.assign(n * k, n);
+		parallel_for_each_index(n, [&](std::size_t i)
+		{
+			if (cancelled(cancel))
+				return;
+			std::vector<std::pair<double, std::size_t> > found;
+			grid.for_each_in_radius(points, points[i], parameters.cluster_epsilon, [&](std::size_t j, double d)
+			{
+				if (j != i)
+					found.push_back(std::make_pair(d, j));
+			});
+			std::size_t kept = std::min(k, found.size());
+			std::partial_sort(found.begin(), found.begin() + kept, found.end());
+			for (std::size_t s = 0; s < kept; s++)
+				m_neighbors[i * k + s] = found[s].second;
+		});
+
+		// 2) grow all the regions at once
+		Clock::time_point t1 = Clock::now();
+		if (cancelled(cancel))
+			return false;
+		Concurrent_union_find regions (n);
+		parallel_for_each_index(n, [&](std::size_t i)
+		{
+			for (std::size_t s = 0; s < k && m_neighbors[i * k + s] != n; s++)
+			{
+				std::size_t j = m_neighbors[i * k + s];
+				if (compatible(i, j, parameters))
+					regions.unite(i, j);
+			}
+		});
+		std::vector<std::size_t> root (n);
+		parallel_for_each_index(n, [&](std::size_t i) { root[i] = regions.find(i); });
+
+		// regions big enough, each one as the increasing list of its points
+		std::vector<std::size_t> size (n, 0);
+		for (std::size_t i = 0; i < n; i++)
+			size[root[i]]++;
+		std::vector<std::size_t> region_of (n, n);
+		std::vector<std::vector<std::size_t> > region_points;
+		for (std::size_t i = 0; i < n; i++)
+			if (root[i] == i && size[i] >= parameters.min_points)
+			{
+				region_of[i] = region_points.size();
+				region_points.push_back(std::vector<std::size_t>());
+				region_points.back().reserve(size[i]);
+			}
+		for (std::size_t i = 0; i < n; i++)
+			if (region_of[root[i]] != n)
+				region_points[region_of[root[i]]].push_back(i);
+
+		// 3) fit the models, one region per task
+		Clock::time_point t2 = Clock::now();
+		if (cancelled(cancel))
+			return false;
+		std::vector<std::vector<Region_shape> > region_shapes (region_points.size());
+		parallel_for_each_index(region_points.size(), [&](std::size_t r)
+		{
+			if (!cancelled(cancel))
+				fit_region(region_points[r], parameters, region_shapes[r]);
+		});
+		if (cancelled(cancel))
+			return false;
+		for (std::size_t r = 0; r < region_shapes.size(); r++)
+			for (std::size_t s = 0; s < region_shapes[r].size(); s++)
+				m_shapes.push_back(region_shapes[r][s]);
+		// biggest shapes first, as CGAL does; ties keep the region order
+		std::stable_sort(m_shapes.begin(), m_shapes.end(), [](const Region_shape& a, const Region_shape& b)
+		{
+			return a.indices.size() > b.indices.size();
+		});
+
+		std::vector<unsigned char> assigned (n, 0);
+		for (std::size_t s = 0; s < m_shapes.size(); s++)
+			for (std::size_t i = 0; i < m_shapes[s].indices.size(); i++)
+				assigned[m_shapes[s].indices[i]] = 1;
+		for (std::size_t i = 0; i < n; i++)
+			if (!assigned[i])
+				m_unassigned.push_back(i);
+		Clock::time_point t3 = Clock::now();
+
+		m_graph_time = std::chrono::duration<double>(t1 - t0).count();
+		m_growing_time = std::chrono::duration<double>(t2 - t1).count();
+		m_fitting_time = std::chrono::duration<double>(t3 - t2).count();
+		return true;
+	}
+
+	const std::vector<Region_shape>& shapes () const								{ return m_shapes; }
+	const std::vector<std::size_t>& indices_of_unassigned_points () const	{ return m_unassigned; }
+	std::size_t number_of_unassigned_points () const								{ return m_unassigned.size(); }
+
+	// seconds spent in the three phases of the last detection
+	double graph_time () const		{ return m_graph_time; }
+	double growing_time () const	{ return m_growing_time; }
+	double fitting_time () const	{ return m_fitting_time; }
+
+private:
+	static bool cancelled (const std::atomic<bool>* cancel)
+	{
+		return cancel != 0 && cancel->load(std::memory_order_relaxed);
+	}
+
+	bool compatible (std::size_t i, std::size_t j, const Region_growing_parameters& parameters) const
+	{
+		const Vec3& ni = (*m_normals)[i];
+		const Vec3& nj = (*m_normals)[j];
+		if (std::fabs(dot(ni, nj)) < parameters.normal_threshold)
+			return false;
+		Vec3 d = (*m_points)[j] - (*m_points)[i];
+		return std::fabs(dot(d, ni)) <= parameters.epsilon && std::fabs(dot(d, nj)) <= parameters.epsilon;
+	}
+
+	// points of the candidate set explained by a plane / a cylinder
+	void plane_inliers (const Fitted_plane& plane, const std::vector<std::size_t>& candidates,
+											const Region_growing_parameters& parameters, std::vector<std::size_t>& inliers) const
+	{
+		inliers.clear();
+		for (std::size_t c = 0; c < candidates.size(); c++)
+		{
+			std::size_t i = candidates[c];
+			if (std::fabs(dot((*m_points)[i] - plane.point, plane.normal)) <= parameters.epsilon
+					&& std::fabs(dot((*m_normals)[i], plane.normal)) >= parameters.normal_threshold)
+				inliers.push_back(i);
+		}
+	}
+
+	void cylinder_inliers (	const Fitted_cylinder& cylinder, const std::vector<std::size_t>& candidates,
+													const Region_growing_parameters& parameters, std::vector<std::size_t>& inliers) const
+	{
+		inliers.clear();
+		for (std::size_t c = 0; c < candidates.size(); c++)
+		{
+			std::size_t i = candidates[c];
+			Vec3 radial;
+			double d = distance_to_axis(cylinder, (*m_points)[i], radial);
+			if (std::fabs(d - cylinder.radius) <= parameters.epsilon
+					&& std::fabs(dot((*m_normals)[i], radial)) >= parameters.normal_threshold)
+				inliers.push_back(i);
+		}
+	}
+
+	// fit, keep the inliers, fit again on them: a few rounds are enough to get rid of
+	// the points of the region that belong to a neighboring surface
+	void fit_region (	const std::vector<std::size_t>& region, const Region_growing_parameters& parameters,
+										std::vector<Region_shape>& found) const
+	{
+		const int rounds = 3;
+		std::vector<std::size_t> remaining = region;
+		while (remaining.size() >= parameters.min_points && found.size() < parameters.max_shapes)
+		{
+			std::vector<std::size_t> plane_in, cylinder_in, subset;
+			Fitted_plane plane;
+			subset = remaining;
+			for (int r = 0; r < rounds && fit_plane(*m_points, subset, plane); r++)
+			{
+				plane_inliers(plane, remaining, parameters, plane_in);
+				subset = plane_in;
+			}
+			Fitted_cylinder cylinder;
+			bool has_cylinder = false;
+			subset = remaining;
+			for (int r = 0; r < rounds && fit_cylinder(*m_points, *m_normals, subset, cylinder); r++)
+			{
+				cylinder_inliers(cylinder, remaining, parameters, cylinder_in);
+				subset = cylinder_in;
+				has_cylinder = true;
+			}
+			if (!has_cylinder)
+				cylinder_in.clear();
+
+			Region_shape shape;
+			if (cylinder_in.size() > plane_in.size())
+			{
+				shape.kind = CYLIND;
+				shape.point = cylinder.point;
+				shape.direction = cylinder.axis;
+				shape.radius = cylinder.radius;
+				shape.indices.swap(cylinder_in);
+			}
+			else
+			{
+				shape.kind = PLANE;
+				shape.point = plane.point;
+				shape.direction = plane.normal;
+				shape.radius = 0.0;
+				shape.indices.swap(plane_in);
+			}
+			if (shape.indices.size() < parameters.min_points)
+				break;
+
+			// both lists are increasing: what is left is the difference
+			std::vector<std::size_t> left;
+			std::set_difference(remaining.begin(), remaining.end(), shape.indices.begin(), shape.indices.end(),
+													std::back_inserter(left));
+			remaining.swap(left);
+			found.push_back(shape);
+		}
+	}
+
+	const std::vector<Vec3>*		m_points;
+	const std::vector<Vec3>*		m_normals;
+	std::vector<std::size_t>		m_neighbors;
+	std::vector<Region_shape>		m_shapes;
+	std::vector<std::size_t>		m_unassigned;
+	double											m_graph_time, m_growing_time, m_fitting_time;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * STAGE PLAN
+ * Order of a few filters on a cloud by estimated cost. Each stage has a cost per input point and
+ * a selectivity (the fraction of its input it keeps), so a stage run after selective ones pays
+ * for fewer points; the cost of an order is the sum of the costs of its stages on the points left
+ * by the ones before. Stages may declare the ones that must run before them (a filter that must
+ * see the values of the scanner and not those of a voxel, a crop that must see the raw density):
+ * the plan is the cheapest order among those respecting the declarations.
+ * The selectivities are taken as independent of each other, as in the ordering of the predicates
+ * of a query; the stages are a handful, so all the orders are tried.
+ */
+#ifndef STAGE_PLAN_HPP
+#define STAGE_PLAN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+struct Plan_stage
+{
+	std::string	name;
+	double			cost;						// estimated seconds per input point
+	double			selectivity;		// estimated fraction of the input points kept
+	unsigned		after;					// bit j set: stage j must run before this one
+};
+
+// an order of the stages with the estimated points and seconds of each (in the order of the plan)
+struct Plan_estimate
+{
+	std::vector<std::size_t>	order;
+	std::vector<double>				input, output, seconds;
+	double										total;
+};
+
+// whether order runs every stage after the ones it declares
+bool plan_allowed (const std::vector<Plan_stage>& stages, const std::vector<std::size_t>& order)
+{
+	unsigned done = 0;
+	for (std::size_t k = 0; k < order.size(); k++)
+	{
+		const Plan_stage& stage = stages[order[k]];
+		if ((stage.after & ~done) != 0)
+			return false;
+		done |= 1u << order[k];
+	}
+	return true;
+}
+
+Plan_estimate estimate_plan (const std::vector<Plan_stage>& stages, const std::vector<std::size_t>& order, double points)
+{
+	Plan_estimate estimate;
+	estimate.order = order;
+	estimate.total = 0.0;
+	for (std::size_t k = 0; k < order.size(); k++)
+	{
+		const Plan_stage& stage = stages[order[k]];
+		estimate.input.push_back(points);
+		estimate.seconds.push_back(stage.cost * points);
+		estimate.total += estimate.seconds.back();
+		points *= stage.selectivity;
+		estimate.output.push_back(points);
+	}
+	return estimate;
+}
+
+// The allowed order of least estimated cost on a cloud of points points; among orders of the same
+// cost, the first one in the order of the stages
+Plan_estimate best_plan (const std::vector<Plan_stage>& stages, double points)
+{
+	std::vector<std::size_t> order (stages.size());
+	for (std::size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	Plan_estimate best;
+	best.total = std::numeric_limits<double>::infinity();
+	do
+	{
+		if (!plan_allowed(stages, order))
+			continue;
+		Plan_estimate estimate = estimate_plan(stages, order, points);
+		if (estimate.total < best.total)
+			best = estimate;
+	}
+	while (std::next_permutation(order.begin(), order.end()));
+	return best;
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * VOXEL GRID DOWNSAMPLING
+ * The space is divided into cubic voxels of side leaf and every non empty voxel becomes a single
+ * point: positions and normals are averaged, discrete attributes (colors, labels) are voted.
+ * Voxels are found by sorting the points on their voxel key (see utils/spatial_grid.hpp),
+ * then each voxel is reduced independently of the others.
+ * The leaf can be fixed or chosen so that the downsampled cloud stays within a point budget.
+ */
+#ifndef VOXEL_GRID_HPP
+#define VOXEL_GRID_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "../utils/geometry.hpp"
+#include "../utils/parallel.hpp"
+#include "../utils/spatial_grid.hpp"
+
+class Voxel_grid
+{
+public:
+	Voxel_grid () : m_leaf(0.0) {}
+
+	Voxel_grid (const std::vector<Vec3>& points, double leaf)
+	{
+		build(points, leaf);
+	}
+
+	void build (const std::vector<Vec3>& points, double leaf)
+	{
+		m_grid.build(points, leaf);
+		m_leaf = m_grid.cell_size();		// larger than leaf on a cloud too wide for the keys
+	}
+
+	double leaf_size () const		{ return m_leaf; }
+	// number of non empty voxels, i.e. of downsampled points
+	std::size_t size () const		{ return m_grid.number_of_cells(); }
+
+	// indices of the input points falling in the v-th voxel, as a [begin, end) range
+	std::pair<const std::size_t*, const std::size_t*> voxel (std::size_t v) const
+	{
+		return m_grid.cell_range(v);
+	}
+
+	// one position per voxel: the mean of its points
+	void average_points (const std::vector<Vec3>& points, std::vector<Vec3>& averaged) const
+	{
+		averaged.resize(size());
+		parallel_for_each_index(size(), [&](std::size_t v)
+		{
+			std::pair<const std::size_t*, const std::size_t*> range = voxel(v);
+			Vec3 sum = make_vec3(0, 0, 0);
+			for (const std::size_t* i = range.first; i != range.second; ++i)
+				sum = sum + points[*i];
+			averaged[v] = (1.0 / double(range.second - range.first)) * sum;
+		});
+	}
+
+	// one unit normal per voxel: normals pointing against the first one of the voxel are
+	// flipped before summing, so that opposite orientations do not cancel out
+	void average_normals (const std::vector<Vec3>& normals, std::vector<Vec3>& averaged) const
+	{
+		averaged.resize(size());
+		parallel_for_each_index(size(), [&](std::size_t v)
+		{
+			std::pair<const std::size_t*, const std::size_t*> range = voxel(v);
+			const Vec3& first = normals[*range.first];
+			Vec3 sum = make_vec3(0, 0, 0);
+			for (const std::size_t* i = range.first; i != range.second; ++i)
+				sum = (dot(normals[*i], first) < 0.0)? sum - normals[*i] : sum + normals[*i];
+			averaged[v] = (squared_length(sum) > 0.0)? normalized(sum) : first;
+		});
+	}
+
+	// One value per voxel: the most frequent among its points (colors, labels...); ties go
+	// to the smallest value, so the result does not depend on the order of the points
+	template <typename T>
+	void majority (const std::vector<T>& values, std::vector<T>& voted) const
+	{
+		voted.resize(size());
+		parallel_for_each_index(size(), [&](std::size_t v)
+		{
+			std::pair<const std::size_t*, const std::size_t*> range = voxel(v);
+			std::vector<T> local;
+			local.reserve(range.second - range.first);
+			for (const std::size_t* i = range.first; i != range.second; ++i)
+				local.push_back(values[*i]);
+			std::sort(local.begin(), local.end());
+			std::size_t best = 0, best_count = 0;
+			for (std::size_t run = 0; run < local.size(); )
+			{
+				std::size_t end = run + 1;
+				while (end < local.size() && !(local[run] < local[end]))
+					end++;
+				if (end - run > best_count)
+				{
+					best = run;
+					best_count = end - run;
+				}
+				run = end;
+			}
+			voted[v] = local[best];
+		});
+	}
+
+	// number of non empty voxels of side leaf
+	static std::size_t count_voxels (const std::vector<Vec3>& points, double leaf)
+	{
+		return Spatial_grid(points, leaf).number_of_cells();
+	}
+
+	// Leaf giving at most target voxels (and not much less): the scanned surfaces are
+	// two dimensional, so the number of voxels goes roughly as 1/leaf^2 and a few
+	// corrections of the first guess are enough. Returns 0 if the cloud is already small
+	static double leaf_size_for_budget (const std::vector<Vec3>& points, std::size_t target)
+	{
+		if (target == 0 || points.size() <= target)
+			return 0.0;
+		Vec3 lo = points[0], hi = points[0];
+		for (std::size_t i = 1; i < points.size(); i++)
+			for (int k = 0; k < 3; k++)
+			{
+				lo[k] = std::min(lo[k], points[i][k]);
+				hi[k] = std::max(hi[k], points[i][k]);
+			}
+		double extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+		if (extent <= 0.0)
+			return 0.0;
+		double volume = 1.0;
+		for (int k = 0; k < 3; k++)
+			volume *= std::max(hi[k] - lo[k], extent * 1e-3);
+
+		double leaf = std::cbrt(volume / double(target));
+		std::size_t count = count_voxels(points, leaf);
+		for (int it = 0; it < 8 && (count > target || 10 * count < 9 * target); it++)
+		{
+			leaf *= std::sqrt(double(count) / double(target));
+			count = count_voxels(points, leaf);
+		}
+		while (count > target)
+		{
+			leaf *= 1.05;
+			count = count_voxels(points, leaf);
+		}
+		return leaf;
+	}
+
+private:
+	double				m_leaf;
+	Spatial_grid	m_grid;
+};
+
+#endif
@@ -0,0 +1,89 @@
+// attribute sets: which columns of a Point_cloud a step reads, carries and writes, fixed at compile time
+#ifndef ATTRIBUTES_HPP
+#define ATTRIBUTES_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "point_cloud.hpp"
+
+// the attributes (Label is the pair of ply properties label and shape_id, see labels.hpp)
+struct XYZ {};
+struct Normal {};
+struct RGB {};
+struct Intensity {};
+struct Label {};
+
+template <typename Attribute, typename... Attributes>
+struct Has_attribute : std::false_type {};
+
+template <typename Attribute, typename First, typename... Rest>
+struct Has_attribute<Attribute, First, Rest...>
+	: std::integral_constant<bool, std::is_same<Attribute, First>::value || Has_attribute<Attribute, Rest...>::value> {};
+
+// A set such as Attrs<XYZ, Normal, RGB>: the reader parses only its columns (the other properties
+// of the file are skipped), the loops below move only its columns and the writer emits only them.
+// The flags are constants, so each instantiation keeps only the branches of its columns
+template <typename... Attributes>
+struct Attrs
+{
+	static_assert(Has_attribute<XYZ, Attributes...>::value, "an attribute set has the positions");
+
+	static constexpr bool normals = Has_attribute<Normal, Attributes...>::value;
+	static constexpr bool colors = Has_attribute<RGB, Attributes...>::value;
+	static constexpr bool intensity = Has_attribute<Intensity, Attributes...>::value;
+	static constexpr bool labels = Has_attribute<Label, Attributes...>::value;
+};
+
+// Allocate the optional columns of the set (zero filled) and free the others
+template <typename Attributes>
+void set_columns (Point_cloud& cloud)
+{
+	if (Attributes::normals)		cloud.add_normals();
+	else												cloud.drop_normals();
+	if (Attributes::colors)			cloud.add_colors();
+	else												cloud.drop_colors();
+	if (Attributes::intensity)	cloud.add_intensity();
+	else												cloud.drop_intensity();
+	if (Attributes::labels)			{ cloud.add_labels(); cloud.add_ids(); }
+	else												{ cloud.drop_labels(); cloud.drop_ids(); }
+}
+
+// Keep, in their order, the points i for which keep(i) holds, moving only the columns of the set
+// (the cloud has exactly those, see set_columns); returns how many are left
+template <typename Attributes, typename Predicate>
+std::size_t keep_points_if (Point_cloud& cloud, const Predicate& keep)
+{
+	const std::size_t n = cloud.size();
+	std::size_t kept = 0;
+	for (std::size_t i = 0; i < n; i++)
+	{
+		if (!keep(i))
+			continue;
+		if (kept != i)
+		{
+			cloud.x[kept] = cloud.x[i]; cloud.y[kept] = cloud.y[i]; cloud.z[kept] = cloud.z[i];
+			if (Attributes::normals)		{ cloud.nx[kept] = cloud.nx[i]; cloud.ny[kept] = cloud.ny[i]; cloud.nz[kept] = cloud.nz[i]; }
+			if (Attributes::colors)			{ cloud.red[kept] = cloud.red[i]; cloud.green[kept] = cloud.green[i]; cloud.blue[kept] = cloud.blue[i]; }
+			if (Attributes::intensity)	cloud.intensity[kept] = cloud.intensity[i];
+			if (Attributes::labels)			{ cloud.label[kept] = cloud.label[i]; cloud.id[kept] = cloud.id[i]; }
+		}
+		kept++;
+	}
+	cloud.resize(kept);
+	return kept;
+}
+
+// The sets of the programs that pass a cloud along with its normals (cut, outliers): the colors
+// are only carried when someone is going to look at them. Calls f with an Attrs object and
+// returns what it returns
+template <typename Function>
+auto with_colors_if (bool colors, const Function& f) -> decltype(f(Attrs<XYZ, Normal, RGB>()))
+{
+	if (colors)
+		return f(Attrs<XYZ, Normal, RGB>());
+	return f(Attrs<XYZ, Normal>());
+}
+
+#endif
@@ -5,9 +5,11 @@
 #include <iostream>
 #include <cstring>
 #include <stdexcept>
+
+#include "kernel.hpp"
+
 // types
-typedef CGAL::Exact_predicates_inexact_constructions_kernel		EPIC_kernel;
-typedef EPIC_kernel::FT																				FT;
+typedef Pipeline_kernel::FT																		FT;
 
 FT grant_FT_input (std::string base_msg, std::string err_msg, FT def_val, FT min=0.0, FT max=-1.0)
 {
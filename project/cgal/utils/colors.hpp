@@ -1,6 +1,8 @@
 #ifndef COLORS_HPP
 #define COLORS_HPP
 
+#include "labels.hpp"
+
 // types
 typedef CGAL::cpp11::array<unsigned char, 3> Color;
 
@@ -72,14 +74,6 @@ bool is_yellow_value (Color c)
 	return false;
 }
 
-#define UNDEF		0
-#define PLANE		1
-#define CONE		2
-#define TORUS		3
-#define SPHERE	4
-#define BIGCYL	5
-#define WRNGAX	6
-#define CYLIND	7
 Color get_color_value (int shape)
 {
 	Color c;
@@ -104,5 +98,16 @@ bool is_color_value (Color c)
 	return true;
 }
 
+// visualization only: turn a label back into the palette used by the detectors
+Color get_label_color (Shape_kind kind, Shape_id id)
+{
+	switch (kind)
+	{
+		case PLANE:		return get_yellow_value(id);
+		case CYLIND:	return get_blue_value(id);
+		default:			return get_color_value(kind);
+	}
+}
+
 
 #endif
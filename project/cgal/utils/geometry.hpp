@@ -0,0 +1,216 @@
+// small geometry helpers that do not need a CGAL kernel: vectors, 3x3 eigen decomposition
+// and least squares fitting of the shapes we look for (planes and cylinders)
+#ifndef GEOMETRY_HPP
+#define GEOMETRY_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// types
+typedef std::array<double, 3>	Vec3;
+typedef std::array<Vec3, 3>		Mat3;	// row major
+
+Vec3 make_vec3 (double x, double y, double z)
+{
+	Vec3 v = {{x, y, z}};
+	return v;
+}
+Vec3 operator+ (const Vec3& a, const Vec3& b)	{ return make_vec3(a[0] + b[0], a[1] + b[1], a[2] + b[2]); }
+Vec3 operator- (const Vec3& a, const Vec3& b)	{ return make_vec3(a[0] - b[0], a[1] - b[1], a[2] - b[2]); }
+Vec3 operator* (double s, const Vec3& a)			{ return make_vec3(s * a[0], s * a[1], s * a[2]); }
+double dot (const Vec3& a, const Vec3& b)			{ return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+Vec3 cross (const Vec3& a, const Vec3& b)
+{
+	return make_vec3(a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]);
+}
+double squared_length (const Vec3& a)				{ return dot(a, a); }
+double length (const Vec3& a)								{ return std::sqrt(dot(a, a)); }
+Vec3 normalized (const Vec3& a)
+{
+	double l = length(a);
+	return (l > 0.0)? (1.0 / l) * a : a;
+}
+
+// any unit vector orthogonal to the (unit) vector a
+Vec3 any_orthogonal (const Vec3& a)
+{
+	Vec3 b = (std::fabs(a[0]) < 0.9)? make_vec3(1, 0, 0) : make_vec3(0, 1, 0);
+	return normalized(cross(a, b));
+}
+
+// Eigen decomposition of a symmetric 3x3 matrix with the cyclic Jacobi method:
+// eigenvalues are returned in increasing order, eigenvectors[k] goes with eigenvalues[k]
+void symmetric_eigen (const Mat3& m, Vec3& eigenvalues, Mat3& eigenvectors)
+{
+	double a[3][3], v[3][3];
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+		{
+			a[i][j] = m[i][j];
+			v[i][j] = (i == j)? 1.0 : 0.0;
+		}
+	for (int sweep = 0; sweep < 50; sweep++)
+	{
+		double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		if (off < 1e-30)
+			break;
+		for (int p = 0; p < 2; p++)
+			for (int q = p + 1; q < 3; q++)
+			{
+				if (std::fabs(a[p][q]) < 1e-300)
+					continue;
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = ((theta >= 0)? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+				double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+				for (int k = 0; k < 3; k++)
+				{
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+	}
+	// sort by eigenvalue (columns of v are the eigenvectors)
+	int order[3] = {0, 1, 2};
+	for (int i = 0; i < 3; i++)
+		for (int j = i + 1; j < 3; j++)
+			if (a[order[j]][order[j]] < a[order[i]][order[i]])
+				std::swap(order[i], order[j]);
+	for (int k = 0; k < 3; k++)
+	{
+		eigenvalues[k] = a[order[k]][order[k]];
+		eigenvectors[k] = make_vec3(v[0][order[k]], v[1][order[k]], v[2][order[k]]);
+	}
+}
+
+// solve the 3x3 linear system m x = b (Cramer); false if the system is singular
+bool solve3 (const Mat3& m, const Vec3& b, Vec3& x)
+{
+	double det = dot(m[0], cross(m[1], m[2]));
+	if (std::fabs(det) < 1e-300)
+		return false;
+	for (int k = 0; k < 3; k++)
+	{
+		Mat3 mk = m;
+		for (int i = 0; i < 3; i++)
+			mk[i][k] = b[i];
+		x[k] = dot(mk[0], cross(mk[1], mk[2])) / det;
+	}
+	return true;
+}
+
+// A plane is a point and a unit normal; a cylinder a point on the axis, the unit axis
+// direction and a radius. Both fits are least squares over the given subset of points
+struct Fitted_plane
+{
+	Vec3 point, normal;
+};
+
+struct Fitted_cylinder
+{
+	Vec3		point, axis;
+	double	radius;
+};
+
+bool fit_plane (const std::vector<Vec3>& points, const std::vector<std::size_t>& indices, Fitted_plane& plane)
+{
+	if (indices.size() < 3)
+		return false;
+	Vec3 c = make_vec3(0, 0, 0);
+	for (std::size_t i = 0; i < indices.size(); i++)
+		c = c + points[indices[i]];
+	c = (1.0 / double(indices.size())) * c;
+	Mat3 cov = {{make_vec3(0, 0, 0), make_vec3(0, 0, 0), make_vec3(0, 0, 0)}};
+	for (std::size_t i = 0; i < indices.size(); i++)
+	{
+		Vec3 d = points[indices[i]] - c;
+		for (int r = 0; r < 3; r++)
+			for (int s = 0; s < 3; s++)
+				cov[r][s] += d[r] * d[s];
+	}
+	Vec3 values;
+	Mat3 vectors;
+	symmetric_eigen(cov, values, vectors);
+	plane.point = c;
+	plane.normal = normalized(vectors[0]);
+	return true;
+}
+
+// The axis is the direction the normals are orthogonal to (smallest eigenvector of the
+// normal scatter matrix); the section is then an algebraic (Kasa) circle fit of the
+// points projected on the plane orthogonal to the axis
+bool fit_cylinder (	const std::vector<Vec3>& points, const std::vector<Vec3>& normals,
+										const std::vector<std::size_t>& indices, Fitted_cylinder& cylinder)
+{
+	if (indices.size() < 6)
+		return false;
+	Mat3 scatter = {{make_vec3(0, 0, 0), make_vec3(0, 0, 0), make_vec3(0, 0, 0)}};
+	Vec3 mean = make_vec3(0, 0, 0);
+	for (std::size_t i = 0; i < indices.size(); i++)
+	{
+		const Vec3& n = normals[indices[i]];
+		for (int r = 0; r < 3; r++)
+			for (int s = 0; s < 3; s++)
+				scatter[r][s] += n[r] * n[s];
+		mean = mean + points[indices[i]];
+	}
+	mean = (1.0 / double(indices.size())) * mean;
+	Vec3 values;
+	Mat3 vectors;
+	symmetric_eigen(scatter, values, vectors);
+	Vec3 axis = normalized(vectors[0]);
+	Vec3 u = any_orthogonal(axis), v = cross(axis, u);
+
+	// minimize sum (x^2 + y^2 + D x + E y + F)^2, coordinates relative to the mean for conditioning
+	Mat3 m = {{make_vec3(0, 0, 0), make_vec3(0, 0, 0), make_vec3(0, 0, 0)}};
+	Vec3 b = make_vec3(0, 0, 0);
+	for (std::size_t i = 0; i < indices.size(); i++)
+	{
+		Vec3 d = points[indices[i]] - mean;
+		double x = dot(d, u), y = dot(d, v), z = -(x * x + y * y);
+		Vec3 row = make_vec3(x, y, 1.0);
+		for (int r = 0; r < 3; r++)
+		{
+			for (int s = 0; s < 3; s++)
+				m[r][s] += row[r] * row[s];
+			b[r] += row[r] * z;
+		}
+	}
+	Vec3 def;
+	if (!solve3(m, b, def))
+		return false;
+	double cx = -def[0] / 2.0, cy = -def[1] / 2.0;
+	double r2 = cx * cx + cy * cy - def[2];
+	if (r2 <= 0.0)
+		return false;
+	cylinder.point = mean + cx * u + cy * v;
+	cylinder.axis = axis;
+	cylinder.radius = std::sqrt(r2);
+	return true;
+}
+
+// distance from the point p to the axis of the cylinder, and radial unit direction
+double distance_to_axis (const Fitted_cylinder& cylinder, const Vec3& p, Vec3& radial)
+{
+	Vec3 d = p - cylinder.point;
+	Vec3 r = d - dot(d, cylinder.axis) * cylinder.axis;
+	double l = length(r);
+	radial = (l > 0.0)? (1.0 / l) * r : cylinder.axis;
+	return l;
+}
+
+#endif
@@ -0,0 +1,21 @@
+// the CGAL kernel of the pipeline programs (outliers, compute_onormals, detect_shapes_ransac, pipeline, wheelsetd)
+#ifndef KERNEL_HPP
+#define KERNEL_HPP
+
+// The scanner files hold float32 coordinates: built with WHEELSET_FLOAT_KERNEL (cmake
+// -DWHEELSET_FLOAT_KERNEL=ON in the folders of those programs) the points, vectors and numbers
+// of the kernel are floats too, halving the size of the clouds and of the search trees; the
+// default is the double precision kernel used so far. pipeline_config() marks the runs of the
+// float build, so that the offset store keeps the two apart and `offsets --compare` sets them
+// side by side
+#ifdef WHEELSET_FLOAT_KERNEL
+#include <CGAL/Simple_cartesian.h>
+typedef CGAL::Simple_cartesian<float>													Pipeline_kernel;
+#define PIPELINE_KERNEL_NAME	"float"
+#else
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+typedef CGAL::Exact_predicates_inexact_constructions_kernel		Pipeline_kernel;
+#define PIPELINE_KERNEL_NAME	"double"
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+// k nearest neighbor queries on a uniform grid, exact or with a bounded error
+#ifndef KNN_GRID_HPP
+#define KNN_GRID_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "spatial_grid.hpp"
+
+// How much a query may give up, for the steps that only need the scale of a neighborhood on noisy
+// scanner data (average spacing, outliers, PCA normals). With the defaults the search is exact.
+// epsilon: the search stops once the k-th point found is within (1 + epsilon) times the distance
+// of the cells not visited yet, so the k-th distance returned is at most (1 + epsilon) times the
+// true one. max_checks: once k points are found, the search also stops after this many distances
+// computed (0: no limit); this bounds the time of a query but not its error
+struct Knn_parameters
+{
+	double			epsilon;
+	std::size_t	max_checks;
+
+	Knn_parameters () : epsilon(0.0), max_checks(0) {}
+
+	bool exact () const		{ return epsilon == 0.0 && max_checks == 0; }
+};
+
+// (squared distance, index) of a neighbor
+typedef std::pair<double, std::size_t> Knn_neighbor;
+
+// A query visits the cells ring by ring around the cell of the query point, until the rings left
+// cannot hold a nearer point (or, approximate, not much nearer)
+class Knn_grid
+{
+public:
+	Knn_grid () : m_points(0) {}
+
+	// points stay owned by the caller and must not change while this object is used
+	Knn_grid (const std::vector<Vec3>& points, std::size_t k, const Knn_parameters& parameters = Knn_parameters())
+	{
+		build(points, k, parameters);
+	}
+
+	void build (const std::vector<Vec3>& points, std::size_t k, const Knn_parameters& parameters = Knn_parameters())
+	{
+		m_points = &points;
+		m_parameters = parameters;
+		if (points.empty())
+			return;
+		Vec3 lo = points[0], hi = points[0];
+		for (std::size_t i = 1; i < points.size(); i++)
+			for (int a = 0; a < 3; a++)
+			{
+				lo[a] = std::min(lo[a], points[i][a]);
+				hi[a] = std::max(hi[a], points[i][a]);
+			}
+		double extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+		double volume = 1.0;
+		for (int a = 0; a < 3; a++)
+			volume *= std::max(hi[a] - lo[a], 1e-3 * extent);
+		double cell = std::cbrt(volume * double(k + 1) / double(points.size()));
+		if (!(cell > 0.0))
+			cell = 1.0;
+		m_grid.build(points, cell);
+		// the cells of the box hold k + 1 points on average, but a scan is a surface: most of them
+		// are empty and the others crowded. Shrink them (the occupancy of a surface goes with the
+		// square of the side) until the non empty ones hold about a quarter of a neighborhood, so
+		// that the rings get close to the k-th neighbor before a query stops. The grid may widen
+		// the cells to fit its keys: the queries use its cell size, not cell
+		const double target = std::max(1.0, double(k + 1) / 4.0);
+		for (int refine = 0; refine < 3; refine++)
+		{
+			double occupancy = double(points.size()) / double(std::max<std::size_t>(1, m_grid.number_of_cells()));
+			if (occupancy < 2.0 * target)
+				break;
+			cell *= std::sqrt(target / occupancy);
+			m_grid.build(points, cell);
+		}
+		m_grid.cell_of(lo, m_lo);
+		m_grid.cell_of(hi, m_hi);
+	}
+
+	const Knn_parameters& parameters () const		{ return m_parameters; }
+
+	// The k nearest points j of q for which accept(j) holds, nearest first, into best (fewer than k
+	// only if the cloud has fewer such points); returns the number of distances computed
+	template <typename Accept>
+	std::size_t search (const Vec3& q, std::size_t k, const Accept& accept, std::vector<Knn_neighbor>& best) const
+	{
+		const std::vector<Vec3>& points = *m_points;
+		best.clear();
+		if (k == 0 || points.empty())
+			return 0;
+		best.reserve(k + 1);
+		long c[3], center[3];
+		m_grid.cell_of(q, center);
+		const double cell = m_grid.cell_size();
+		// distance from q to the faces of its cell: the rings around it start there
+		double margin = cell;
+		for (int a = 0; a < 3; a++)
+		{
+			double low = q[a] - (m_grid.origin()[a] + double(center[a]) * cell);
+			margin = std::min(margin, std::min(low, cell - low));
+		}
+		margin = std::max(0.0, margin);
+		const double slack = (1.0 + m_parameters.epsilon) * (1.0 + m_parameters.epsilon);
+		long max_ring = 0;
+		for (int a = 0; a < 3; a++)
+			max_ring = std::max(max_ring, std::max(center[a] - m_lo[a], m_hi[a] - center[a]));
+
+		std::size_t checks = 0;
+		for (long ring = 0; ring <= max_ring; ring++)
+		{
+			for (c[0] = center[0] - ring; c[0] <= center[0] + ring; c[0]++)
+				for (c[1] = center[1] - ring; c[1] <= center[1] + ring; c[1]++)
+				{
+					// only the shell of the ring: inside it, just the two end cells along z
+					long step = (std::abs(c[0] - center[0]) == ring || std::abs(c[1] - center[1]) == ring)? 1 : std::max(1L, 2 * ring);
+					for (c[2] = center[2] - ring; c[2] <= center[2] + ring; c[2] += step)
+					{
+						std::pair<const std::size_t*, const std::size_t*> range = m_grid.cell_points(c);
+						for (const std::size_t* p = range.first; p != range.second; ++p)
+						{
+							if (!accept(*p))
+								continue;
+							double d = squared_length(points[*p] - q);
+							checks++;
+							if (best.size() < k)
+							{
+								best.push_back(Knn_neighbor(d, *p));
+								std::push_heap(best.begin(), best.end());
+							}
+							else if (d < best.front().first)
+							{
+								std::pop_heap(best.begin(), best.end());
+								best.back() = Knn_neighbor(d, *p);
+								std::push_heap(best.begin(), best.end());
+							}
+						}
+					}
+				}
+			if (best.size() < k)
+				continue;
+			// anything beyond this ring is at least ring cells (and the margin) away from q
+			double reach = double(ring) * cell + margin;
+			if (best.front().first <= slack * reach * reach)
+				break;
+			if (m_parameters.max_checks > 0 && checks >= m_parameters.max_checks)
+				break;
+		}
+		std::sort_heap(best.begin(), best.end());
+		return checks;
+	}
+
+private:
+	const std::vector<Vec3>*	m_points;
+	Knn_parameters						m_parameters;
+	Spatial_grid							m_grid;
+	long											m_lo[3], m_hi[3];		// cells of the bounding box corners
+};
+
+#endif
@@ -0,0 +1,75 @@
+// write the output of a shape detector: points with normals and their labels
+#ifndef LABELED_PLY_HPP
+#define LABELED_PLY_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "colors.hpp"
+#include "labels.hpp"
+#include "parallel.hpp"
+#include "ply_header.hpp"
+#include "shm_cloud.hpp"
+
+// Save the points whose kind is selected by the keep table; colors are generated
+// from the labels only if asked (visualization). Returns the number of points saved
+template <typename Pwn_vector>
+std::size_t write_labeled_ply (	std::ostream& out, const Pwn_vector& point_cloud,
+																const std::vector<Shape_kind>& kind_cloud, const std::vector<Shape_id>& id_cloud,
+																const Keep_table& keep, bool with_colors)
+{
+	std::vector<unsigned char> flags (point_cloud.size());
+	parallel_for_each_index(flags.size(), [&](std::size_t i)
+	{
+		flags[i] = keep.keep[kind_cloud[i]];
+	});
+	std::vector<std::size_t> selected = parallel_select(flags);
+
+	write_ply_header(out, selected.size(), true, with_colors, true);
+	for (std::size_t s = 0; s < selected.size(); ++s)
+	{
+		const std::size_t i = selected[s];
+		out << point_cloud[i].first << " " << point_cloud[i].second << " ";
+		if (with_colors)
+		{
+			Color c = get_label_color(kind_cloud[i], id_cloud[i]);
+			out << int(c[0]) << " " << int(c[1]) << " " << int(c[2]) << " ";
+		}
+		out << int(kind_cloud[i]) << " " << id_cloud[i] << std::endl;
+	}
+	return selected.size();
+}
+
+// Same selection, published to the shared memory segment name (see shm_cloud.hpp) with the labels
+// as columns; the colors are left to whoever displays the cloud. Returns the number of points
+// published, or -1 if the segment cannot be written
+template <typename Pwn_vector>
+long publish_labeled_cloud (	const std::string& name, const Pwn_vector& point_cloud,
+															const std::vector<Shape_kind>& kind_cloud, const std::vector<Shape_id>& id_cloud,
+															const Keep_table& keep)
+{
+	std::vector<unsigned char> flags (point_cloud.size());
+	parallel_for_each_index(flags.size(), [&](std::size_t i)
+	{
+		flags[i] = keep.keep[kind_cloud[i]];
+	});
+	std::vector<std::size_t> selected = parallel_select(flags);
+
+	Point_cloud columns;
+	columns.add_normals();
+	columns.add_labels();
+	columns.add_ids();
+	columns.resize(selected.size());
+	parallel_for_each_index(selected.size(), [&](std::size_t s)
+	{
+		const std::size_t i = selected[s];
+		columns.set_position(s, point_cloud[i].first);
+		columns.set_normal(s, point_cloud[i].second);
+		columns.label[s] = (unsigned char)(kind_cloud[i]);
+		columns.id[s] = id_cloud[i];
+	});
+	return publish_cloud(name, columns)? long(selected.size()) : -1;
+}
+
+#endif
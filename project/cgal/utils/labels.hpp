@@ -0,0 +1,72 @@
+// per-point semantic labels: what shape a point has been assigned to by a detector
+#ifndef LABELS_HPP
+#define LABELS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// shape kinds, stored in the "label" property of the ply files
+#define UNDEF		0
+#define PLANE		1
+#define CONE		2
+#define TORUS		3
+#define SPHERE	4
+#define BIGCYL	5
+#define WRNGAX	6
+#define CYLIND	7
+
+// types
+typedef unsigned char	Shape_kind;	// one of the kinds above
+typedef int						Shape_id;		// n-th shape of its kind found by the detector, -1 if unassigned
+
+// A label is stored as two ply properties: "label" (uchar kind) and "shape_id" (int).
+// The keep table is indexed directly by the kind byte, so that selecting points is
+// a single lookup per point, without any comparison chain
+struct Keep_table
+{
+	unsigned char keep[256];
+};
+
+// every point, whatever its label
+Keep_table keep_all ()
+{
+	Keep_table t;
+	std::memset(t.keep, 1, sizeof(t.keep));
+	return t;
+}
+
+// only the accepted cylinders (what we believe to be the axle)
+Keep_table keep_cylinders ()
+{
+	Keep_table t;
+	std::memset(t.keep, 0, sizeof(t.keep));
+	t.keep[CYLIND] = 1;
+	return t;
+}
+
+// everything that has been assigned to some shape
+Keep_table keep_assigned ()
+{
+	Keep_table t;
+	std::memset(t.keep, 1, sizeof(t.keep));
+	t.keep[UNDEF] = 0;
+	return t;
+}
+
+// A cylinder can be the axle only if its axis is almost aligned to Y: since the axis is
+// a unit vector, its angle with y = [0,1,0] is acos of its y component, and it must be
+// within 30 degrees (either way). Moreover the radius cannot be too high
+Shape_kind classify_cylinder (double axis_y, double radius)
+{
+	double theta = std::acos(std::max(-1.0, std::min(1.0, axis_y)));
+	if (theta > 0.52 && theta < 2.62) // radians: 30 degrees
+		return WRNGAX;
+	if (radius > 1.0)
+		return BIGCYL;
+	return CYLIND;
+}
+
+#endif
@@ -0,0 +1,155 @@
+// loops over point indices that run on TBB when CGAL is linked with it, sequentially otherwise
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifdef CGAL_LINKED_WITH_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/task_arena.h>
+#endif
+
+// call f(i) for each i in [0, n)
+template <typename Function>
+void parallel_for_each_index (std::size_t n, const Function& f)
+{
+#ifdef CGAL_LINKED_WITH_TBB
+	tbb::parallel_for(tbb::blocked_range<std::size_t>(0, n),
+										[&](const tbb::blocked_range<std::size_t>& r)
+										{
+											for (std::size_t i = r.begin(); i != r.end(); ++i)
+												f(i);
+										});
+#else
+	for (std::size_t i = 0; i < n; ++i)
+		f(i);
+#endif
+}
+
+// Reduction over [0, n): each block of indices folds its own partial result, starting from
+// identity, with add(partial, i); the partials are then merged in block order with
+// merge(result, partial), so that the result does not depend on the scheduling
+template <typename Value, typename Add, typename Merge>
+Value parallel_reduce_index (std::size_t n, const Value& identity, const Add& add, const Merge& merge)
+{
+	const std::size_t	block = 1 << 14;
+	const std::size_t	nb_blocks = (n + block - 1) / block;
+	std::vector<Value> partials (nb_blocks, identity);
+	parallel_for_each_index(nb_blocks, [&](std::size_t b)
+	{
+		for (std::size_t i = b * block; i < n && i < (b + 1) * block; ++i)
+			add(partials[b], i);
+	});
+	Value result = identity;
+	for (std::size_t b = 0; b < nb_blocks; ++b)
+		merge(result, partials[b]);
+	return result;
+}
+
+// Call f() letting the parallel loops it starts use at most threads threads (a TBB arena of
+// that size), so that several jobs running side by side do not oversubscribe the cores
+template <typename Function>
+void with_thread_limit (std::size_t threads, const Function& f)
+{
+#ifdef CGAL_LINKED_WITH_TBB
+	tbb::task_arena arena (int(std::max<std::size_t>(1, threads)));
+	arena.execute(f);
+#else
+	(void)threads;
+	f();
+#endif
+}
+
+// sort [begin, end) with the given strict ordering
+template <typename Iterator, typename Compare>
+void parallel_sort (Iterator begin, Iterator end, const Compare& compare)
+{
+#ifdef CGAL_LINKED_WITH_TBB
+	tbb::parallel_sort(begin, end, compare);
+#else
+	std::sort(begin, end, compare);
+#endif
+}
+
+// Stream compaction: return the indices i with flags[i] != 0, in increasing order.
+// The range is split into blocks: each block counts its survivors, a prefix sum over
+// the blocks gives where each of them starts writing, then the blocks are filled
+std::vector<std::size_t> parallel_select (const std::vector<unsigned char>& flags)
+{
+	const std::size_t	n = flags.size();
+	const std::size_t	block = 1 << 14;
+	const std::size_t	nb_blocks = (n + block - 1) / block;
+	std::vector<std::size_t> offsets (nb_blocks + 1, 0);
+
+	parallel_for_each_index(nb_blocks, [&](std::size_t b)
+	{
+		std::size_t count = 0;
+		for (std::size_t i = b * block; i < n && i < (b + 1) * block; ++i)
+			count += (flags[i] != 0);
+		offsets[b + 1] = count;
+	});
+	for (std::size_t b = 0; b < nb_blocks; ++b)
+		offsets[b + 1] += offsets[b];
+
+	std::vector<std::size_t> selected (offsets[nb_blocks]);
+	parallel_for_each_index(nb_blocks, [&](std::size_t b)
+	{
+		std::size_t out = offsets[b];
+		for (std::size_t i = b * block; i < n && i < (b + 1) * block; ++i)
+			if (flags[i])
+				selected[out++] = i;
+	});
+	return selected;
+}
+
+// The value std::nth_element would put at position k of values (0 if empty), without changing
+// them: a parallel pass finds the range, a second one counts the values falling in each of the
+// bins of the range, then only the values of the bin holding rank k are copied and selected
+template <typename T>
+T parallel_nth_value (const std::vector<T>& values, std::size_t k)
+{
+	typedef std::vector<std::size_t> Histogram;
+	const std::size_t n = values.size();
+	if (n == 0)
+		return T(0);
+	std::pair<T, T> range = parallel_reduce_index(n, std::make_pair(values[0], values[0]),
+		[&](std::pair<T, T>& r, std::size_t i)
+		{
+			r.first = std::min(r.first, values[i]);
+			r.second = std::max(r.second, values[i]);
+		},
+		[](std::pair<T, T>& r, const std::pair<T, T>& p)
+		{
+			r.first = std::min(r.first, p.first);
+			r.second = std::max(r.second, p.second);
+		});
+	if (!(range.first < range.second))
+		return range.first;
+
+	const std::size_t bins = 1024;
+	const double low = double(range.first), scale = double(bins) / (double(range.second) - low);
+	auto bin_of = [&](T v) { return std::min(bins - 1, std::size_t((double(v) - low) * scale)); };
+	Histogram histogram = parallel_reduce_index(n, Histogram(bins, 0),
+		[&](Histogram& h, std::size_t i) { h[bin_of(values[i])]++; },
+		[](Histogram& h, const Histogram& p) { for (std::size_t b = 0; b < h.size(); b++) h[b] += p[b]; });
+	std::size_t bin = 0, before = 0;
+	k = std::min(k, n - 1);
+	while (before + histogram[bin] <= k)
+		before += histogram[bin++];
+
+	std::vector<unsigned char> flags (n);
+	parallel_for_each_index(n, [&](std::size_t i) { flags[i] = (bin_of(values[i]) == bin); });
+	std::vector<std::size_t> selected = parallel_select(flags);
+	std::vector<T> candidates (selected.size());
+	for (std::size_t i = 0; i < selected.size(); i++)
+		candidates[i] = values[selected[i]];
+	std::nth_element(candidates.begin(), candidates.begin() + (k - before), candidates.end());
+	return candidates[k - before];
+}
+
+#endif
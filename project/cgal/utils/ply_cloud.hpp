@@ -0,0 +1,333 @@
+// ply files read into and written from a Point_cloud, limited to the columns of an attribute set
+#ifndef PLY_CLOUD_HPP
+#define PLY_CLOUD_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "attributes.hpp"
+#include "ply_header.hpp"
+
+enum Ply_format { PLY_ASCII, PLY_BINARY_LITTLE_ENDIAN, PLY_BINARY_BIG_ENDIAN };
+
+// the columns a vertex property can go to; PLY_SKIP is any other property, or one not in the set
+enum Ply_column { PLY_X, PLY_Y, PLY_Z, PLY_NX, PLY_NY, PLY_NZ, PLY_RED, PLY_GREEN, PLY_BLUE, PLY_INTENSITY, PLY_LABEL,
+									PLY_SHAPE_ID, PLY_SKIP };
+
+enum Ply_type { PLY_CHAR, PLY_UCHAR, PLY_SHORT, PLY_USHORT, PLY_INT, PLY_UINT, PLY_FLOAT, PLY_DOUBLE, PLY_UNKNOWN };
+
+struct Ply_property
+{
+	std::string	name;
+	Ply_type		type;
+	bool				list;
+	int					column;				// Ply_column
+	std::size_t	offset;				// in a binary record
+};
+
+struct Ply_element
+{
+	std::string								name;
+	std::size_t								count;
+	std::vector<Ply_property>	properties;
+};
+
+Ply_type ply_type_of (const std::string& name)
+{
+	if (name == "char" || name == "int8")				return PLY_CHAR;
+	if (name == "uchar" || name == "uint8")			return PLY_UCHAR;
+	if (name == "short" || name == "int16")			return PLY_SHORT;
+	if (name == "ushort" || name == "uint16")		return PLY_USHORT;
+	if (name == "int" || name == "int32")				return PLY_INT;
+	if (name == "uint" || name == "uint32")			return PLY_UINT;
+	if (name == "float" || name == "float32")		return PLY_FLOAT;
+	if (name == "double" || name == "float64")	return PLY_DOUBLE;
+	return PLY_UNKNOWN;
+}
+
+std::size_t ply_type_size (Ply_type type)
+{
+	static const std::size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+	return sizes[type];
+}
+
+// The column of the vertex property name if the set has it
+template <typename Attributes>
+int ply_column_of (const std::string& name)
+{
+	static const char* names[PLY_SKIP] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "intensity", "label", "shape_id" };
+	for (int c = 0; c < PLY_SKIP; c++)
+		if (name == names[c])
+		{
+			if ((c >= PLY_NX && c <= PLY_NZ && !Attributes::normals) || (c >= PLY_RED && c <= PLY_BLUE && !Attributes::colors) ||
+					(c == PLY_INTENSITY && !Attributes::intensity) || (c >= PLY_LABEL && !Attributes::labels))
+				return PLY_SKIP;
+			return c;
+		}
+	return PLY_SKIP;
+}
+
+// Parse the header (up to end_header); false if it is not a ply header this reader understands
+template <typename Attributes>
+bool read_ply_cloud_header (std::istream& in, Ply_format& format, std::vector<Ply_element>& elements)
+{
+	std::string line;
+	if (!std::getline(in, line) || line.compare(0, 3, "ply") != 0)
+		return false;
+	bool formatted = false;
+	while (std::getline(in, line))
+	{
+		std::istringstream words (line);
+		std::string keyword;
+		words >> keyword;
+		if (keyword == "end_header")
+			return formatted;
+		if (keyword == "format")
+		{
+			std::string name;
+			words >> name;
+			if (name == "ascii")									format = PLY_ASCII;
+			else if (name == "binary_little_endian")	format = PLY_BINARY_LITTLE_ENDIAN;
+			else if (name == "binary_big_endian")		format = PLY_BINARY_BIG_ENDIAN;
+			else																	return false;
+			formatted = true;
+		}
+		else if (keyword == "element")
+		{
+			Ply_element element;
+			if (!(words >> element.name >> element.count))
+				return false;
+			elements.push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			if (elements.empty())
+				return false;
+			Ply_property property;
+			std::string type;
+			words >> type;
+			property.list = (type == "list");
+			if (property.list)
+			{
+				std::string count_type;
+				words >> count_type >> type;
+			}
+			words >> property.name;
+			property.type = ply_type_of(type);
+			if (property.type == PLY_UNKNOWN || property.name.empty())
+				return false;
+			property.column = (elements.back().name == "vertex" && !property.list)? ply_column_of<Attributes>(property.name) : int(PLY_SKIP);
+			elements.back().properties.push_back(property);
+		}
+		// comment, obj_info: nothing to do
+	}
+	return false;
+}
+
+// a value of type at p, in the byte order of the file
+template <typename T>
+T ply_load (const char* p, bool swap)
+{
+	char bytes[sizeof(T)];
+	for (std::size_t b = 0; b < sizeof(T); b++)
+		bytes[b] = swap? p[sizeof(T) - 1 - b] : p[b];
+	T value;
+	std::memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+double ply_binary_value (const char* p, Ply_type type, bool swap)
+{
+	switch (type)
+	{
+		case PLY_CHAR:		return double(ply_load<std::int8_t>(p, swap));
+		case PLY_UCHAR:		return double(ply_load<std::uint8_t>(p, swap));
+		case PLY_SHORT:		return double(ply_load<std::int16_t>(p, swap));
+		case PLY_USHORT:	return double(ply_load<std::uint16_t>(p, swap));
+		case PLY_INT:			return double(ply_load<std::int32_t>(p, swap));
+		case PLY_UINT:		return double(ply_load<std::uint32_t>(p, swap));
+		case PLY_FLOAT:		return double(ply_load<float>(p, swap));
+		default:					return ply_load<double>(p, swap);
+	}
+}
+
+void set_ply_value (Point_cloud& cloud, std::size_t i, int column, double value)
+{
+	switch (column)
+	{
+		case PLY_X:					cloud.x[i] = float(value); break;
+		case PLY_Y:					cloud.y[i] = float(value); break;
+		case PLY_Z:					cloud.z[i] = float(value); break;
+		case PLY_NX:				cloud.nx[i] = float(value); break;
+		case PLY_NY:				cloud.ny[i] = float(value); break;
+		case PLY_NZ:				cloud.nz[i] = float(value); break;
+		case PLY_RED:				cloud.red[i] = (unsigned char)(value); break;
+		case PLY_GREEN:			cloud.green[i] = (unsigned char)(value); break;
+		case PLY_BLUE:			cloud.blue[i] = (unsigned char)(value); break;
+		case PLY_INTENSITY:	cloud.intensity[i] = float(value); break;
+		case PLY_LABEL:			cloud.label[i] = (unsigned char)(value); break;
+		case PLY_SHAPE_ID:	cloud.id[i] = std::int32_t(value); break;
+		default:						break;
+	}
+}
+
+// Skip the lines (ascii) or records (binary, without lists) of an element before the vertices
+bool skip_ply_element (std::istream& in, const Ply_element& element, Ply_format format)
+{
+	if (format == PLY_ASCII)
+	{
+		std::string line;
+		for (std::size_t i = 0; i < element.count; i++)
+			if (!std::getline(in, line))
+				return false;
+		return true;
+	}
+	std::size_t stride = 0;
+	for (std::size_t p = 0; p < element.properties.size(); p++)
+	{
+		if (element.properties[p].list)
+			return false;
+		stride += ply_type_size(element.properties[p].type);
+	}
+	return bool(in.ignore(std::streamsize(stride * element.count)));
+}
+
+// Read the vertices of a ply file into cloud, which gets exactly the columns of the set. Only
+// the properties of the set are converted: the others are stepped over (a token in ascii, a few
+// bytes of the record in binary). Columns of the set missing from the file stay at zero; false if
+// the file has no positions or cannot be parsed
+template <typename Attributes>
+bool read_ply_cloud (std::istream& in, Point_cloud& cloud)
+{
+	Ply_format format = PLY_ASCII;
+	std::vector<Ply_element> elements;
+	if (!read_ply_cloud_header<Attributes>(in, format, elements))
+		return false;
+	std::size_t v = 0;
+	while (v < elements.size() && elements[v].name != "vertex")
+		if (!skip_ply_element(in, elements[v++], format))
+			return false;
+	if (v == elements.size())
+		return false;
+	const Ply_element& vertex = elements[v];
+	std::vector<Ply_property> properties = vertex.properties;
+	bool has[PLY_SKIP] = { false };
+	std::size_t stride = 0;
+	for (std::size_t p = 0; p < properties.size(); p++)
+	{
+		if (properties[p].list)
+			return false;
+		properties[p].offset = stride;
+		stride += ply_type_size(properties[p].type);
+		if (properties[p].column != PLY_SKIP)
+			has[properties[p].column] = true;
+	}
+	if (!has[PLY_X] || !has[PLY_Y] || !has[PLY_Z])
+		return false;
+
+	cloud = Point_cloud();
+	set_columns<Attributes>(cloud);
+	cloud.resize(vertex.count);
+
+	// the properties to convert, in file order
+	std::vector<std::size_t> used;
+	for (std::size_t p = 0; p < properties.size(); p++)
+		if (properties[p].column != PLY_SKIP)
+			used.push_back(p);
+
+	if (format == PLY_ASCII)
+	{
+		std::string line;
+		for (std::size_t i = 0; i < vertex.count; i++)
+		{
+			if (!std::getline(in, line))
+				return false;
+			const char* c = line.c_str();
+			std::size_t u = 0;
+			for (std::size_t p = 0; p < properties.size() && u < used.size(); p++)
+			{
+				while (*c == ' ' || *c == '\t')
+					c++;
+				if (*c == '\0' || *c == '\r')
+					return false;
+				if (used[u] == p)
+				{
+					char* end;
+					set_ply_value(cloud, i, properties[p].column, std::strtod(c, &end));
+					if (end == c)
+						return false;
+					c = end;
+					u++;
+				}
+				else
+					while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\r')
+						c++;
+			}
+		}
+		return true;
+	}
+
+	// binary: the vertices in blocks of records, each used property decoded over the block
+	const bool swap = (format == PLY_BINARY_BIG_ENDIAN) != (ply_load<std::uint16_t>("\x01\x00", false) != 1);
+	const std::size_t block = 1 << 14;
+	std::vector<char> records (block * stride);
+	for (std::size_t first = 0; first < vertex.count; first += block)
+	{
+		const std::size_t n = std::min(block, vertex.count - first);
+		if (!in.read(records.data(), std::streamsize(n * stride)))
+			return false;
+		for (std::size_t u = 0; u < used.size(); u++)
+		{
+			const Ply_property& property = properties[used[u]];
+			for (std::size_t i = 0; i < n; i++)
+				set_ply_value(cloud, first + i, property.column, ply_binary_value(&records[i * stride + property.offset], property.type, swap));
+		}
+	}
+	return true;
+}
+
+// Write the columns of the set as an ascii ply (see ply_header.hpp); the cloud must have them
+template <typename Attributes>
+void write_ply_cloud (std::ostream& out, const Point_cloud& cloud)
+{
+	write_ply_header(out, cloud.size(), Attributes::normals, Attributes::colors, Attributes::labels, false, Attributes::intensity);
+	for (std::size_t i = 0; i < cloud.size(); i++)
+	{
+		out << cloud.x[i] << " " << cloud.y[i] << " " << cloud.z[i];
+		if (Attributes::normals)
+			out << " " << cloud.nx[i] << " " << cloud.ny[i] << " " << cloud.nz[i];
+		if (Attributes::colors)
+			out << " " << int(cloud.red[i]) << " " << int(cloud.green[i]) << " " << int(cloud.blue[i]);
+		if (Attributes::labels)
+			out << " " << int(cloud.label[i]) << " " << cloud.id[i];
+		if (Attributes::intensity)
+			out << " " << cloud.intensity[i];
+		out << "\n";
+	}
+}
+
+// Pairs of point and normal (the Pwn_vector of the detectors and of the pipeline) read with the
+// set XYZ + Normal: colors, intensity and labels of the file are not parsed
+template <typename Pwn_vector>
+bool read_ply_points_with_normals (std::istream& in, Pwn_vector& point_cloud)
+{
+	typedef typename Pwn_vector::value_type	Point_with_normal;
+	Point_cloud cloud;
+	if (!read_ply_cloud<Attrs<XYZ, Normal> >(in, cloud))
+		return false;
+	point_cloud.resize(cloud.size());
+	for (std::size_t i = 0; i < cloud.size(); i++)
+		point_cloud[i] = Point_with_normal(	cloud.position<typename Point_with_normal::first_type>(i),
+																				cloud.normal<typename Point_with_normal::second_type>(i));
+	return true;
+}
+
+#endif
@@ -0,0 +1,56 @@
+// header of the ascii ply files written by the pipeline tools
+#ifndef PLY_HEADER_HPP
+#define PLY_HEADER_HPP
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// points always come first; then, in this order, normals, colors, labels (kind, shape id), the
+// cluster index and the intensity
+void write_ply_header (std::ostream& out, std::size_t size, bool normals, bool colors, bool labels, bool clusters = false,
+											 bool intensity = false)
+{
+	out	<< "ply " << std::endl
+			<< "format ascii 1.0" << std::endl
+			<< "element vertex " << size << std::endl
+			<< "property float x" << std::endl
+			<< "property float y" << std::endl
+			<< "property float z" << std::endl;
+	if (normals)
+		out << "property float nx" << std::endl
+				<< "property float ny" << std::endl
+				<< "property float nz" << std::endl;
+	if (colors)
+		out	<< "property uchar red" << std::endl
+				<< "property uchar green" << std::endl
+				<< "property uchar blue" << std::endl;
+	if (labels)
+		out	<< "property uchar label" << std::endl
+				<< "property int shape_id" << std::endl;
+	if (clusters)
+		out	<< "property int cluster" << std::endl;
+	if (intensity)
+		out	<< "property float intensity" << std::endl;
+	out << "end_header" << std::endl;
+}
+
+// whether the header of the ply file read from in declares the vertex property name
+// (the stream is read up to end_header)
+bool ply_has_property (std::istream& in, const std::string& name)
+{
+	bool found = false;
+	std::string line;
+	while (std::getline(in, line) && line.compare(0, 10, "end_header") != 0)
+	{
+		std::istringstream words (line);
+		std::string keyword, type, property;
+		if (words >> keyword >> type >> property && keyword == "property" && property == name)
+			found = true;
+	}
+	return found;
+}
+
+#endif
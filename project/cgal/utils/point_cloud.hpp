@@ -0,0 +1,248 @@
+// a cloud kept as one vector per property, shared by the tools instead of their tuples
+#ifndef POINT_CLOUD_HPP
+#define POINT_CLOUD_HPP
+
+#include <boost/property_map/property_map.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Positions are always there; the optional columns (normals, colors, intensity, labels, shape
+// ids) stay empty until add_*() allocates them, so a cloud only pays for what it has: 12 bytes per
+// point for the positions, 24 with normals, 27 with colors, 32 with labels and shape ids, where a
+// tuple of CGAL point, vector and color takes 56.
+// Colors and labels keep the width of the ply properties (uchar), positions and normals the float
+// precision of the scanner files.
+class Point_cloud
+{
+public:
+	std::vector<float>					x, y, z;
+	std::vector<float>					nx, ny, nz;
+	std::vector<unsigned char>	red, green, blue;
+	std::vector<float>					intensity;
+	std::vector<unsigned char>	label;
+	std::vector<std::int32_t>		id;
+
+	std::size_t size () const				{ return x.size(); }
+	bool empty () const							{ return x.empty(); }
+	bool has_normals () const				{ return !nx.empty() || (empty() && normals_wanted); }
+	bool has_colors () const				{ return !red.empty() || (empty() && colors_wanted); }
+	bool has_intensity () const			{ return !intensity.empty() || (empty() && intensity_wanted); }
+	bool has_labels () const				{ return !label.empty() || (empty() && labels_wanted); }
+	bool has_ids () const						{ return !id.empty() || (empty() && ids_wanted); }
+
+	Point_cloud () : normals_wanted(false), colors_wanted(false), intensity_wanted(false), labels_wanted(false), ids_wanted(false) {}
+
+	// allocate an optional column (zero filled); on an empty cloud the column grows with the points
+	void add_normals ()							{ normals_wanted = true; nx.resize(size()); ny.resize(size()); nz.resize(size()); }
+	void add_colors ()							{ colors_wanted = true; red.resize(size()); green.resize(size()); blue.resize(size()); }
+	void add_intensity ()						{ intensity_wanted = true; intensity.resize(size()); }
+	void add_labels ()							{ labels_wanted = true; label.resize(size()); }
+	void add_ids ()									{ ids_wanted = true; id.resize(size()); }
+
+	// free an optional column
+	void drop_normals ()						{ normals_wanted = false; std::vector<float>().swap(nx); std::vector<float>().swap(ny); std::vector<float>().swap(nz); }
+	void drop_colors ()							{ colors_wanted = false; std::vector<unsigned char>().swap(red); std::vector<unsigned char>().swap(green); std::vector<unsigned char>().swap(blue); }
+	void drop_intensity ()					{ intensity_wanted = false; std::vector<float>().swap(intensity); }
+	void drop_labels ()							{ labels_wanted = false; std::vector<unsigned char>().swap(label); }
+	void drop_ids ()								{ ids_wanted = false; std::vector<std::int32_t>().swap(id); }
+
+	// the positions and every optional column present
+	void resize (std::size_t n)
+	{
+		const bool normals = has_normals(), colors = has_colors(), intensities = has_intensity(), labels = has_labels(), ids = has_ids();
+		x.resize(n); y.resize(n); z.resize(n);
+		if (normals)			{ nx.resize(n); ny.resize(n); nz.resize(n); }
+		if (colors)				{ red.resize(n); green.resize(n); blue.resize(n); }
+		if (intensities)	intensity.resize(n);
+		if (labels)				label.resize(n);
+		if (ids)					id.resize(n);
+	}
+
+	void reserve (std::size_t n)
+	{
+		const bool normals = has_normals(), colors = has_colors(), intensities = has_intensity(), labels = has_labels(), ids = has_ids();
+		x.reserve(n); y.reserve(n); z.reserve(n);
+		if (normals)			{ nx.reserve(n); ny.reserve(n); nz.reserve(n); }
+		if (colors)				{ red.reserve(n); green.reserve(n); blue.reserve(n); }
+		if (intensities)	intensity.reserve(n);
+		if (labels)				label.reserve(n);
+		if (ids)					id.reserve(n);
+	}
+
+	// one more point, with its optional properties at zero; returns its index
+	template <typename P>
+	std::size_t push_back (const P& p)
+	{
+		const std::size_t i = size();
+		resize(i + 1);
+		set_position(i, p);
+		return i;
+	}
+
+	// anything with operator[] (CGAL points and vectors, Vec3)
+	template <typename P>
+	void set_position (std::size_t i, const P& p)	{ x[i] = float(p[0]); y[i] = float(p[1]); z[i] = float(p[2]); }
+	template <typename V>
+	void set_normal (std::size_t i, const V& n)		{ nx[i] = float(n[0]); ny[i] = float(n[1]); nz[i] = float(n[2]); }
+	template <typename C>
+	void set_color (std::size_t i, const C& c)		{ red[i] = c[0]; green[i] = c[1]; blue[i] = c[2]; }
+
+	// anything built from three coordinates
+	template <typename P>
+	P position (std::size_t i) const							{ return P(x[i], y[i], z[i]); }
+	template <typename V>
+	V normal (std::size_t i) const								{ return V(nx[i], ny[i], nz[i]); }
+	template <typename C>
+	C color (std::size_t i) const									{ C c = {{ red[i], green[i], blue[i] }}; return c; }
+
+	// Keep the points whose flag is set, in their order, in every column; returns how many are left
+	std::size_t keep (const std::vector<unsigned char>& flags)
+	{
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < size(); i++)
+			if (flags[i])
+			{
+				if (kept != i)
+					copy(*this, i, kept);
+				kept++;
+			}
+		resize(kept);
+		return kept;
+	}
+
+	// Only the points of indices, in that order (indices may repeat or skip points)
+	void select (const std::vector<std::size_t>& indices)
+	{
+		Point_cloud selected;
+		selected.normals_wanted = has_normals();
+		selected.colors_wanted = has_colors();
+		selected.intensity_wanted = has_intensity();
+		selected.labels_wanted = has_labels();
+		selected.ids_wanted = has_ids();
+		selected.resize(indices.size());
+		for (std::size_t s = 0; s < indices.size(); s++)
+			selected.copy(*this, indices[s], s);
+		swap(selected);
+	}
+
+	void swap (Point_cloud& other)
+	{
+		x.swap(other.x); y.swap(other.y); z.swap(other.z);
+		nx.swap(other.nx); ny.swap(other.ny); nz.swap(other.nz);
+		red.swap(other.red); green.swap(other.green); blue.swap(other.blue);
+		intensity.swap(other.intensity); label.swap(other.label); id.swap(other.id);
+		std::swap(normals_wanted, other.normals_wanted);
+		std::swap(colors_wanted, other.colors_wanted);
+		std::swap(intensity_wanted, other.intensity_wanted);
+		std::swap(labels_wanted, other.labels_wanted);
+		std::swap(ids_wanted, other.ids_wanted);
+	}
+
+	std::size_t bytes_per_point () const
+	{
+		return 3 * sizeof(float) + (has_normals()? 3 * sizeof(float) : 0) + (has_colors()? 3 : 0) +
+					 (has_intensity()? sizeof(float) : 0) + (has_labels()? 1 : 0) + (has_ids()? sizeof(std::int32_t) : 0);
+	}
+
+private:
+	// an empty cloud remembers which columns it has, so that push_back fills them
+	bool normals_wanted, colors_wanted, intensity_wanted, labels_wanted, ids_wanted;
+
+	void copy (const Point_cloud& from, std::size_t i, std::size_t to)
+	{
+		x[to] = from.x[i]; y[to] = from.y[i]; z[to] = from.z[i];
+		if (!nx.empty())				{ nx[to] = from.nx[i]; ny[to] = from.ny[i]; nz[to] = from.nz[i]; }
+		if (!red.empty())				{ red[to] = from.red[i]; green[to] = from.green[i]; blue[to] = from.blue[i]; }
+		if (!intensity.empty())	intensity[to] = from.intensity[i];
+		if (!label.empty())			label[to] = from.label[i];
+		if (!id.empty())				id[to] = from.id[i];
+	}
+};
+
+// 0, 1, ..., n - 1: the range given to the CGAL algorithms together with the maps below. Those that
+// reorder their input (remove_outliers, mst_orient_normals) permute the indices, not the columns
+std::vector<std::size_t> point_indices (const Point_cloud& cloud)
+{
+	std::vector<std::size_t> indices (cloud.size());
+	for (std::size_t i = 0; i < indices.size(); i++)
+		indices[i] = i;
+	return indices;
+}
+
+//------------------------------------------------------------------------------------------------
+// property maps: from the index of a point to its properties, built from the columns on the fly
+//------------------------------------------------------------------------------------------------
+// position as a CGAL point (or anything built from three coordinates)
+template <typename Point>
+struct Point_cloud_point_map
+{
+	typedef std::size_t															key_type;
+	typedef Point																		value_type;
+	typedef Point																		reference;
+	typedef boost::read_write_property_map_tag			category;
+
+	Point_cloud* cloud;
+	Point_cloud_point_map (Point_cloud* cloud = 0) : cloud(cloud) {}
+
+	friend Point get (const Point_cloud_point_map& map, std::size_t i)								{ return map.cloud->position<Point>(i); }
+	friend void put (const Point_cloud_point_map& map, std::size_t i, const Point& p)	{ map.cloud->set_position(i, p); }
+};
+
+// normal as a CGAL vector; writable, for the normal estimation and orientation
+template <typename Vector>
+struct Point_cloud_normal_map
+{
+	typedef std::size_t															key_type;
+	typedef Vector																	value_type;
+	typedef Vector																	reference;
+	typedef boost::read_write_property_map_tag			category;
+
+	Point_cloud* cloud;
+	Point_cloud_normal_map (Point_cloud* cloud = 0) : cloud(cloud) {}
+
+	friend Vector get (const Point_cloud_normal_map& map, std::size_t i)									{ return map.cloud->normal<Vector>(i); }
+	friend void put (const Point_cloud_normal_map& map, std::size_t i, const Vector& n)		{ map.cloud->set_normal(i, n); }
+};
+
+// color as an array of three uchars
+template <typename Color>
+struct Point_cloud_color_map
+{
+	typedef std::size_t															key_type;
+	typedef Color																		value_type;
+	typedef Color																		reference;
+	typedef boost::read_write_property_map_tag			category;
+
+	Point_cloud* cloud;
+	Point_cloud_color_map (Point_cloud* cloud = 0) : cloud(cloud) {}
+
+	friend Color get (const Point_cloud_color_map& map, std::size_t i)									{ return map.cloud->color<Color>(i); }
+	friend void put (const Point_cloud_color_map& map, std::size_t i, const Color& c)		{ map.cloud->set_color(i, c); }
+};
+
+// a single column (intensity, label, id) by reference
+template <typename T>
+struct Point_cloud_column_map
+{
+	typedef std::size_t															key_type;
+	typedef T																				value_type;
+	typedef T&																			reference;
+	typedef boost::lvalue_property_map_tag					category;
+
+	std::vector<T>* column;
+	Point_cloud_column_map (std::vector<T>* column = 0) : column(column) {}
+
+	friend T& get (const Point_cloud_column_map& map, std::size_t i)								{ return (*map.column)[i]; }
+	friend void put (const Point_cloud_column_map& map, std::size_t i, const T& value)	{ (*map.column)[i] = value; }
+};
+
+template <typename T>
+Point_cloud_column_map<T> make_column_map (std::vector<T>& column)
+{
+	return Point_cloud_column_map<T>(&column);
+}
+
+#endif
@@ -0,0 +1,295 @@
+// clouds handed from a tool to the next one through a named POSIX shared memory segment
+#ifndef SHM_CLOUD_HPP
+#define SHM_CLOUD_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "attributes.hpp"
+#include "point_cloud.hpp"
+
+// Where a tool reads or writes a cloud:
+// - shm://<name> is the shared memory segment /<name>; with shm://<name>?unlink the reader
+//   removes the segment once it has read it (the last tool of a chain);
+// - file://<path> or just <path> is a ply file.
+struct Cloud_uri
+{
+	bool				shared;
+	std::string	path;			// file path or segment name (with the leading /)
+	bool				unlink;
+};
+
+Cloud_uri parse_cloud_uri (const std::string& argument)
+{
+	Cloud_uri uri;
+	uri.shared = false;
+	uri.unlink = false;
+	uri.path = argument;
+	if (argument.compare(0, 6, "shm://") == 0)
+	{
+		uri.shared = true;
+		uri.path = "/" + argument.substr(6);
+		std::string::size_type query = uri.path.find('?');
+		if (query != std::string::npos)
+		{
+			uri.unlink = (uri.path.substr(query + 1) == "unlink");
+			uri.path.erase(query);
+		}
+	}
+	else if (argument.compare(0, 7, "file://") == 0)
+		uri.path = argument.substr(7);
+	return uri;
+}
+
+// Layout of a segment: this header, then the columns present, each starting at its offset
+// (64 byte aligned); an absent column has offset 0
+#define SHM_CLOUD_MAGIC		0x4c435357u		// "WSCL"
+#define SHM_CLOUD_VERSION	2u
+
+enum Shm_column { SHM_X, SHM_Y, SHM_Z, SHM_NX, SHM_NY, SHM_NZ, SHM_RED, SHM_GREEN, SHM_BLUE, SHM_INTENSITY, SHM_LABEL,
+									SHM_ID, SHM_COLUMNS };
+
+struct Shm_cloud_header
+{
+	std::uint32_t	magic;
+	std::uint32_t	version;
+	std::uint64_t	count;
+	std::uint64_t	bytes;								// whole segment
+	std::uint64_t	offset[SHM_COLUMNS];
+};
+
+// pointer and size in bytes of each column of the cloud (0 if absent)
+void shm_columns (const Point_cloud& cloud, const void* data[SHM_COLUMNS], std::size_t size[SHM_COLUMNS])
+{
+	const std::size_t n = cloud.size();
+	const void* d[SHM_COLUMNS] = {	cloud.x.data(), cloud.y.data(), cloud.z.data(), cloud.nx.data(), cloud.ny.data(), cloud.nz.data(),
+																	cloud.red.data(), cloud.green.data(), cloud.blue.data(), cloud.intensity.data(), cloud.label.data(),
+																	cloud.id.data() };
+	std::size_t s[SHM_COLUMNS] = {	n * 4, n * 4, n * 4, cloud.nx.size() * 4, cloud.ny.size() * 4, cloud.nz.size() * 4,
+																	cloud.red.size(), cloud.green.size(), cloud.blue.size(), cloud.intensity.size() * 4, cloud.label.size(),
+																	cloud.id.size() * 4 };
+	for (int c = 0; c < SHM_COLUMNS; c++)
+	{
+		data[c] = d[c];
+		size[c] = s[c];
+	}
+}
+
+// bytes per point of column c
+std::size_t shm_element_size (int c)
+{
+	return (c == SHM_RED || c == SHM_GREEN || c == SHM_BLUE || c == SHM_LABEL)? 1 : 4;
+}
+
+// Header of the segment holding cloud: the offsets of the columns present, and its size
+Shm_cloud_header cloud_segment_header (const Point_cloud& cloud)
+{
+	const void*	data[SHM_COLUMNS];
+	std::size_t	size[SHM_COLUMNS];
+	shm_columns(cloud, data, size);
+	Shm_cloud_header header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = SHM_CLOUD_MAGIC;
+	header.version = SHM_CLOUD_VERSION;
+	header.count = cloud.size();
+	std::uint64_t end = (sizeof(header) + 63) & ~std::uint64_t(63);
+	for (int c = 0; c < SHM_COLUMNS; c++)
+		if (size[c] > 0)
+		{
+			header.offset[c] = end;
+			end = (end + size[c] + 63) & ~std::uint64_t(63);
+		}
+	header.bytes = end;
+	return header;
+}
+
+// Lay the cloud out in segment (header.bytes long, see cloud_segment_header)
+void write_cloud_segment (char* segment, const Shm_cloud_header& header, const Point_cloud& cloud)
+{
+	const void*	data[SHM_COLUMNS];
+	std::size_t	size[SHM_COLUMNS];
+	shm_columns(cloud, data, size);
+	std::memcpy(segment, &header, sizeof(header));
+	for (int c = 0; c < SHM_COLUMNS; c++)
+		if (size[c] > 0)
+			std::memcpy(segment + header.offset[c], data[c], size[c]);
+}
+
+// Write the cloud to the segment name (created or replaced); it stays there until a reader with
+// unlink, or shm_unlink, removes it
+bool publish_cloud (const std::string& name, const Point_cloud& cloud)
+{
+	Shm_cloud_header header = cloud_segment_header(cloud);
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, off_t(header.bytes)) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* map = mmap(0, std::size_t(header.bytes), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	write_cloud_segment(static_cast<char*>(map), header, cloud);
+	munmap(map, std::size_t(header.bytes));
+	return true;
+}
+
+#define SHM_ALL_COLUMNS		((1u << SHM_COLUMNS) - 1)
+
+// Copy the columns of a segment of bytes bytes (mapped or read from a file) into cloud, only those
+// of the mask (bit c for column c); false if it is not a cloud
+bool read_cloud_segment (const char* segment, std::size_t bytes, Point_cloud& cloud, unsigned columns = SHM_ALL_COLUMNS)
+{
+	if (bytes < sizeof(Shm_cloud_header))
+		return false;
+	Shm_cloud_header header;
+	std::memcpy(&header, segment, sizeof(header));
+	bool valid = header.magic == SHM_CLOUD_MAGIC && header.version == SHM_CLOUD_VERSION &&
+								header.bytes <= std::uint64_t(bytes) && header.offset[SHM_X] != 0;
+	// every column of the header within the segment before anything is allocated: a truncated or
+	// corrupt segment (or cache entry) must not ask for count points it does not hold
+	for (int c = 0; c < SHM_COLUMNS && valid; c++)
+		if (header.offset[c] != 0)
+			valid = header.offset[c] <= header.bytes &&
+							header.count <= (header.bytes - header.offset[c]) / shm_element_size(c);
+	if (!valid)
+		return false;
+	const std::size_t n = std::size_t(header.count);
+	cloud = Point_cloud();
+	for (int c = 0; c < SHM_COLUMNS; c++)
+		if (header.offset[c] == 0)
+			columns &= ~(1u << c);
+	if (columns & (1u << SHM_NX))					cloud.add_normals();
+	if (columns & (1u << SHM_RED))				cloud.add_colors();
+	if (columns & (1u << SHM_INTENSITY))	cloud.add_intensity();
+	if (columns & (1u << SHM_LABEL))			cloud.add_labels();
+	if (columns & (1u << SHM_ID))					cloud.add_ids();
+	cloud.resize(n);
+	const void*	data[SHM_COLUMNS];
+	std::size_t	size[SHM_COLUMNS];
+	shm_columns(cloud, data, size);
+	for (int c = 0; c < SHM_COLUMNS && valid; c++)
+		if (size[c] > 0)
+		{
+			valid = header.offset[c] != 0 && header.offset[c] + size[c] <= header.bytes;
+			if (valid)
+				std::memcpy(const_cast<void*>(data[c]), segment + header.offset[c], size[c]);
+		}
+	return valid;
+}
+
+// Copy the columns of the segment name into cloud, only those of the mask (bit c for column c);
+// false if it does not exist or is not a cloud
+bool attach_cloud (const std::string& name, Point_cloud& cloud, bool unlink = false, unsigned columns = SHM_ALL_COLUMNS)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || std::size_t(info.st_size) < sizeof(Shm_cloud_header))
+	{
+		close(fd);
+		return false;
+	}
+	void* map = mmap(0, std::size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	bool valid = read_cloud_segment(static_cast<const char*>(map), std::size_t(info.st_size), cloud, columns);
+	munmap(map, std::size_t(info.st_size));
+	if (valid && unlink)
+		shm_unlink(name.c_str());
+	return valid;
+}
+
+// the columns of an attribute set, as the mask of attach_cloud
+template <typename Attributes>
+unsigned shm_column_mask ()
+{
+	unsigned columns = (1u << SHM_X) | (1u << SHM_Y) | (1u << SHM_Z);
+	if (Attributes::normals)		columns |= (1u << SHM_NX) | (1u << SHM_NY) | (1u << SHM_NZ);
+	if (Attributes::colors)			columns |= (1u << SHM_RED) | (1u << SHM_GREEN) | (1u << SHM_BLUE);
+	if (Attributes::intensity)	columns |= (1u << SHM_INTENSITY);
+	if (Attributes::labels)			columns |= (1u << SHM_LABEL) | (1u << SHM_ID);
+	return columns;
+}
+
+// Only the columns of the attribute set are copied; those the segment lacks are left at zero
+template <typename Attributes>
+bool attach_cloud_attributes (const Cloud_uri& uri, Point_cloud& cloud)
+{
+	if (!attach_cloud(uri.path, cloud, uri.unlink, shm_column_mask<Attributes>()))
+		return false;
+	set_columns<Attributes>(cloud);
+	return true;
+}
+
+// Pairs of point and normal (the Pwn_vector of the detectors and of the pipeline); false if the
+// segment has no normals
+template <typename Pwn_vector>
+bool attach_points_with_normals (const Cloud_uri& uri, Pwn_vector& point_cloud)
+{
+	typedef typename Pwn_vector::value_type	Point_with_normal;
+	Point_cloud columns;
+	if (!attach_cloud(uri.path, columns, uri.unlink, shm_column_mask<Attrs<XYZ, Normal> >()) || !columns.has_normals())
+		return false;
+	point_cloud.resize(columns.size());
+	for (std::size_t i = 0; i < columns.size(); i++)
+		point_cloud[i] = Point_with_normal(	columns.position<typename Point_with_normal::first_type>(i),
+																				columns.normal<typename Point_with_normal::second_type>(i));
+	return true;
+}
+
+// Tuples of point, normal, label and shape id (the PNL of the labeled clouds); false if the
+// segment has no labels
+template <typename Tuple>
+bool attach_labeled_tuples (const Cloud_uri& uri, std::vector<Tuple>& point_cloud)
+{
+	typedef typename std::tuple_element<0, Tuple>::type	Point;
+	typedef typename std::tuple_element<1, Tuple>::type	Vector;
+	Point_cloud columns;
+	if (!attach_cloud(uri.path, columns, uri.unlink) || !columns.has_labels() || !columns.has_ids())
+		return false;
+	point_cloud.assign(columns.size(), Tuple());
+	for (std::size_t i = 0; i < columns.size(); i++)
+	{
+		Tuple& t = point_cloud[i];
+		std::get<0>(t) = columns.position<Point>(i);
+		std::get<1>(t) = columns.has_normals()? columns.normal<Vector>(i) : Vector(0, 0, 0);
+		std::get<2>(t) = columns.label[i];
+		std::get<3>(t) = columns.id[i];
+	}
+	return true;
+}
+
+template <typename Tuple>
+bool publish_labeled_tuples (const Cloud_uri& uri, const std::vector<Tuple>& point_cloud)
+{
+	Point_cloud columns;
+	columns.add_normals();
+	columns.add_labels();
+	columns.add_ids();
+	columns.resize(point_cloud.size());
+	for (std::size_t i = 0; i < point_cloud.size(); i++)
+	{
+		columns.set_position(i, std::get<0>(point_cloud[i]));
+		columns.set_normal(i, std::get<1>(point_cloud[i]));
+		columns.label[i] = (unsigned char)(std::get<2>(point_cloud[i]));
+		columns.id[i] = std::int32_t(std::get<3>(point_cloud[i]));
+	}
+	return publish_cloud(uri.path, columns);
+}
+
+#endif
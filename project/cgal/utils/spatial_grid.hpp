@@ -0,0 +1,153 @@
+// uniform grid over a point cloud for fixed radius neighbor queries
+#ifndef SPATIAL_GRID_HPP
+#define SPATIAL_GRID_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "parallel.hpp"
+
+// Points are bucketed by cell: cells are identified by a 64 bit key (21 bits per axis),
+// the point indices are sorted by key and each non empty cell is a contiguous range of
+// the sorted array. No hashing: a cell is found by binary search among the non empty ones.
+// A cell is never smaller than the extent of the cloud over GRID_AXIS_CELLS, so that distinct
+// cells never share a key: cell_size () may be larger than asked
+#define GRID_AXIS_CELLS		((1L << 21) - 1)
+
+class Spatial_grid
+{
+public:
+	typedef std::uint64_t Key;
+
+	Spatial_grid () : m_cell(1.0) {}
+
+	// positions[i] is the i-th point; cell_size is usually the query radius
+	Spatial_grid (const std::vector<Vec3>& positions, double cell_size)
+	{
+		build(positions, cell_size);
+	}
+
+	void build (const std::vector<Vec3>& positions, double cell_size)
+	{
+		m_origin = make_vec3(	std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+													std::numeric_limits<double>::max());
+		Vec3 corner = make_vec3(	std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(),
+															std::numeric_limits<double>::lowest());
+		for (std::size_t i = 0; i < positions.size(); i++)
+			for (int k = 0; k < 3; k++)
+			{
+				m_origin[k] = std::min(m_origin[k], positions[i][k]);
+				corner[k] = std::max(corner[k], positions[i][k]);
+			}
+		// the coordinates of the cells must fit in the 21 bits of their key
+		double extent = 0.0;
+		for (int k = 0; k < 3 && !positions.empty(); k++)
+			extent = std::max(extent, corner[k] - m_origin[k]);
+		m_cell = std::max(cell_size, extent / double(GRID_AXIS_CELLS));
+
+		std::vector<std::pair<Key, std::size_t> > keyed (positions.size());
+		parallel_for_each_index(positions.size(), [&](std::size_t i)
+		{
+			keyed[i] = std::make_pair(key_of(positions[i]), i);
+		});
+		parallel_sort(keyed.begin(), keyed.end(), [](const std::pair<Key, std::size_t>& a,
+																								 const std::pair<Key, std::size_t>& b) { return a < b; });
+
+		m_order.resize(keyed.size());
+		m_keys.clear();
+		m_start.clear();
+		for (std::size_t i = 0; i < keyed.size(); i++)
+		{
+			m_order[i] = keyed[i].second;
+			if (i == 0 || keyed[i].first != keyed[i - 1].first)
+			{
+				m_keys.push_back(keyed[i].first);
+				m_start.push_back(i);
+			}
+		}
+		m_start.push_back(keyed.size());
+	}
+
+	double cell_size () const									{ return m_cell; }
+	// lower corner of the cell with integer coordinates 0, 0, 0
+	const Vec3& origin () const								{ return m_origin; }
+	std::size_t number_of_cells () const				{ return m_keys.size(); }
+
+	// integer coordinates of the cell holding p
+	void cell_of (const Vec3& p, long c[3]) const
+	{
+		for (int k = 0; k < 3; k++)
+			c[k] = long(std::floor((p[k] - m_origin[k]) / m_cell));
+	}
+
+	Key key_of (const Vec3& p) const
+	{
+		long c[3];
+		cell_of(p, c);
+		return key_of(c);
+	}
+
+	static Key key_of (const long c[3])
+	{
+		const long mask = GRID_AXIS_CELLS;
+		return (Key(c[0] & mask) << 42) | (Key(c[1] & mask) << 21) | Key(c[2] & mask);
+	}
+
+	// point indices in the cell-th non empty cell, as a [begin, end) range of the sorted order
+	std::pair<const std::size_t*, const std::size_t*> cell_range (std::size_t cell) const
+	{
+		return std::make_pair(m_order.data() + m_start[cell], m_order.data() + m_start[cell + 1]);
+	}
+
+	// point indices in the cell with integer coordinates c, as a [begin, end) range
+	// of the sorted order (empty if the cell is)
+	std::pair<const std::size_t*, const std::size_t*> cell_points (const long c[3]) const
+	{
+		for (int k = 0; k < 3; k++)
+			if (c[k] < 0 || c[k] > GRID_AXIS_CELLS)
+				return std::make_pair((const std::size_t*)0, (const std::size_t*)0);
+		Key key = key_of(c);
+		std::vector<Key>::const_iterator it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+		if (it == m_keys.end() || *it != key)
+			return std::make_pair((const std::size_t*)0, (const std::size_t*)0);
+		return cell_range(std::size_t(it - m_keys.begin()));
+	}
+
+	// call f(index, squared_distance) for each point within radius from q
+	template <typename Function>
+	void for_each_in_radius (const std::vector<Vec3>& positions, const Vec3& q, double radius, const Function& f) const
+	{
+		long lo[3], hi[3];
+		cell_of(q - make_vec3(radius, radius, radius), lo);
+		cell_of(q + make_vec3(radius, radius, radius), hi);
+		const double sq_radius = radius * radius;
+		long c[3];
+		for (c[0] = lo[0]; c[0] <= hi[0]; c[0]++)
+			for (c[1] = lo[1]; c[1] <= hi[1]; c[1]++)
+				for (c[2] = lo[2]; c[2] <= hi[2]; c[2]++)
+				{
+					std::pair<const std::size_t*, const std::size_t*> range = cell_points(c);
+					for (const std::size_t* i = range.first; i != range.second; ++i)
+					{
+						double d = squared_length(positions[*i] - q);
+						if (d <= sq_radius)
+							f(*i, d);
+					}
+				}
+	}
+
+private:
+	double									m_cell;
+	Vec3										m_origin;
+	std::vector<Key>				m_keys;		// non empty cells, sorted
+	std::vector<std::size_t>	m_start;	// m_start[c] .. m_start[c+1] is the range of cell c in m_order
+	std::vector<std::size_t>	m_order;	// point indices sorted by cell
+};
+
+#endif
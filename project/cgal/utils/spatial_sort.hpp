@@ -0,0 +1,119 @@
+// order of the points along a Morton (Z-order) curve, so that neighbors in space are neighbors in memory
+#ifndef SPATIAL_SORT_HPP
+#define SPATIAL_SORT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "geometry.hpp"
+#include "parallel.hpp"
+#include "point_cloud.hpp"
+
+// The clouds come in the order rtabmap emits them, so the k nearest neighbors of a point are
+// scattered all over the columns and each query of outliers, normals or region growing misses
+// the cache. Sorted by Morton code, the points of a cell of the bounding cube are contiguous at
+// every level of subdivision, and so are most of the neighbors of a point.
+
+// the 21 low bits of v, each followed by two zeros
+std::uint64_t spread_morton_bits (std::uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | (v << 32)) & 0x1f00000000ffffULL;
+	v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+	v = (v | (v << 8)) & 0x100f00f00f00f00fULL;
+	v = (v | (v << 4)) & 0x10c30c30c30c30c3ULL;
+	v = (v | (v << 2)) & 0x1249249249249249ULL;
+	return v;
+}
+
+// code of the cell with integer coordinates x, y, z (21 bits each)
+std::uint64_t morton_code (std::uint32_t x, std::uint32_t y, std::uint32_t z)
+{
+	return spread_morton_bits(x) | (spread_morton_bits(y) << 1) | (spread_morton_bits(z) << 2);
+}
+
+// Order of the n points along the curve, position(i) giving the i-th one as a Vec3: the point
+// that goes to place j is order[j]. The bounding cube is split in 2^21 cells per side; points
+// of the same cell keep their relative order
+template <typename Position>
+std::vector<std::size_t> morton_order (std::size_t n, const Position& position)
+{
+	typedef std::pair<Vec3, Vec3> Box;
+	const double inf = std::numeric_limits<double>::max();
+	Box box = parallel_reduce_index(n, std::make_pair(make_vec3(inf, inf, inf), make_vec3(-inf, -inf, -inf)),
+		[&](Box& b, std::size_t i)
+		{
+			const Vec3 p = position(i);
+			for (int k = 0; k < 3; k++)
+			{
+				b.first[k] = std::min(b.first[k], p[k]);
+				b.second[k] = std::max(b.second[k], p[k]);
+			}
+		},
+		[](Box& b, const Box& p)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				b.first[k] = std::min(b.first[k], p.first[k]);
+				b.second[k] = std::max(b.second[k], p.second[k]);
+			}
+		});
+	// a cube, so that the cells are cubes too
+	double side = 0.0;
+	for (int k = 0; k < 3 && n > 0; k++)
+		side = std::max(side, box.second[k] - box.first[k]);
+	const double cells = double((1 << 21) - 1);
+	const double scale = (side > 0.0)? cells / side : 0.0;
+
+	std::vector<std::pair<std::uint64_t, std::size_t> > keyed (n);
+	parallel_for_each_index(n, [&](std::size_t i)
+	{
+		const Vec3 p = position(i);
+		std::uint32_t c[3];
+		for (int k = 0; k < 3; k++)
+			c[k] = std::uint32_t(std::min(cells, (p[k] - box.first[k]) * scale));
+		keyed[i] = std::make_pair(morton_code(c[0], c[1], c[2]), i);
+	});
+	parallel_sort(keyed.begin(), keyed.end(), [](const std::pair<std::uint64_t, std::size_t>& a,
+																							 const std::pair<std::uint64_t, std::size_t>& b) { return a < b; });
+	std::vector<std::size_t> order (n);
+	parallel_for_each_index(n, [&](std::size_t j) { order[j] = keyed[j].second; });
+	return order;
+}
+
+// values[j] becomes what values[order[j]] was
+template <typename T>
+void apply_order (std::vector<T>& values, const std::vector<std::size_t>& order)
+{
+	std::vector<T> ordered (order.size());
+	parallel_for_each_index(order.size(), [&](std::size_t j) { ordered[j] = values[order[j]]; });
+	values.swap(ordered);
+}
+
+// Sort all the columns of the cloud together. Returns the permutation back to the order of the
+// input: the point now at j was at original[j]
+std::vector<std::size_t> spatial_sort (Point_cloud& cloud)
+{
+	std::vector<std::size_t> original = morton_order(cloud.size(), [&cloud](std::size_t i)
+	{
+		return make_vec3(cloud.x[i], cloud.y[i], cloud.z[i]);
+	});
+	cloud.select(original);
+	return original;
+}
+
+// Put the points back in the order of the input. original is the permutation of spatial_sort,
+// kept in step with the cloud when points are removed (it still gives, for each point, its index
+// in the input: the points left are restored in their relative order)
+void restore_order (Point_cloud& cloud, const std::vector<std::size_t>& original)
+{
+	std::vector<std::size_t> order = point_indices(cloud);
+	parallel_sort(order.begin(), order.end(), [&original](std::size_t a, std::size_t b) { return original[a] < original[b]; });
+	cloud.select(order);
+}
+
+#endif
@@ -0,0 +1,110 @@
+// bounded queue between two threads (one producer, one consumer), without locks
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Ring of capacity + 1 slots: the producer only moves the tail, the consumer only the head, so one
+// atomic store each is enough to hand an item over. push waits while the queue is full
+// (backpressure: a fast stage cannot run ahead of a slow one by more than capacity items), pop
+// waits while it is empty and returns false once the producer has closed it and it is drained.
+// Waiting spins a little, then yields, then sleeps: the items are whole clouds, a wait of a
+// fraction of a millisecond costs nothing compared to processing one.
+template <typename T>
+class Spsc_queue
+{
+public:
+	explicit Spsc_queue (std::size_t capacity) : slots(capacity + 1), head(0), tail(0), closed(false),
+																							pushes(0), full(0), occupancy_sum(0) {}
+
+	std::size_t capacity () const	{ return slots.size() - 1; }
+
+	// items waiting; exact only when called by the producer or the consumer
+	std::size_t size () const
+	{
+		const std::size_t h = head.load(std::memory_order_acquire), t = tail.load(std::memory_order_acquire);
+		return (t + slots.size() - h) % slots.size();
+	}
+
+	bool try_push (T& item)
+	{
+		const std::size_t t = tail.load(std::memory_order_relaxed);
+		const std::size_t next = (t + 1) % slots.size();
+		if (next == head.load(std::memory_order_acquire))
+			return false;
+		slots[t] = std::move(item);
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop (T& item)
+	{
+		const std::size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(slots[h]);
+		head.store((h + 1) % slots.size(), std::memory_order_release);
+		return true;
+	}
+
+	// producer side
+	void push (T item)
+	{
+		if (!try_push(item))
+		{
+			full++;
+			for (unsigned wait = 0; !try_push(item); wait++)
+				back_off(wait);
+		}
+		pushes++;
+		occupancy_sum += size();
+	}
+
+	void close ()	{ closed.store(true, std::memory_order_release); }
+
+	// consumer side; false when closed and empty
+	bool pop (T& item)
+	{
+		for (unsigned wait = 0; !try_pop(item); wait++)
+		{
+			if (closed.load(std::memory_order_acquire))
+				return try_pop(item);		// the last items may have arrived before close
+			back_off(wait);
+		}
+		return true;
+	}
+
+	// producer statistics: items pushed, pushes that found the queue full, mean number of items
+	// waiting right after a push
+	std::size_t pushed () const						{ return pushes; }
+	std::size_t found_full () const				{ return full; }
+	double mean_occupancy () const				{ return pushes? double(occupancy_sum) / double(pushes) : 0.0; }
+
+private:
+	static void back_off (unsigned wait)
+	{
+		if (wait < 64)
+			return;
+		if (wait < 128)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	// head and tail on different cache lines, so that the two threads do not invalidate each other
+	std::vector<T>							slots;
+	char												line_before_head[64];
+	std::atomic<std::size_t>		head;
+	char												line_before_tail[64];
+	std::atomic<std::size_t>		tail;
+	char												line_after_tail[64];
+	std::atomic<bool>						closed;
+	std::size_t									pushes, full, occupancy_sum;
+};
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * STAGE CACHE
+ * Outputs of the pipeline stages kept on disk, content addressed: the key of an output is a hash
+ * of the input cloud (its columns, byte by byte), the name of the stage and its parameters, so a
+ * stage run again on the same cloud with the same parameters loads its output instead of
+ * computing it. Each entry is a file <key>.stage of the cache directory: a small header (key,
+ * stage, up to CACHE_VALUES numbers the stage wants back, e.g. the box of the cut) followed by the
+ * cloud laid out as a shared memory segment (see shm_cloud.hpp).
+ * The directory is bounded in size: after a store, the entries used least recently (the
+ * modification time of a file is touched when it is loaded) are removed until the total fits.
+ * Entries are written to a temporary file and renamed, so that processes and threads can share
+ * the directory; hits, misses and stores are counted per stage.
+ */
+#ifndef STAGE_CACHE_HPP
+#define STAGE_CACHE_HPP
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "point_cloud.hpp"
+#include "shm_cloud.hpp"
+
+typedef std::uint64_t Cache_key;
+
+#define STAGE_CACHE_MAGIC		0x43535357u		// "WSSC"
+#define CACHE_VALUES				8
+#define FNV_OFFSET_BASIS		0xcbf29ce484222325ull
+#define FNV_PRIME						0x100000001b3ull
+
+// FNV-1a of size bytes, going on from hash
+Cache_key hash_bytes (const void* data, std::size_t size, Cache_key hash = FNV_OFFSET_BASIS)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (std::size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	return hash;
+}
+
+// hash of the columns of the cloud (which ones are present included)
+Cache_key cloud_key (const Point_cloud& cloud)
+{
+	const void*	data[SHM_COLUMNS];
+	std::size_t	size[SHM_COLUMNS];
+	shm_columns(cloud, data, size);
+	std::uint64_t count = cloud.size();
+	Cache_key hash = hash_bytes(&count, sizeof(count));
+	for (std::uint32_t c = 0; c < SHM_COLUMNS; c++)
+		if (size[c] > 0)
+		{
+			hash = hash_bytes(&c, sizeof(c), hash);
+			hash = hash_bytes(data[c], size[c], hash);
+		}
+	return hash;
+}
+
+// key of the output of stage on the input of key input, with the parameters written as a string
+Cache_key stage_key (Cache_key input, const std::string& stage, const std::string& parameters)
+{
+	Cache_key hash = hash_bytes(&input, sizeof(input));
+	hash = hash_bytes(stage.c_str(), stage.size() + 1, hash);
+	return hash_bytes(parameters.data(), parameters.size(), hash);
+}
+
+struct Cache_entry_header
+{
+	std::uint32_t	magic;
+	std::uint32_t	values;									// how many of value are used
+	Cache_key			key;
+	char					stage[32];
+	double				value[CACHE_VALUES];
+};
+
+struct Cache_stats
+{
+	std::size_t		hits, misses, stores;
+	std::uint64_t	bytes_loaded, bytes_stored;
+
+	Cache_stats () : hits(0), misses(0), stores(0), bytes_loaded(0), bytes_stored(0) {}
+};
+
+class Stage_cache
+{
+public:
+	// max_bytes bounds the size of all the entries of directory (created if missing)
+	Stage_cache (const std::string& directory, std::uint64_t max_bytes) : m_directory(directory), m_limit(max_bytes), m_evictions(0)
+	{
+		if (!m_directory.empty() && m_directory[m_directory.size() - 1] == '/')
+			m_directory.erase(m_directory.size() - 1);
+		m_ready = mkdir(m_directory.c_str(), 0755) == 0 || errno == EEXIST;
+		struct stat info;
+		m_ready = m_ready && stat(m_directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+	}
+
+	bool ready () const													{ return m_ready; }
+	const std::string& directory () const				{ return m_directory; }
+	std::uint64_t limit () const								{ return m_limit; }
+
+	// The output of stage with key into cloud, and the values stored with it; false (a miss) if
+	// there is no such entry or it cannot be read
+	bool load (const std::string& stage, Cache_key key, Point_cloud& cloud, std::vector<double>& values)
+	{
+		const std::string path = entry_path(key);
+		bool hit = false;
+		std::size_t bytes = 0;
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat info;
+		if (fd >= 0 && fstat(fd, &info) == 0 && std::size_t(info.st_size) > sizeof(Cache_entry_header))
+		{
+			bytes = std::size_t(info.st_size);
+			void* map = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);
+			if (map != MAP_FAILED)
+			{
+				const char* entry = static_cast<const char*>(map);
+				Cache_entry_header header;
+				std::memcpy(&header, entry, sizeof(header));
+				hit = header.magic == STAGE_CACHE_MAGIC && header.key == key && header.values <= CACHE_VALUES &&
+							strncmp(header.stage, stage.c_str(), sizeof(header.stage)) == 0 &&
+							read_cloud_segment(entry + sizeof(header), bytes - sizeof(header), cloud);
+				if (hit)
+					values.assign(header.value, header.value + header.values);
+				munmap(map, bytes);
+			}
+		}
+		if (fd >= 0)
+			close(fd);
+		if (hit)
+			utimensat(AT_FDCWD, path.c_str(), 0, 0);		// now: used most recently
+		std::lock_guard<std::mutex> lock (m_mutex);
+		Cache_stats& stats = m_stats[stage];
+		if (hit)
+		{
+			stats.hits++;
+			stats.bytes_loaded += bytes;
+		}
+		else
+			stats.misses++;
+		return hit;
+	}
+
+	bool load (const std::string& stage, Cache_key key, Point_cloud& cloud)
+	{
+		std::vector<double> values;
+		return load(stage, key, cloud, values);
+	}
+
+	// Keep cloud (and up to CACHE_VALUES values) as the output of stage with key, then evict the
+	// entries used least recently beyond the limit; false if it cannot be written or is larger
+	// than the whole cache
+	bool store (const std::string& stage, Cache_key key, const Point_cloud& cloud, const std::vector<double>& values = std::vector<double>())
+	{
+		Cache_entry_header header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = STAGE_CACHE_MAGIC;
+		header.key = key;
+		header.values = std::uint32_t(std::min<std::size_t>(values.size(), CACHE_VALUES));
+		std::strncpy(header.stage, stage.c_str(), sizeof(header.stage) - 1);
+		std::copy(values.begin(), values.begin() + header.values, header.value);
+		const Shm_cloud_header segment = cloud_segment_header(cloud);
+		const std::size_t bytes = sizeof(header) + std::size_t(segment.bytes);
+		if (!m_ready || bytes > m_limit)
+			return false;
+
+		const std::string path = entry_path(key);
+		const std::string temporary = path + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(m_temporaries++);
+		int fd = open(temporary.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		bool written = ftruncate(fd, off_t(bytes)) == 0;
+		void* map = written? mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+		close(fd);
+		if (map != MAP_FAILED)
+		{
+			char* entry = static_cast<char*>(map);
+			std::memcpy(entry, &header, sizeof(header));
+			write_cloud_segment(entry + sizeof(header), segment, cloud);
+			munmap(map, bytes);
+		}
+		written = map != MAP_FAILED && std::rename(temporary.c_str(), path.c_str()) == 0;
+		if (!written)
+		{
+			std::remove(temporary.c_str());
+			return false;
+		}
+		std::lock_guard<std::mutex> lock (m_mutex);
+		Cache_stats& stats = m_stats[stage];
+		stats.stores++;
+		stats.bytes_stored += bytes;
+		evict(path);
+		return true;
+	}
+
+	std::map<std::string, Cache_stats> stats () const
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		return m_stats;
+	}
+
+	// size of all the entries now in the directory
+	std::uint64_t size () const
+	{
+		std::vector<Entry> entries = list_entries();
+		std::uint64_t total = 0;
+		for (std::size_t i = 0; i < entries.size(); i++)
+			total += entries[i].bytes;
+		return total;
+	}
+
+	void print_stats (std::ostream& out) const
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		out << "Stage cache " << m_directory << ":";
+		if (m_stats.empty())
+			out << " not used";
+		for (std::map<std::string, Cache_stats>::const_iterator s = m_stats.begin(); s != m_stats.end(); ++s)
+			out << (s == m_stats.begin()? " " : ", ") << s->first << " " << s->second.hits << " hit(s) / "
+					<< s->second.misses << " miss(es), " << s->second.stores << " stored";
+		out << "; " << m_evictions << " entr" << (m_evictions == 1? "y" : "ies") << " evicted, "
+				<< double(size()) / (1024.0 * 1024.0) << " of " << double(m_limit) / (1024.0 * 1024.0) << " MB in use\n";
+	}
+
+private:
+	struct Entry
+	{
+		std::string		path;
+		std::uint64_t	bytes;
+		struct timespec	used;
+	};
+
+	std::string entry_path (Cache_key key) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "/%016llx.stage", static_cast<unsigned long long>(key));
+		return m_directory + name;
+	}
+
+	std::vector<Entry> list_entries () const
+	{
+		std::vector<Entry> entries;
+		DIR* dir = opendir(m_directory.c_str());
+		if (dir == 0)
+			return entries;
+		for (struct dirent* e = readdir(dir); e != 0; e = readdir(dir))
+		{
+			std::string name = e->d_name;
+			struct stat info;
+			if (name.size() < 6 || name.compare(name.size() - 6, 6, ".stage") != 0)
+				continue;
+			Entry entry;
+			entry.path = m_directory + "/" + name;
+			if (stat(entry.path.c_str(), &info) != 0)
+				continue;
+			entry.bytes = std::uint64_t(info.st_size);
+			entry.used = info.st_mtim;
+			entries.push_back(entry);
+		}
+		closedir(dir);
+		return entries;
+	}
+
+	// remove the entries used least recently until the directory fits in the limit; kept is never
+	// removed. The directory is listed again each time, since other processes may share it
+	void evict (const std::string& kept)
+	{
+		std::vector<Entry> entries = list_entries();
+		std::uint64_t total = 0;
+		for (std::size_t i = 0; i < entries.size(); i++)
+			total += entries[i].bytes;
+		if (total <= m_limit)
+			return;
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+		{
+			return a.used.tv_sec < b.used.tv_sec || (a.used.tv_sec == b.used.tv_sec && a.used.tv_nsec < b.used.tv_nsec);
+		});
+		for (std::size_t i = 0; i < entries.size() && total > m_limit; i++)
+			if (entries[i].path != kept && std::remove(entries[i].path.c_str()) == 0)
+			{
+				total -= entries[i].bytes;
+				m_evictions++;
+			}
+	}
+
+	std::string														m_directory;
+	std::uint64_t													m_limit;
+	bool																	m_ready;
+	mutable std::mutex										m_mutex;
+	std::map<std::string, Cache_stats>		m_stats;
+	std::size_t														m_evictions;
+	std::atomic<std::size_t>							m_temporaries {0};
+};
+
+#endif
@@ -0,0 +1,88 @@
+// fixed number of worker threads taking tasks from a shared queue
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Tasks are run in the order they are submitted, each one by the first free worker; a task
+// is meant to be a whole job (e.g. one detection) that is not split in parallel loops itself.
+// The destructor lets the queued tasks finish before joining the workers
+class Thread_pool
+{
+public:
+	// threads == 0 means one per hardware thread
+	explicit Thread_pool (std::size_t threads = 0) : m_stop(false)
+	{
+		if (threads == 0)
+			threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+		for (std::size_t t = 0; t < threads; t++)
+			m_workers.push_back(std::thread([this] { work(); }));
+	}
+
+	~Thread_pool ()
+	{
+		{
+			std::lock_guard<std::mutex> lock (m_mutex);
+			m_stop = true;
+		}
+		m_ready.notify_all();
+		for (std::size_t t = 0; t < m_workers.size(); t++)
+			m_workers[t].join();
+	}
+
+	Thread_pool (const Thread_pool&) = delete;
+	Thread_pool& operator= (const Thread_pool&) = delete;
+
+	std::size_t size () const	{ return m_workers.size(); }
+
+	// queue f(); the future gives its result (or rethrows its exception)
+	template <typename Function>
+	std::future<typename std::result_of<Function()>::type> submit (Function f)
+	{
+		typedef typename std::result_of<Function()>::type Result;
+		std::shared_ptr<std::packaged_task<Result()> > task (new std::packaged_task<Result()>(f));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock (m_mutex);
+			m_tasks.push_back([task] { (*task)(); });
+		}
+		m_ready.notify_one();
+		return result;
+	}
+
+private:
+	void work ()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock (m_mutex);
+				m_ready.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+				if (m_tasks.empty())
+					return;
+				task = m_tasks.front();
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread>						m_workers;
+	std::deque<std::function<void()> >	m_tasks;
+	std::mutex													m_mutex;
+	std::condition_variable							m_ready;
+	bool																m_stop;
+};
+
+#endif
@@ -0,0 +1,60 @@
+// disjoint sets over point indices that many threads can merge at the same time
+#ifndef UNION_FIND_HPP
+#define UNION_FIND_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Lock-free union-find: every root is the smallest index of its set, because unite()
+// always hangs the larger root below the smaller one with a compare-and-swap. The final
+// partition (and hence find() of every element) does not depend on the order in which
+// the unions are made, so the result is the same whatever the number of threads
+class Concurrent_union_find
+{
+public:
+	explicit Concurrent_union_find (std::size_t n) : m_parent(n)
+	{
+		for (std::size_t i = 0; i < n; i++)
+			m_parent[i].store(i, std::memory_order_relaxed);
+	}
+
+	std::size_t size () const	{ return m_parent.size(); }
+
+	std::size_t find (std::size_t i)
+	{
+		std::size_t p = m_parent[i].load(std::memory_order_acquire);
+		while (p != i)
+		{
+			// path halving: a failed exchange only means someone else shortened it first
+			std::size_t gp = m_parent[p].load(std::memory_order_acquire);
+			m_parent[i].compare_exchange_weak(p, gp, std::memory_order_acq_rel);
+			i = p;
+			p = m_parent[i].load(std::memory_order_acquire);
+		}
+		return i;
+	}
+
+	void unite (std::size_t a, std::size_t b)
+	{
+		while (true)
+		{
+			a = find(a);
+			b = find(b);
+			if (a == b)
+				return;
+			if (a > b)
+				std::swap(a, b);
+			// b is the larger root: link it below a, unless it stopped being a root meanwhile
+			std::size_t expected = b;
+			if (m_parent[b].compare_exchange_strong(expected, a, std::memory_order_acq_rel))
+				return;
+		}
+	}
+
+private:
+	std::vector<std::atomic<std::size_t> > m_parent;
+};
+
+#endif
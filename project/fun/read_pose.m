@@ -0,0 +1,9 @@
+% legge la posa dell'assile salvata da pipeline --pose (o da pipeline_batch in
+% <name>_pose.json): centro, asse, raggio e offset su X, senza rileggere la
+% nuvola cleardetect_*.ply con pcread
+function pose = read_pose (posefile)
+    pose = jsondecode(fileread(posefile));
+    pose.center = pose.center';
+    pose.point = pose.point';
+    pose.axis = pose.axis';
+end
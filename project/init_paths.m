@@ -13,4 +13,7 @@ cut_prog = [home_folder 'cgal/Cut/cut '];
 outlier_prog = [home_folder 'cgal/Outliers/outliers '];
 norm_prog = [home_folder 'cgal/Normals/compute_onormals '];
 detect_prog = [home_folder 'cgal/Detect_shape/RANSAC/detect_shapes_ransac --verbose --defaults ']; % default parameters
-clear_prog = [home_folder 'cgal/Clear_shape/clear_shape ']; % add --keep-color to preserve planes
+clear_prog = [home_folder 'cgal/Clear_shape/clear_shape ']; % add --keep-color to preserve planes (not needed with detect --cylinders-only)
+pipeline_prog = [home_folder 'cgal/Pipeline/pipeline ']; % cut + outliers + detection in a single program
+client_prog = [home_folder 'cgal/Daemon/wheelset_client ']; % needs wheelsetd running (cgal/Daemon/wheelsetd ply/limits.ply)
+offsets_prog = [home_folder 'cgal/Pipeline/offsets ']; % offsets kept by pipeline --store
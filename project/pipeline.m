@@ -30,6 +30,16 @@ if strcmp(anw, 'yes') == 1
 else
     plot_all_steps = false;
 end
+% le forme trovate sono salvate come etichette (label, shape_id): i colori
+% servono solo per la visualizzazione, quindi si chiedono solo se si plotta;
+% senza plot cut e outliers non leggono ne' scrivono i colori della nuvola
+if plot_all_steps == true
+    colors_opt = '--colors ';
+    carry_opt = '';
+else
+    colors_opt = '';
+    carry_opt = '--no-colors ';
+end
 
 % misuriamo il tempo di computazione dell'intera pipeline facendo partire
 % il cronometro di Matlab...
@@ -49,7 +59,7 @@ end
 input_file = [ply_pl 'c_' name ply];
 output_file = [ply_pl 'cut_' name ply];
 limits = [ply_pl 'limits.ply'];
-command = [cut_prog input_file ' ' output_file ' ' limits];
+command = [cut_prog carry_opt input_file ' ' output_file ' ' limits];
 if system(command) ~= 0
     fprintf('Error at: step %d, iteration %d, cloud %s\n', 1, 1, name);
     return;
@@ -67,7 +77,7 @@ for i=1 : outer_iterations
         % 2) remove outliers
         input_file = output_file;
         output_file = [ply_pl 'out_' name ply]; % la prima volta e' cut_, poi cleardetect_
-        command = [outlier_prog input_file ' ' output_file];
+        command = [outlier_prog carry_opt input_file ' ' output_file];
         if system(command) ~= 0
             fprintf('Error at: step %d, iteration %d, cloud %s\n', 1, i, name);
             return;
@@ -77,26 +87,24 @@ for i=1 : outer_iterations
         end
     end
 
-    % 3) detection
+    % 3-4) detection e cleaning in un solo passo: il detector salva solo i
+    % punti dei cilindri accettati (come avrebbe fatto clear_shape). La
+    % nuvola completa colorata si scrive solo se serve il plot (debug)
     input_file = output_file;
-    output_file = [ply_pl 'detect_' name ply];
-    command = [detect_prog input_file ' ' output_file]
-    if system(command) ~= 0
-        fprintf('Error at: step %d, iteration %d, cloud %s\n', 3, i, name);
-        return;
-    end
+    output_file = [ply_pl 'cleardetect_' name ply];
     if plot_all_steps == true
-        plot_cloud (output_file, ['Step 3.' num2str(i) ' - shape detection']);
+        debug_file = [ply_pl 'detect_' name ply];
+        debug_opt = ['--debug ' debug_file ' '];
+    else
+        debug_opt = '';
     end
-    % 4) cleaning: rimangono solo i cilindri
-    input_file = output_file;
-    output_file = [ply_pl 'cleardetect_' name ply];
-    command = [clear_prog input_file ' ' output_file]
+    command = [detect_prog '--cylinders-only ' colors_opt debug_opt input_file ' ' output_file]
     if system(command) ~= 0
-        fprintf('Error at: step %d, iteration %d, cloud %s\n', 4, i, name);
-        return;        
+        fprintf('Error at: step %d, iteration %d, cloud %s\n', 3, i, name);
+        return;
     end
     if plot_all_steps == true
+        plot_cloud (debug_file, ['Step 3.' num2str(i) ' - shape detection']);
         plot_cloud (output_file, ['Step 4.' num2str(i) ' - isolating cylinders']);
     end
     % output_file = '...ply/cleardetect_out_<filename>.ply'